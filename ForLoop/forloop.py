@@ -50,6 +50,11 @@ ccmd_command = r'..\bin\linux\ccmd.exe'
 # ccmd_command = os.path.expanduser(ccmd_command)
 max_threads = 4
 
+# Number of parameter points run together by each copy of CCMD. Points run
+# together as an ensemble must have the same ions and numbers of steps, and
+# use the verlet integrator; they can differ in voltages, laser and seed.
+replicas_per_run = 1
+
 #======================================================================
 
 # Read base input file and convert to a Python template.
@@ -73,19 +78,24 @@ def do_loop():
     template_file are replaced with the current values and the file is written
     to the new working drectory, overwriting one already there.
 
-    Each working directory is passed to a ThreadCounter object that handles
-    calling the ccmd executable and limiting the number of concurrently running
-    copies.
+    The working directories are passed in groups of replicas_per_run to a
+    ThreadCounter object that handles calling the ccmd executable and limiting
+    the number of concurrently running copies.
     """
 
+    group = []
     for i_val in i_vals:
         for j_val in j_vals:
             # Build a dictionary of replacements for the placeholders
-            replacements = dict(i=i_val, j=j_val)
-
-            # Start a thread to execute CCMD when ready.
-            exe = ThreadCounter(replacements)
-            exe.start()
+            group.append(dict(i=i_val, j=j_val))
+            if len(group) == replicas_per_run:
+                # Start a thread to execute CCMD when ready.
+                exe = ThreadCounter(group)
+                exe.start()
+                group = []
+    if group:
+        exe = ThreadCounter(group)
+        exe.start()
 
 #===============================================================================
 
@@ -96,43 +106,48 @@ class ThreadCounter(threading.Thread):
     """
     Class to handle executing a new copy of CCMD when ready. The execution is
     blocked until the semaphore can be acquired, then the command-line for
-    CCMD is passed to a subprocess for execution.
+    CCMD is passed to a subprocess for execution. One copy of CCMD runs all
+    the working directories of the group as an ensemble.
     """
-    def __init__(self, replacements):
+    def __init__(self, group):
         threading.Thread.__init__(self)
-        self.replacements = replacements
+        self.group = group
     def run(self):
         thread_limit.acquire()
         try:
-            # Substitute placeholders in file path and input file templates.
-            # Fail and quit the script if we are left with anything
-            # un-substituted.
-            new_params = params_template.substitute(self.replacements)
-            new_path   = path_template.substitute(self.replacements)
-
-
-            # Concatentate the base path with the new path name and create this
-            # directory if it doesn't exist. Fail and quit the script if this
-            # causes problems.
-            target_path = os.path.join(base_path, new_path)
-            if not os.path.exists(target_path):
-                os.makedirs(target_path)
-
-            # Write the new, substituted, input file to the working directory
-            newfile = open(os.path.join(target_path, "trap.info"), 'w')
-            newfile.write(new_params)
-            newfile.close()
-
-            # If the waveform file is in the current directory, copy it to the
-            # new working directory. Otherwise, skip this.
-            if os.path.exists(source_waveform):
-                target_waveform = os.path.join(target_path, "waveform.dat")
-                shutil.copy(source_waveform, target_waveform)
-
-            print "\n********************"
-            print "Thread starting in %s" % new_path
-            print "********************\n"
-            cmd = split(ccmd_command) + [target_path]
+            target_paths = []
+            for replacements in self.group:
+                # Substitute placeholders in file path and input file
+                # templates. Fail and quit the script if we are left with
+                # anything un-substituted.
+                new_params = params_template.substitute(replacements)
+                new_path   = path_template.substitute(replacements)
+
+
+                # Concatentate the base path with the new path name and create
+                # this directory if it doesn't exist. Fail and quit the script
+                # if this causes problems.
+                target_path = os.path.join(base_path, new_path)
+                if not os.path.exists(target_path):
+                    os.makedirs(target_path)
+
+                # Write the new, substituted, input file to the working
+                # directory
+                newfile = open(os.path.join(target_path, "trap.info"), 'w')
+                newfile.write(new_params)
+                newfile.close()
+
+                # If the waveform file is in the current directory, copy it to
+                # the new working directory. Otherwise, skip this.
+                if os.path.exists(source_waveform):
+                    target_waveform = os.path.join(target_path, "waveform.dat")
+                    shutil.copy(source_waveform, target_waveform)
+
+                print "\n********************"
+                print "Thread starting in %s" % new_path
+                print "********************\n"
+                target_paths.append(target_path)
+            cmd = split(ccmd_command) + target_paths
             proc = subprocess.Popen(cmd)
             proc.communicate()
 
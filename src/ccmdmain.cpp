@@ -14,6 +14,12 @@
  *
  *      <path to ccmd>/ccmd <path to working directory>
  *
+ *  Given several working directories, the program runs them together as an
+ *  Ensemble of replicas in one process. The replicas may differ in their trap
+ *  voltages, laser and seed, but must hold the same ions and take the same
+ *  steps. Each writes its output files to its own directory, and the log is
+ *  written to the first.
+ *
  *  The input file must be named \c trap.info and the file format is documented
  *  in ccmdsim.h. The file is divided into sections, one for each set of
  *  related parameters. These are documented in detail in TrapParams,
@@ -29,13 +35,26 @@
  *  equations of motion of the trapped ions. The first run for a total of
  *  IntegrationParams.cool_steps time steps allows the ions to equilibrate,
  *  then for the number of time steps in IntegrationParams.hist_steps while
- *  collecting statistics on each ion's position and kinetic energy. The
+ *  collecting statistics on each ion's position and kinetic energy. With
+ *  \c cooling_model \c pseudopotential the ions equilibrate in the
+ *  time-averaged pseudopotential of the trap, using a PseudoIntegrator and a
+ *  longer time step. The RF trap takes over for the statistics. The
  *  positions are stored in a 3-dimensional histogram, which is used to
  *  generate a representation of a microscope image of the crystal. Here, each
  *  layer of the histogram represents a pixel brightness that is blurred
  *  proportional to its distance from a focal plane (taken as the centre of the
  *  crystal.)
  *
+ *  With \c relaxsteps set, the starting ions are first moved to a minimum of
+ *  their energy in the pseudopotential by a Minimiser, so the cooling stage
+ *  starts close to the crystal.
+ *
+ *  With \c checkpointperiods set, the state of the run is written to
+ *  \c checkpoint.bin at that interval. Starting the program again in the same
+ *  directory carries on from the checkpoint and gives the same output as a run
+ *  that was not interrupted; only the microscope image is limited to the
+ *  steps after the restart.
+ *
  *  # Base Classes
  *
  *  The primary classes used to drive the simulation are the IonCloud,
@@ -54,12 +73,16 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "include/ccmdsim.h"
+#include "include/checkpoint.h"
+#include "include/ensemble.h"
 #include "include/iontrap.h"
 #include "include/ioncloud.h"
 #include "include/integrator.h"
 #include "include/logger.h"
+#include "include/minimiser.h"
 #include "include/timer.h"
 
 #include "include/ionstatslistener.h"
@@ -95,24 +118,174 @@ void printProgBar(int percent) {
     std::cout<< percent << "%     " << std::flush;
 }
 
+/**
+ *  @brief Construct the integrator named by the integration parameters.
+ */
+std::unique_ptr<Integrator> make_integrator(const IonTrap_ptr trap,
+        const IonCloud_ptr cloud, const IntegrationParams& integration_params,
+        const SimParams& sp) {
+    std::unique_ptr<Integrator> integrator;
+    if (integration_params.method == integration_params.respa) {
+        integrator.reset(new RespaIntegrator(trap, cloud,
+                                             integration_params, sp));
+    } else if (integration_params.method == integration_params.split) {
+        integrator.reset(new SplitRespaIntegrator(trap, cloud,
+                                                  integration_params, sp));
+    } else if (integration_params.method == integration_params.transfer) {
+        integrator.reset(new TransferIntegrator(trap, cloud,
+                                                integration_params, sp));
+    } else if (integration_params.method == integration_params.forestruth) {
+        integrator.reset(new CompositionIntegrator<ForestRuth>(trap,
+                cloud, integration_params, sp));
+    } else if (integration_params.method == integration_params.yoshida6) {
+        integrator.reset(new CompositionIntegrator<Yoshida6>(trap,
+                cloud, integration_params, sp));
+    } else if (integration_params.method == integration_params.blanesmoan) {
+        integrator.reset(new CompositionIntegrator<BlanesMoan>(trap,
+                cloud, integration_params, sp));
+    } else {
+        integrator.reset(new VerletIntegrator(trap, cloud,
+                                              integration_params, sp));
+    }
+    return integrator;
+}
+
+/**
+ *  @brief Run a replica ensemble: the same cooling and histogram stages as a
+ *  single run, for every replica at once.
+ *
+ *  @param paths    Working directory of each replica, ending in a '/'.
+ *  @return Exit status.
+ */
+int run_ensemble(const std::vector<std::string>& paths) {
+    Timer timer;
+    Logger& log = Logger::getInstance();
+
+    try {
+        Ensemble ensemble(paths);
+        const size_t n_rep = ensemble.size();
+        const IntegrationParams& integration_params =
+            ensemble.replica(0).integration_params;
+        int nt_cool = integration_params.cool_steps;
+        int nt = integration_params.hist_steps;
+        double dt = integration_params.time_step;
+
+//------------------------------------------------------------------------------
+// Cooling
+//------------------------------------------------------------------------------
+        log.info("Running cool down.");
+        std::vector<std::shared_ptr<MeanEnergyListener>> meanListeners;
+        for (size_t r = 0; r < n_rep; ++r) {
+            Replica& rep = ensemble.replica(r);
+            meanListeners.push_back(std::make_shared<MeanEnergyListener>(
+                rep.integration_params, rep.trap_params,
+                rep.path + "energy.csv"));
+            ensemble.registerListener(r, meanListeners[r]);
+        }
+        auto progListener = std::make_shared<ProgressBarListener>(nt_cool + nt);
+        ensemble.registerListener(0, progListener);
+
+        // Cool for nt_cool steps, or until every replica has converged.
+        for (int t = 0; t < nt_cool; ++t) {
+            ensemble.evolve(dt);
+            if (t + 1 >= integration_params.min_cool_steps
+                    && std::all_of(meanListeners.begin(), meanListeners.end(),
+                                   [](const std::shared_ptr<MeanEnergyListener>&
+                                      l) { return l->converged(); })) {
+                log.info("Cooling energy of every replica converged after "
+                         + std::to_string(t + 1) + " steps.");
+                break;
+            }
+        }
+
+        for (size_t r = 0; r < n_rep; ++r)
+            ensemble.deregisterListener(r, meanListeners[r]);
+
+//------------------------------------------------------------------------------
+// Histogram
+//------------------------------------------------------------------------------
+        log.debug("Acquiring histogram data");
+
+        for (size_t r = 0; r < n_rep; ++r) {
+            Replica& rep = ensemble.replica(r);
+            if (rep.microscope_params.make_image) {
+                ensemble.registerListener(r,
+                    std::make_shared<ImageHistogramListener>(
+                        rep.integration_params, rep.trap_params,
+                        rep.microscope_params, rep.path));
+            }
+            ensemble.registerListener(r, std::make_shared<IonStatsListener>(
+                rep.integration_params, rep.trap_params, rep.cloud_params,
+                rep.path));
+        }
+
+        for (size_t r = 0; r < n_rep; ++r)
+            ensemble.replica(r).trap->begin_histogram();
+        std::vector<double> ke_sum(n_rep, 0.0);
+        std::vector<double> etot(n_rep, 0.0);
+        for (int t = 0; t < nt; ++t) {
+            ensemble.evolve(dt);
+            for (size_t r = 0; r < n_rep; ++r) {
+                double ke = ensemble.replica(r).cloud->kinetic_energy();
+                ke_sum[r] += ke;
+                etot[r] += ke + ensemble.coulomb_energy(r);
+            }
+        }
+        ensemble.deregisterListener(0, progListener);
+
+        for (size_t r = 0; r < n_rep; ++r) {
+            const TrapParams& trap_params = ensemble.replica(r).trap_params;
+            char buffer[256];
+            snprintf(buffer, 256, "Total kinetic energy = %.4e J",
+                     ke_sum[r]/nt * trap_params.energy_scale);
+            log.info(ensemble.replica(r).path + ": " + std::string(buffer));
+            snprintf(buffer, 256, "Total energy = %.4e J",
+                     etot[r] * trap_params.energy_scale);
+            log.info(ensemble.replica(r).path + ": " + std::string(buffer));
+        }
+
+        timer.stop();
+        log.info(timer.get_wall_string());
+        log.info(timer.get_cpu_string());
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char * const argv[]) {
-    double PI = 3.1415926535897932;
     Timer timer;
     Logger& log = Logger::getInstance();
 
-    if (argc != 2) {
-        std::cout << "usage: " << argv[0] << " [working directory]" << std::endl;
+    if (argc < 2) {
+        std::cout << "usage: " << argv[0] << " [working directory]..."
+                  << std::endl;
         std::exit(1);
     }
 
-    std::string path = std::string(argv[1]);
-    if (path[path.length()-1] != '/')
-        path += "/";
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string p = std::string(argv[i]);
+        if (p[p.length()-1] != '/')
+            p += "/";
+        paths.push_back(p);
+    }
+    std::string path = paths[0];
 
     log.initialise(Logger::DEBUG, path + "log.txt");
     log.info("CCMD - Coulomb crystal molecular dynamics");
     log.info("Version 2.2.0 alpha");
 
+    // More than one working directory runs them together as an ensemble,
+    // logged to the first.
+    if (paths.size() > 1) {
+        log.info("Running an ensemble of " + std::to_string(paths.size())
+                 + " replicas.");
+        return run_ensemble(paths);
+    }
+
     // Parameter file paths
     std::string info_file = path + "trap.info";
     log.info("Loading input file " + info_file);
@@ -127,37 +300,53 @@ int main(int argc, char * const argv[]) {
 		LaserParams laser_params(info_file);
 
         // Construct trap based on parameters
-        IonTrap_ptr trap;
-        if (trap_params.wave == trap_params.cosine) {
-            trap = std::make_shared<CosineTrap>(trap_params);
-        } else if (trap_params.wave == trap_params.digital) {
-            trap = std::make_shared<PulsedTrap>(trap_params);
-        } else if (trap_params.wave == trap_params.waveform) {
-            trap = std::make_shared<WaveformTrap>(trap_params);
-        } else if (trap_params.wave == trap_params.cosine_decay) {
-            // have to do some unit conversions here for the decay params
-            trap_params.tau *= PI;
-            trap_params.deltaT = (integration_params.cool_steps + integration_params.hist_steps)*
-                integration_params.time_step-trap_params.deltaT*PI;
-            trap = std::make_shared<CosineDecayTrap>(trap_params);
-        } else if (trap_params.wave == trap_params.twofreq) {
-            trap = std::make_shared<TwoFreq_trap>(trap_params);
-        } else {
-            log.error("Unrecognised trap type");
-            throw std::runtime_error("Unrecognised trap type");
-        }
+        IonTrap_ptr trap = make_trap(trap_params, integration_params);
         log.debug("Constructing Ion Cloud");
         // Construct ion cloud
         IonCloud_ptr cloud = std::make_shared<IonCloud>
             (trap, cloud_params, sim_params, trap_params, laser_params);
         log.debug("Finished constructing Ion Cloud");
 
-        // Construct integrator
-        //RespaIntegrator integrator(trap, cloud, integration_params, sim_params);
+        // Carry on from a checkpoint, if there is one.
+        Checkpoint checkpoint(path, integration_params, sim_params);
+        const bool checkpointing = integration_params.checkpoint_periods > 0.0;
+        const bool resume = checkpointing && checkpoint.exists();
+        Checkpoint::Progress progress = {Checkpoint::cooling, 0, 0.0, 0.0, {}};
+        if (resume) {
+            log.info("Carrying on from checkpoint " + path
+                     + "checkpoint.bin");
+            progress = checkpoint.load(*trap, *cloud);
+            if (microscope_params.make_image) {
+                log.warn("The microscope image only covers the steps after "
+                         "the checkpoint.");
+            }
+        }
+        const bool cooling = progress.stage == Checkpoint::cooling;
+
+        // Relax the starting ions towards the crystal.
+        if (!resume && integration_params.relax_steps > 0) {
+            Minimiser minimiser(cloud, integration_params, sim_params);
+            minimiser.relax();
+        }
+
+        // Construct integrator. Cooling in the pseudopotential has an
+        // integrator of its own, and the RF integrator is made after it.
         log.debug("Initialising integrator");
-        VerletIntegrator integrator(trap, cloud, integration_params, sim_params);
+        const bool pseudo_cooling = integration_params.cooling_model
+            == IntegrationParams::pseudopotential;
+        std::unique_ptr<Integrator> integrator;
+        if (pseudo_cooling && cooling) {
+            integrator.reset(new PseudoIntegrator(trap, cloud,
+                                                  integration_params,
+                                                  sim_params));
+        } else {
+            integrator = make_integrator(trap, cloud, integration_params,
+                                         sim_params);
+        }
+        if (resume)
+            checkpoint.load_integrator(*integrator);
         log.debug("Finished initialising integrator");
-        
+
 
 //------------------------------------------------------------------------------
 // Cooling
@@ -166,23 +355,61 @@ int main(int argc, char * const argv[]) {
         int nt_cool = integration_params.cool_steps;
         int nt = integration_params.hist_steps;
         double dt = integration_params.time_step;
+        double cool_dt = integration_params.cool_time_step;
+        // Steps between checkpoints in each stage.
+        const int cool_every = std::max(1, static_cast<int>(
+            integration_params.checkpoint_periods
+            * integration_params.cool_steps_per_period));
+        const int hist_every = std::max(1, static_cast<int>(
+            integration_params.checkpoint_periods
+            * integration_params.steps_per_period));
 
         auto meanListener = std::make_shared<MeanEnergyListener>(
             integration_params, trap_params, path + "energy.csv");
-        integrator.registerListener(meanListener);
+        if (cooling) {
+            integrator->registerListener(meanListener);
+            if (resume)
+                meanListener->resume(progress.step, progress.cool_state);
+        }
         //auto positionListener = std::make_shared<PositionListener>(
             //integration_params, trap_params, path);
         //integrator.registerListener(positionListener);
-        auto progListener = std::make_shared<ProgressBarListener>(nt_cool + nt);
-        integrator.registerListener(progListener);
+        auto progListener = std::make_shared<ProgressBarListener>(
+            !pseudo_cooling ? nt_cool + nt : cooling ? nt_cool : nt);
+        integrator->registerListener(progListener);
 
-        for (int t = 0; t < nt_cool; ++t) {
+        // Cool for nt_cool steps, or until the energy has converged.
+        for (int t = cooling ? progress.step : nt_cool; t < nt_cool; ++t) {
             //std::cout<<"Here\n";
-            integrator.evolve(dt);
+            integrator->evolve(cool_dt);
             //std::cout<<"Here 2\n";
+            if (t + 1 >= integration_params.min_cool_steps
+                    && meanListener->converged()) {
+                log.info("Cooling energy converged after "
+                         + std::to_string(t + 1) + " steps.");
+                break;
+            }
+            if (checkpointing && (t + 1) % cool_every == 0
+                    && t + 1 < nt_cool) {
+                meanListener->flush();
+                checkpoint.save({Checkpoint::cooling, t + 1, 0.0, 0.0,
+                                 meanListener->state()},
+                                *trap, *cloud, *integrator);
+            }
         }
 
-        integrator.deregisterListener(meanListener);
+        if (cooling)
+            integrator->deregisterListener(meanListener);
+        if (pseudo_cooling && cooling) {
+            // Hand over to the RF trap, with a progress bar of its own.
+            integrator->deregisterListener(progListener);
+            log.info("Cooled in the pseudopotential, switching to the RF "
+                     "trap.");
+            integrator = make_integrator(trap, cloud, integration_params,
+                                         sim_params);
+            progListener = std::make_shared<ProgressBarListener>(nt);
+            integrator->registerListener(progListener);
+        }
         //integrator.deregisterListener(positionListener);
 
 
@@ -191,24 +418,36 @@ int main(int argc, char * const argv[]) {
 //------------------------------------------------------------------------------
         log.debug("Acquiring histogram data");
 
-        KE = 0;
-        double etot = 0;
+        KE = cooling ? 0.0 : progress.ke_sum;
+        double etot = cooling ? 0.0 : progress.etot_sum;
+        if (cooling)
+            trap->begin_histogram();
 
         if (microscope_params.make_image) {
             auto imagesListener = std::make_shared<ImageHistogramListener>(
                 integration_params, trap_params, microscope_params, path);
-            integrator.registerListener(imagesListener);
+            integrator->registerListener(imagesListener);
         }
         auto ionStatsListener = std::make_shared<IonStatsListener>(
             integration_params, trap_params, cloud_params, path);
-        integrator.registerListener(ionStatsListener);
+        integrator->registerListener(ionStatsListener);
 
-        for (int t = 0; t < nt; ++t) {
-            integrator.evolve(dt);
-            KE += cloud->kinetic_energy();
-            etot += cloud->total_energy();
+        // The Coulomb energy comes from the force pass of each step, or is
+        // summed at the final positions by the RESPA integrators.
+        integrator->calculate_energy(true);
+        for (int t = cooling ? 0 : progress.step; t < nt; ++t) {
+            integrator->evolve(dt);
+            double ke = cloud->kinetic_energy();
+            KE += ke;
+            etot += ke + integrator->coulomb_energy();
+            if (checkpointing && (t + 1) % hist_every == 0 && t + 1 < nt) {
+                checkpoint.save({Checkpoint::histogram, t + 1, KE, etot, {}},
+                                *trap, *cloud, *integrator);
+            }
         }
-        integrator.deregisterListener(progListener);
+        integrator->deregisterListener(progListener);
+        if (checkpointing)
+            checkpoint.remove();
 
         KE /= nt;
 
@@ -31,6 +31,7 @@
  *         respasteps  50       ; Respa inner loop steps
  *         coolperiods 2000
  *         histperiods   200
+ *         method      verlet
  *     }
  *     image {
  *         makeimage   true
@@ -43,6 +44,8 @@
  *     simulation {
  *         threads     0
  *         seed        -1
+ *         kernel      auto
+ *         method      direct
  *     }
  *     ionnumbers {
  *         Ca      50
@@ -296,6 +299,19 @@ TrapParams::TrapParams(const std::string& file_name) {
  *                 |   automatically, or an integer to remove all randomness.
  *  \c recoil      |   Heating recoil factor (**optional**)
  *
+ *  ## start ##
+ *
+ *  The optional \c start branch starts the ions from the crystal of an
+ *  earlier run, instead of a cubic lattice, so that fewer \c coolperiods are
+ *  needed; see Snapshot.
+ *
+ *  Parameter      | Description
+ *  ---------------|------------------------------------------------------------
+ *  \c from        |   The \c snapshot.bin file written by the earlier run, or
+ *                 |   its working directory to read the \c _pos.csv files.
+ *                 |   A relative path is taken from the directory of this
+ *                 |   input file. The ions are matched by \c name.
+ *
  *
  *  # Example input #
  *  see the description of ccmdsim.h for a full input file, the sections
@@ -323,6 +339,9 @@ TrapParams::TrapParams(const std::string& file_name) {
  *              direction   0.5
  *          }
  *       }
+ *       start {
+ *           from ../previous/snapshot.bin
+ *       }
  *
  * .
  */
@@ -390,6 +409,13 @@ CloudParams::CloudParams(const std::string& file_name) {
                     "\tdirection: " + std::to_string(ionType.direction));
         }
     }
+
+    start_from = pt.get<std::string>("start.from", "");
+    if (!start_from.empty() && start_from[0] != '/') {
+        const size_t slash = file_name.rfind('/');
+        if (slash != std::string::npos)
+            start_from = file_name.substr(0, slash + 1) + start_from;
+    }
 }
 
 
@@ -447,6 +473,53 @@ SwapParams::SwapParams(const std::string& file_name, const CloudParams& cp) {
  *                   | velocity Verlet algorithm.
  * \c coolperiods    | Number of RF periods for equilibration (no data collected)
  * \c histperiods    | Number of RF periods to propagate while collecting data.
+ * \c method         | \c verlet (default) velocity Verlet, \c respa RESPA with
+ *                   | \c respasteps trap steps per Coulomb update, \c split
+ *                   | RESPA with the Coulomb force split by distance, or
+ *                   | \c transfer RESPA with the trap steps applied as one
+ *                   | transfer matrix per species. The composition methods
+ *                   | \c forestruth and \c blanesmoan (4th order) and
+ *                   | \c yoshida6 (6th order) allow a larger time step.
+ * \c splitradius    | For \c split, the distance beyond which the Coulomb force
+ *                   | is far field, in simulation length units. Default 4.
+ * \c farsteps       | For \c split, the number of steps between far field
+ *                   | updates. The near field is updated every step. Default 4.
+ * \c skin           | For \c split, the extra distance kept in the neighbour
+ *                   | list of the near field; it is rebuilt once an ion has
+ *                   | moved half this far. Default 1.
+ * \c cooling_model  | \c rf (default) cools in the full RF trap.
+ *                   | \c pseudopotential cools in the time-averaged harmonic
+ *                   | pseudopotential of the trap, by velocity Verlet, then
+ *                   | hands over to \c method in the RF trap for \c histperiods.
+ * \c pseudostepsPerPeriod | Steps in one RF period while cooling in the
+ *                   | pseudopotential, which has no micromotion to resolve.
+ *                   | Default 10.
+ * \c checkpointperiods | RF periods between binary checkpoints, written to
+ *                   | \c checkpoint.bin in the working directory. A run
+ *                   | started with a checkpoint present carries on from it,
+ *                   | and the file is deleted when the run finishes.
+ *                   | Default 0, no checkpoints.
+ * \c convergence    | \c fixed (default) always cools for \c coolperiods.
+ *                   | \c plateau ends cooling once the mean energy of the
+ *                   | last window of periods differs from that of the window
+ *                   | before by less than the tolerance, and \c slope once
+ *                   | a straight line fitted to the last window changes by
+ *                   | less than the tolerance across it, allowing for the
+ *                   | noise of the energy. See
+ *                   | MeanEnergyListener::converged. The histogram stage,
+ *                   | and the wait before a \c cosine_decay trap decays,
+ *                   | start from the step at which cooling ended.
+ * \c convergencewindow | RF periods in each window, at least 2 for
+ *                   | \c plateau and 3 for \c slope. Default 50.
+ * \c convergencetolerance | Relative change of the energy taken as
+ *                   | converged. Default 0.02.
+ * \c mincoolperiods | Fewest RF periods of cooling before the test can end
+ *                   | it; \c coolperiods is the most. Default 0.
+ * \c relaxsteps     | Most steps of a FIRE energy minimisation of the
+ *                   | starting ions in the pseudopotential and their Coulomb
+ *                   | force, before cooling; see Minimiser. Default 0, none.
+ * \c relaxtolerance | The minimisation stops once the RMS force on the ions
+ *                   | is this fraction of the RMS Coulomb force. Default 1e-4.
  *
  *  # Example input #
  *  see the description of ccmdsim.h for a full input file, the sections
@@ -469,6 +542,11 @@ SwapParams::SwapParams(const std::string& file_name, const CloudParams& cp) {
 IntegrationParams::IntegrationParams(const std::string& file_name) {
     double coolperiods;
     double histperiods;
+    std::string methodString;
+    std::string coolingString;
+    std::string convergenceString;
+    double mincoolperiods;
+    int pseudo_steps_per_period;
 
     using boost::property_tree::iptree;
     iptree pt;
@@ -479,19 +557,140 @@ IntegrationParams::IntegrationParams(const std::string& file_name) {
         respa_steps = pt.get<int>("integrator.respasteps");
         coolperiods   = pt.get<double>("integrator.coolperiods");
         histperiods   = pt.get<double>("integrator.histperiods");
+        methodString = pt.get<std::string>("integrator.method", "verlet");
+        split_radius = pt.get<double>("integrator.splitradius", 4.0);
+        far_steps = pt.get<int>("integrator.farsteps", 4);
+        skin = pt.get<double>("integrator.skin", 1.0);
+        coolingString = pt.get<std::string>("integrator.cooling_model", "rf");
+        pseudo_steps_per_period =
+            pt.get<int>("integrator.pseudostepsPerPeriod", 10);
+        checkpoint_periods =
+            pt.get<double>("integrator.checkpointperiods", 0.0);
+        convergenceString =
+            pt.get<std::string>("integrator.convergence", "fixed");
+        convergence_window =
+            pt.get<int>("integrator.convergencewindow", 50);
+        convergence_tolerance =
+            pt.get<double>("integrator.convergencetolerance", 0.02);
+        mincoolperiods = pt.get<double>("integrator.mincoolperiods", 0.0);
+        relax_steps = pt.get<int>("integrator.relaxsteps", 0);
+        relax_tolerance = pt.get<double>("integrator.relaxtolerance", 1e-4);
     } catch(const boost::property_tree::ptree_error &e) {
         log.error("Error reading integration params.");
         log.error(e.what());
         throw std::runtime_error("Error reading integration params.");
     }
 
+    if (methodString == "verlet") {
+        method = verlet;
+    } else if (methodString == "respa") {
+        method = respa;
+    } else if (methodString == "split") {
+        method = split;
+    } else if (methodString == "transfer") {
+        method = transfer;
+    } else if (methodString == "forestruth") {
+        method = forestruth;
+    } else if (methodString == "yoshida6") {
+        method = yoshida6;
+    } else if (methodString == "blanesmoan") {
+        method = blanesmoan;
+    } else {
+        log.error("Unrecognised integrator method " + methodString);
+        throw std::runtime_error("unrecognised integrator method");
+    }
+    if (split_radius <= 0.0) {
+        log.error("Split radius must be greater than zero.");
+        throw std::runtime_error("invalid split radius");
+    }
+    if (skin < 0.0) {
+        log.error("Neighbour list skin must not be negative.");
+        throw std::runtime_error("invalid neighbour list skin");
+    }
+    if (far_steps < 1) {
+        log.error("Steps between far field updates must be at least one.");
+        throw std::runtime_error("invalid number of far field steps");
+    }
+    if (coolingString == "rf") {
+        cooling_model = rf;
+        cool_steps_per_period = steps_per_period;
+    } else if (coolingString == "pseudopotential") {
+        cooling_model = pseudopotential;
+        cool_steps_per_period = pseudo_steps_per_period;
+    } else {
+        log.error("Unrecognised cooling model " + coolingString);
+        throw std::runtime_error("unrecognised cooling model");
+    }
+    if (cool_steps_per_period < 1) {
+        log.error("Steps per period while cooling must be at least one.");
+        throw std::runtime_error("invalid number of cooling steps");
+    }
+
+    if (convergenceString == "fixed") {
+        convergence = fixed;
+    } else if (convergenceString == "plateau") {
+        convergence = plateau;
+    } else if (convergenceString == "slope") {
+        convergence = slope;
+    } else {
+        log.error("Unrecognised convergence test " + convergenceString);
+        throw std::runtime_error("unrecognised convergence test");
+    }
+    if (convergence_window < 2 || convergence_tolerance <= 0.0) {
+        log.error("The convergence window must be at least two periods, "
+                  "and the tolerance greater than zero.");
+        throw std::runtime_error("invalid convergence test");
+    }
+    if (convergence == slope && convergence_window < 3) {
+        // The noise of a straight line fitted to two points is unknown.
+        log.error("The convergence window must be at least three periods "
+                  "for the slope test.");
+        throw std::runtime_error("invalid convergence test");
+    }
+    if (relax_steps < 0 || relax_tolerance <= 0.0) {
+        log.error("Minimisation steps must not be negative, and the "
+                  "tolerance must be greater than zero.");
+        throw std::runtime_error("invalid minimisation parameters");
+    }
+    if (checkpoint_periods < 0.0) {
+        log.error("Periods between checkpoints must not be negative.");
+        throw std::runtime_error("invalid checkpoint period");
+    }
+
     time_step = 3.1415926535897932/steps_per_period;
-    cool_steps = static_cast<int>(coolperiods*steps_per_period);
+    cool_time_step = 3.1415926535897932/cool_steps_per_period;
+    cool_steps = static_cast<int>(coolperiods*cool_steps_per_period);
     hist_steps = static_cast<int>(histperiods*steps_per_period);
+    min_cool_steps = static_cast<int>(mincoolperiods*cool_steps_per_period);
 
     log.info("Integrator parameters:");
     log.info("\tTime step: " + std::to_string(time_step));
+    log.info("\tMethod: " + methodString);
     log.info("\tRESPA steps: " + std::to_string(respa_steps));
+    if (method == split) {
+        log.info("\tSplit radius: " + std::to_string(split_radius));
+        log.info("\tSteps per far field update: "
+                 + std::to_string(far_steps));
+        log.info("\tNeighbour list skin: " + std::to_string(skin));
+    }
+    if (cooling_model == pseudopotential) {
+        log.info("\tCooling in the pseudopotential, time step: "
+                 + std::to_string(cool_time_step));
+    }
+    if (convergence != fixed) {
+        log.info("\tEnd cooling on a " + convergenceString + " of the "
+                 "energy over " + std::to_string(convergence_window)
+                 + " periods, after at least "
+                 + std::to_string(min_cool_steps) + " steps");
+    }
+    if (relax_steps > 0) {
+        log.info("\tRelax the starting ions for at most "
+                 + std::to_string(relax_steps) + " steps");
+    }
+    if (checkpoint_periods > 0.0) {
+        log.info("\tCheckpoint every " + std::to_string(checkpoint_periods)
+                 + " periods");
+    }
     log.info("\tWill take " + std::to_string(cool_steps) +
             " steps to allow ions to equilibrate,");
     log.info("\t then " + std::to_string(hist_steps) +
@@ -544,25 +743,123 @@ MicroscopeParams::MicroscopeParams(const std::string& file_name) {
  * --------------|---------------------------------------------------------------
  *  \c threads   | Number of threads to use in Coulomb force calculation.
  *               | The total number of running threads will be this number plus one.
- *               | Zero performs all calculations in a single thread.
+ *               | The force is calculated in the background while the trap
+ *               | and laser forces move the ions. Zero calculates it in the
+ *               | integrator thread, which waits for it.
  *  \c seed      | Seed for random number generator. Set to -1 to pick seed from
  *               | system clock.
+ *  \c kernel    | Instruction set for the Coulomb force sum: \c auto (default)
+ *               | picks the widest supported by the processor, or one of
+ *               | \c scalar, \c sse2, \c avx2 or \c avx512.
+ *  \c coulomb_precision | Arithmetic of the Coulomb kernel: \c double
+ *               | (default), \c single to evaluate each pair in single
+ *               | precision, or \c rsqrt for double precision with a fast
+ *               | reciprocal square root. The mixed modes need AVX2 or
+ *               | AVX-512, and their error is written to the log at start.
+ *  \c method    | Coulomb force method: \c direct (default) sums every pair,
+ *               | \c tree uses a Barnes-Hut octree in O(N log N) time,
+ *               | \c fmm the fast multipole method in O(N) time, and \c p3m
+ *               | a particle-particle/particle-mesh method in O(N log N).
+ *  \c theta     | Opening angle of the tree, 0 <= theta < 1. Smaller is more
+ *               | accurate and slower; zero gives the direct sum. Default 0.5.
+ *  \c fmmorder  | Expansion order of the fast multipole method, from 1 to 20.
+ *               | Higher is more accurate and slower. Default 6.
+ *  \c mesh      | P3M mesh points along the longest side of the cloud, a
+ *               | power of two from 8 to 256. Default 0 sizes the mesh for
+ *               | about two mesh cells per ion.
+ *  \c cutoff    | P3M short-range cutoff in mesh spacings. Larger is more
+ *               | accurate and slower. Default 4.
  */
 SimParams::SimParams(const std::string& file_name) {
     using boost::property_tree::iptree;
     iptree pt;
     read_info(file_name, pt);
 
+    Logger& log = Logger::getInstance();
+    std::string kernelString = "auto";
+    std::string methodString = "direct";
+    std::string precisionString = "double";
     boost::optional<iptree&> params = pt.get_child_optional("simulation");
     if (params) {
         coulomb_threads = params.get().get<int>("threads", 0);
         random_seed = params.get().get<int>("seed", -1);
+        kernelString = params.get().get<std::string>("kernel", "auto");
+        methodString = params.get().get<std::string>("method", "direct");
+        precisionString = params.get().get<std::string>("coulomb_precision",
+                                                        "double");
+        tree_theta = params.get().get<double>("theta", 0.5);
+        fmm_order = params.get().get<int>("fmmorder", 6);
+        p3m_mesh = params.get().get<int>("mesh", 0);
+        p3m_cutoff = params.get().get<double>("cutoff", 4.0);
     } else {
         coulomb_threads = 0;
         random_seed = -1;
+        tree_theta = 0.5;
+        fmm_order = 6;
+        p3m_mesh = 0;
+        p3m_cutoff = 4.0;
+    }
+
+    if (kernelString == "auto") {
+        coulomb_kernel = automatic;
+    } else if (kernelString == "scalar") {
+        coulomb_kernel = scalar;
+    } else if (kernelString == "sse2") {
+        coulomb_kernel = sse2;
+    } else if (kernelString == "avx2") {
+        coulomb_kernel = avx2;
+    } else if (kernelString == "avx512") {
+        coulomb_kernel = avx512;
+    } else {
+        log.error("Unrecognised Coulomb kernel " + kernelString);
+        throw std::runtime_error("unrecognised Coulomb kernel");
+    }
+
+    if (precisionString == "double") {
+        coulomb_precision = full;
+    } else if (precisionString == "single") {
+        coulomb_precision = single;
+    } else if (precisionString == "rsqrt") {
+        coulomb_precision = rsqrt;
+    } else {
+        log.error("Unrecognised Coulomb precision " + precisionString);
+        throw std::runtime_error("unrecognised Coulomb precision");
+    }
+
+    if (methodString == "direct") {
+        coulomb_method = direct;
+    } else if (methodString == "tree") {
+        coulomb_method = tree;
+    } else if (methodString == "fmm") {
+        coulomb_method = fmm;
+    } else if (methodString == "p3m") {
+        coulomb_method = p3m;
+    } else {
+        log.error("Unrecognised Coulomb method " + methodString);
+        throw std::runtime_error("unrecognised Coulomb method");
+    }
+    if (tree_theta < 0.0 || tree_theta >= 1.0) {
+        log.error("Tree opening angle theta must be in [0, 1).");
+        throw std::runtime_error("invalid tree opening angle");
+    }
+    if (fmm_order < 1 || fmm_order > 20) {
+        log.error("FMM expansion order must be from 1 to 20.");
+        throw std::runtime_error("invalid FMM expansion order");
+    }
+    if (p3m_mesh != 0 && (p3m_mesh < 8 || p3m_mesh > 256
+                          || (p3m_mesh & (p3m_mesh - 1)) != 0)) {
+        log.error("P3M mesh must be 0 or a power of two from 8 to 256.");
+        throw std::runtime_error("invalid P3M mesh");
+    }
+    if (coulomb_threads < 0) {
+        log.error("Number of Coulomb threads must not be negative.");
+        throw std::runtime_error("invalid number of threads");
+    }
+    if (p3m_cutoff <= 0.0) {
+        log.error("P3M cutoff must be positive.");
+        throw std::runtime_error("invalid P3M cutoff");
     }
 
-    Logger& log = Logger::getInstance();
     log.info("Coulomb Force using " + std::to_string(coulomb_threads)
             + " threads.");
     log.info("Random seed " + std::to_string(random_seed));
@@ -582,6 +879,10 @@ SimParams::SimParams(const std::string& file_name) {
  *  \c delta     | Detuning of laser from resonance
  *               | 
  *  \c IdIsat    | Intensity of Laser divided by saturation intensity
+ *  \c scattering| \c stepped (default) tests for a photon absorption or
+ *               | emission in each 1 ns of the time step. \c events samples
+ *               | the time to the next one from the scattering rate, as
+ *               | kinetic Monte Carlo, and costs little between events.
  */
 LaserParams::LaserParams(const std::string& file_name) {
     using boost::property_tree::iptree;
@@ -589,18 +890,30 @@ LaserParams::LaserParams(const std::string& file_name) {
     Logger& log = Logger::getInstance();
     read_info(file_name, pt);
 	
+    std::string scatteringString;
     try {
         wavelength= pt.get<float>("laser.wavelength");
         delta = pt.get<float>("laser.delta");
         IdIsat   = pt.get<float>("laser.IdIsat");
+        scatteringString =
+            pt.get<std::string>("laser.scattering", "stepped");
     } catch(const boost::property_tree::ptree_error &e) {
         log.error("Error reading Laser params.");
         log.error(e.what());
         throw std::runtime_error("Error reading Laser params.");
     }
+    if (scatteringString == "stepped") {
+        scattering = stepped;
+    } else if (scatteringString == "events") {
+        scattering = events;
+    } else {
+        log.error("Unrecognised photon scattering " + scatteringString);
+        throw std::runtime_error("unrecognised photon scattering");
+    }
 	
 	log.info("Laser parameters:");
     log.info("\tWavelength: " + std::to_string(wavelength));
     log.info("\tdelta: " + std::to_string(delta));
     log.info("\tI/Isat: " + std::to_string(IdIsat));
+    log.info("\tPhoton scattering: " + scatteringString);
 }
@@ -0,0 +1,334 @@
+/**
+ * @file checkpoint.cpp
+ * @brief Function definitions for binary checkpoints of a run.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+/**
+ *  @class Checkpoint
+ *
+ *  A checkpoint holds everything a run needs to carry on exactly as if it
+ *  had not stopped: the ion positions, velocities, electronic states and
+ *  statistics, the trap time and phase, the state of the random number
+ *  generators, the integrator step counter and cached forces, and the stage
+ *  and step the run had reached. The ion types, trap and integrator are
+ *  still built from \c trap.info, and the checkpoint is refused if the
+ *  number of ions, the time steps or the parameters of the Coulomb force do
+ *  not match.
+ *
+ *  The file is written to a temporary name and then renamed, so a run
+ *  killed while writing leaves the previous checkpoint intact.
+ */
+
+#include "include/checkpoint.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "include/ccmdsim.h"
+#include "include/integrator.h"
+#include "include/ioncloud.h"
+#include "include/iontrap.h"
+#include "include/logger.h"
+
+/** @brief Marks the file as a CCMD checkpoint ("CCMDCKPT"). */
+const std::int64_t Checkpoint::magic_ = 0x54504B43444D4343;
+/** @brief Changed whenever the layout of the file changes. */
+const std::int64_t Checkpoint::version_ = 6;
+
+
+/**
+ *  @brief Open a temporary file beside \c file_name for writing.
+ *
+ *  @param file_name    Name of the finished checkpoint.
+ */
+CheckpointWriter::CheckpointWriter(const std::string& file_name)
+    : file_name_(file_name),
+      stream_(file_name + ".tmp", std::ofstream::out | std::ofstream::binary
+                                  | std::ofstream::trunc) {
+    if (!stream_) {
+        Logger& log = Logger::getInstance();
+        log.error("Cannot open checkpoint file " + file_name + ".tmp");
+        throw std::runtime_error("Cannot open checkpoint file");
+    }
+}
+
+void CheckpointWriter::write_bytes(const void* p, size_t n) {
+    stream_.write(static_cast<const char*>(p), n);
+}
+
+void CheckpointWriter::write(std::int64_t i) {
+    write_bytes(&i, sizeof(i));
+}
+
+void CheckpointWriter::write(double d) {
+    write_bytes(&d, sizeof(d));
+}
+
+void CheckpointWriter::write(const Vector3D& v) {
+    write(v.x);
+    write(v.y);
+    write(v.z);
+}
+
+void CheckpointWriter::write(const std::string& s) {
+    write(static_cast<std::int64_t>(s.size()));
+    write_bytes(s.data(), s.size());
+}
+
+void CheckpointWriter::write(const AlignedVector& a) {
+    write(static_cast<std::int64_t>(a.size()));
+    write_bytes(a.data(), a.size()*sizeof(double));
+}
+
+void CheckpointWriter::write(const std::vector<double>& a) {
+    write(static_cast<std::int64_t>(a.size()));
+    write_bytes(a.data(), a.size()*sizeof(double));
+}
+
+void CheckpointWriter::write(const std::vector<Vector3D>& a) {
+    write(static_cast<std::int64_t>(a.size()));
+    for (const auto& v : a)
+        write(v);
+}
+
+/**
+ *  @brief Finish the file, and move it over any previous checkpoint.
+ */
+void CheckpointWriter::close() {
+    stream_.close();
+    if (!stream_ || std::rename((file_name_ + ".tmp").c_str(),
+                                file_name_.c_str()) != 0) {
+        Logger& log = Logger::getInstance();
+        log.error("Failed writing checkpoint file " + file_name_);
+        throw std::runtime_error("Failed writing checkpoint file");
+    }
+}
+
+
+/**
+ *  @brief Open a checkpoint file for reading.
+ *
+ *  @param file_name    Name of the checkpoint.
+ */
+CheckpointReader::CheckpointReader(const std::string& file_name)
+    : file_name_(file_name),
+      stream_(file_name, std::ifstream::in | std::ifstream::binary) {
+    if (!stream_) {
+        Logger& log = Logger::getInstance();
+        log.error("Cannot open checkpoint file " + file_name);
+        throw std::runtime_error("Cannot open checkpoint file");
+    }
+}
+
+void CheckpointReader::read_bytes(void* p, size_t n) {
+    stream_.read(static_cast<char*>(p), n);
+    if (!stream_) {
+        Logger& log = Logger::getInstance();
+        log.error("Checkpoint file " + file_name_ + " is truncated.");
+        throw std::runtime_error("Checkpoint file is truncated");
+    }
+}
+
+std::int64_t CheckpointReader::read_int() {
+    std::int64_t i;
+    read_bytes(&i, sizeof(i));
+    return i;
+}
+
+double CheckpointReader::read_double() {
+    double d;
+    read_bytes(&d, sizeof(d));
+    return d;
+}
+
+Vector3D CheckpointReader::read_vector() {
+    Vector3D v;
+    v.x = read_double();
+    v.y = read_double();
+    v.z = read_double();
+    return v;
+}
+
+std::string CheckpointReader::read_string() {
+    std::string s(read_int(), '\0');
+    read_bytes(&s[0], s.size());
+    return s;
+}
+
+/**
+ *  @brief Read an array of the same length as \c a.
+ */
+void CheckpointReader::read(AlignedVector& a) {
+    if (read_int() != static_cast<std::int64_t>(a.size())) {
+        Logger& log = Logger::getInstance();
+        log.error("Array length in checkpoint file " + file_name_
+                  + " does not match.");
+        throw std::runtime_error("Checkpoint array length does not match");
+    }
+    read_bytes(a.data(), a.size()*sizeof(double));
+}
+
+/**
+ *  @brief Read an array of numbers, resizing \c a to hold it.
+ */
+void CheckpointReader::read(std::vector<double>& a) {
+    a.resize(read_int());
+    read_bytes(a.data(), a.size()*sizeof(double));
+}
+
+/**
+ *  @brief Read an array of vectors, resizing \c a to hold it.
+ */
+void CheckpointReader::read(std::vector<Vector3D>& a) {
+    a.resize(read_int());
+    for (auto& v : a)
+        v = read_vector();
+}
+
+
+/**
+ *  @brief Checkpoints of the run in working directory \c path.
+ *
+ *  @param path     Working directory, ending in a '/'.
+ *  @param params   Integration parameters of the run.
+ *  @param sp       Simulation parameters of the run.
+ */
+Checkpoint::Checkpoint(const std::string& path,
+                       const IntegrationParams& params, const SimParams& sp)
+    : file_name_(path + "checkpoint.bin"), params_(params),
+      sim_params_(sp) {}
+
+
+/** @brief Whether there is a checkpoint to resume from. */
+bool Checkpoint::exists() const {
+    std::ifstream f(file_name_);
+    return f.good();
+}
+
+
+/**
+ *  @brief Write the state of the run.
+ *
+ *  @param progress     Stage and step reached.
+ *  @param trap         The trap.
+ *  @param cloud        The ions.
+ *  @param integrator   The integrator of the current stage.
+ */
+void Checkpoint::save(const Progress& progress, const IonTrap& trap,
+                      const IonCloud& cloud,
+                      Integrator& integrator) const {
+    CheckpointWriter writer(file_name_);
+    writer.write(magic_);
+    writer.write(version_);
+    writer.write(static_cast<std::int64_t>(cloud.get_store().size()));
+    writer.write(static_cast<std::int64_t>(params_.steps_per_period));
+    writer.write(static_cast<std::int64_t>(params_.respa_steps));
+    writer.write(static_cast<std::int64_t>(params_.method));
+    writer.write(static_cast<std::int64_t>(params_.cooling_model));
+    writer.write(static_cast<std::int64_t>(params_.cool_steps_per_period));
+    writer.write(static_cast<std::int64_t>(params_.far_steps));
+    writer.write(static_cast<std::int64_t>(sim_params_.coulomb_method));
+    writer.write(static_cast<std::int64_t>(sim_params_.coulomb_kernel));
+    writer.write(static_cast<std::int64_t>(sim_params_.coulomb_precision));
+    writer.write(sim_params_.tree_theta);
+    writer.write(static_cast<std::int64_t>(sim_params_.fmm_order));
+    writer.write(static_cast<std::int64_t>(sim_params_.p3m_mesh));
+    writer.write(sim_params_.p3m_cutoff);
+    writer.write(params_.split_radius);
+    writer.write(params_.skin);
+
+    writer.write(static_cast<std::int64_t>(progress.stage));
+    writer.write(static_cast<std::int64_t>(progress.step));
+    writer.write(progress.ke_sum);
+    writer.write(progress.etot_sum);
+    writer.write(progress.cool_state);
+
+    trap.save_state(writer);
+    cloud.save_state(writer);
+    integrator.save_state(writer);
+    writer.close();
+}
+
+
+/**
+ *  @brief Refuse a checkpoint written for a different run.
+ */
+void Checkpoint::check_params(CheckpointReader& reader, size_t n_ions) const {
+    Logger& log = Logger::getInstance();
+    if (reader.read_int() != magic_ || reader.read_int() != version_) {
+        log.error(file_name_ + " is not a checkpoint of this version.");
+        throw std::runtime_error("Not a checkpoint file");
+    }
+    if (reader.read_int() != static_cast<std::int64_t>(n_ions)) {
+        log.error(file_name_ + " holds a different number of ions.");
+        throw std::runtime_error("Checkpoint does not match the ion cloud");
+    }
+    const bool same = reader.read_int() == params_.steps_per_period
+        && reader.read_int() == params_.respa_steps
+        && reader.read_int() == params_.method
+        && reader.read_int() == params_.cooling_model
+        && reader.read_int() == params_.cool_steps_per_period
+        && reader.read_int() == params_.far_steps
+        && reader.read_int() == sim_params_.coulomb_method
+        && reader.read_int() == sim_params_.coulomb_kernel
+        && reader.read_int() == sim_params_.coulomb_precision
+        && reader.read_double() == sim_params_.tree_theta
+        && reader.read_int() == sim_params_.fmm_order
+        && reader.read_int() == sim_params_.p3m_mesh
+        && reader.read_double() == sim_params_.p3m_cutoff
+        && reader.read_double() == params_.split_radius
+        && reader.read_double() == params_.skin;
+    if (!same) {
+        log.error(file_name_ + " was written with other integration or "
+                  "Coulomb force parameters.");
+        throw std::runtime_error("Checkpoint does not match the integrator");
+    }
+}
+
+
+/**
+ *  @brief Restore the trap and the ions, before the integrator is built.
+ *
+ *  The integrator is built from the restored positions and trap time, and
+ *  then given the rest of the checkpoint by load_integrator.
+ *
+ *  @param trap     The trap, as built from the parameters.
+ *  @param cloud    The ions, as built from the parameters.
+ *  @return The stage and step the run had reached.
+ */
+Checkpoint::Progress Checkpoint::load(IonTrap& trap, IonCloud& cloud) {
+    reader_.reset(new CheckpointReader(file_name_));
+    check_params(*reader_, cloud.get_store().size());
+
+    Progress progress;
+    progress.stage = static_cast<Stage>(reader_->read_int());
+    progress.step = static_cast<int>(reader_->read_int());
+    progress.ke_sum = reader_->read_double();
+    progress.etot_sum = reader_->read_double();
+    reader_->read(progress.cool_state);
+
+    trap.load_state(*reader_);
+    cloud.load_state(*reader_);
+    return progress;
+}
+
+
+/**
+ *  @brief Restore the integrator step counter and forces, and close the
+ *  file.
+ */
+void Checkpoint::load_integrator(Integrator& integrator) {
+    integrator.load_state(*reader_);
+    reader_.reset();
+}
+
+
+/** @brief Delete the checkpoint, once the run has finished. */
+void Checkpoint::remove() const {
+    std::remove(file_name_.c_str());
+}
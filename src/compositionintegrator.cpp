@@ -0,0 +1,162 @@
+/**
+ * @file compositionintegrator.cpp
+ * @brief Function definitions for higher order composition integrators.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include <cmath>
+#include <string>
+
+#include "include/ccmdsim.h"
+#include "include/integrator.h"
+#include "include/ioncloud.h"
+#include "include/iontrap.h"
+#include "include/logger.h"
+
+/**
+ *  @class CompositionIntegrator
+ *  @brief Numerical integration by a symmetric composition of kicks and
+ *  drifts.
+ *
+ *  Each step is a sequence of kicks by the Coulomb and trap forces and
+ *  drifts, with coefficients chosen so that the step is accurate to 4th or
+ *  6th order in the time step, against 2nd order for velocity Verlet. The
+ *  trap is evolved along with the drifts, so the trap force is found at the
+ *  time of each kick. Some coefficients are negative, and the step goes
+ *  backwards in time in between.
+ *
+ *  The Coulomb force is updated after each drift, and the last update of a
+ *  step is used for the first kick of the next, so a step of \c stages
+ *  stages costs that many force updates. A larger time step then gives the
+ *  same accuracy for fewer force updates.
+ *
+ *  Heating and laser cooling are not reversible, and a laser cooled ion
+ *  cannot scatter photons backwards in time, so they are left out of the
+ *  composition and applied for half a step at each end.
+ *
+ *  @see ForestRuth @see Yoshida6 @see BlanesMoan
+ */
+
+namespace {
+/// Weight of the outer steps of the Forest-Ruth scheme, 1/(2 - 2^(1/3)).
+const double fr_theta = 1.0/(2.0 - std::cbrt(2.0));
+
+/// Weights of the velocity Verlet steps of Yoshida's 6th order solution A.
+const double y6_w1 = -1.17767998417887;
+const double y6_w2 = 0.235573213359357;
+const double y6_w3 = 0.784513610477560;
+const double y6_w0 = 1.0 - 2.0*(y6_w1 + y6_w2 + y6_w3);
+
+/// Coefficients of the Blanes and Moan scheme, S6 of order 4.
+const double bm_a1 = 0.0792036964311957;
+const double bm_a2 = 0.353172906049774;
+const double bm_a3 = -0.0420650803577195;
+const double bm_a4 = 1.0 - 2.0*(bm_a1 + bm_a2 + bm_a3);
+const double bm_b1 = 0.209515106613362;
+const double bm_b2 = -0.143851773179818;
+const double bm_b3 = 0.5 - (bm_b1 + bm_b2);
+}  // namespace
+
+/**
+ *  @struct ForestRuth
+ *  Three velocity Verlet steps of theta, 1 - 2 theta and theta.
+ *
+ *  See: E. Forest and R. D. Ruth, Physica D 43, 105 (1990)
+ */
+const int ForestRuth::stages;
+const double ForestRuth::kick[] = {fr_theta/2.0, (1.0 - fr_theta)/2.0,
+                                   (1.0 - fr_theta)/2.0, fr_theta/2.0};
+const double ForestRuth::drift[] = {fr_theta, 1.0 - 2.0*fr_theta, fr_theta};
+const char* const ForestRuth::name = "Forest-Ruth 4th order";
+
+/**
+ *  @struct Yoshida6
+ *  Seven velocity Verlet steps of w3, w2, w1, w0, w1, w2 and w3.
+ *
+ *  See: H. Yoshida, Phys. Lett. A 150, 262 (1990)
+ */
+const int Yoshida6::stages;
+const double Yoshida6::kick[] = {y6_w3/2.0, (y6_w3 + y6_w2)/2.0,
+                                 (y6_w2 + y6_w1)/2.0, (y6_w1 + y6_w0)/2.0,
+                                 (y6_w0 + y6_w1)/2.0, (y6_w1 + y6_w2)/2.0,
+                                 (y6_w2 + y6_w3)/2.0, y6_w3/2.0};
+const double Yoshida6::drift[] = {y6_w3, y6_w2, y6_w1, y6_w0,
+                                  y6_w1, y6_w2, y6_w3};
+const char* const Yoshida6::name = "Yoshida 6th order";
+
+/**
+ *  @struct BlanesMoan
+ *  Kicks of a1 to a4 and back, between drifts of b1 to b3 and back. The
+ *  scheme is for a general splitting, so the kicks take the place of its
+ *  first part.
+ *
+ *  See: S. Blanes and P. C. Moan, J. Comput. Appl. Math. 142, 313 (2002)
+ */
+const int BlanesMoan::stages;
+const double BlanesMoan::kick[] = {bm_a1, bm_a2, bm_a3, bm_a4,
+                                   bm_a3, bm_a2, bm_a1};
+const double BlanesMoan::drift[] = {bm_b1, bm_b2, bm_b3,
+                                    bm_b3, bm_b2, bm_b1};
+const char* const BlanesMoan::name = "Blanes-Moan 4th order";
+
+
+/**
+ *  @brief Create a new composition integrator.
+ *
+ *  @param it       Pointer to ion trap object.
+ *  @param ic       Pointer to ion cloud object.
+ *  @param ip       Reference to integrator parameters.
+ *  @param sp       Reference to simulation parameters.
+ */
+template <class Scheme>
+CompositionIntegrator<Scheme>::CompositionIntegrator(const IonTrap_ptr it,
+        const IonCloud_ptr ic, const IntegrationParams& integrationParams,
+        const SimParams& sp)
+    : Integrator(it, ic, integrationParams, sp) {
+    Logger& log = Logger::getInstance();
+    log.info(std::string(Scheme::name) + " composition integration.");
+}
+
+
+/** @brief Increment by one step.
+ *
+ *  Half a step of heating and laser cooling, the stages of kicks and
+ *  drifts, then the second half-step of cooling and heating.
+ *
+ *  @param dt   Time step.
+ */
+template <class Scheme>
+void CompositionIntegrator<Scheme>::evolve(double dt) {
+    const double half_dt = dt/2.0;
+    ions_->heat(half_dt);
+    ions_->cool(half_dt);
+    for (int i = 0; i < Scheme::stages; ++i) {
+        kick(Scheme::kick[i]*dt);
+        ions_->drift(Scheme::drift[i]*dt);
+        coulomb_.update();
+        trap_->evolve(Scheme::drift[i]*dt);
+    }
+    kick(Scheme::kick[Scheme::stages]*dt);
+    ions_->cool(half_dt);
+    ions_->heat(half_dt);
+
+    // Tell everyone we're done
+    notifyListeners(n_iter_++);
+}
+
+
+/** @brief Kick the ions by the Coulomb force of the last update and the
+ *  trap force at the current time.
+ */
+template <class Scheme>
+void CompositionIntegrator<Scheme>::kick(double dt) {
+    ions_->kick(dt, coulomb_.get_force());
+    ions_->linear_kick(dt, trap_->force_coefficients());
+}
+
+
+template class CompositionIntegrator<ForestRuth>;
+template class CompositionIntegrator<Yoshida6>;
+template class CompositionIntegrator<BlanesMoan>;
@@ -15,10 +15,19 @@
  *  all rods. The force on an ion is determined via the Mathieu equations. At
  *  time -DeltaT (from end of simulation) the cosine amplitude decays with
  *  time constant tau.
+ *
+ *  The decay is timed from the start of the histogram stage, as the trap
+ *  time does not advance through every cooling step: cooling in the
+ *  pseudopotential leaves it at zero, and cooling may end early once the
+ *  energy has converged.
  */
 
 #include "include/iontrap.h"
 
+#include <limits>
+
+#include "include/checkpoint.h"
+
 /**
  *  @brief Create a new cosine ion trap, call the parent class to initialise 
  *  parameters.
@@ -26,11 +35,21 @@
  *  @param params   Reference to the trap parameters object.
  */
 CosineDecayTrap::CosineDecayTrap(const TrapParams& params)
-    : CosineTrap(params) {
+    : CosineTrap(params),
+      decay_start_(std::numeric_limits<double>::infinity()) {
         cos_phase_ = 0.0;
     }
 
 
+/**
+ *  @brief Start the decay TrapParams::deltaT after the current time, which
+ *  make_trap sets to the time before the end of the histogram stage.
+ */
+void CosineDecayTrap::begin_histogram() {
+    decay_start_ = time_now_ + params_.deltaT;
+}
+
+
 /**
  *  @brief Update the trap by time interval `dt`.
  *
@@ -40,14 +59,31 @@ CosineDecayTrap::CosineDecayTrap(const TrapParams& params)
  *  @param dt   Time step.
  */
 void CosineDecayTrap::evolve(double dt) {
-    time_now_ += dt;
-    cos_phase_ = cos(2.0*time_now_);
-    if (time_now_ > params_.deltaT) {
-        cos_phase_ *= exp(-(time_now_-params_.deltaT)/params_.tau);
+    cos_phase_ = advance(dt) ? table_phase() : phase_at(time_now_);
+    if (time_now_ > decay_start_) {
+        cos_phase_ *= exp(-(time_now_-decay_start_)/params_.tau);
     }
 }
 
 
+/**
+ *  @brief Write the trap time, phase and decay start to a checkpoint.
+ */
+void CosineDecayTrap::save_state(CheckpointWriter& writer) const {
+    IonTrap::save_state(writer);
+    writer.write(decay_start_);
+}
+
+
+/**
+ *  @brief Restore the trap time, phase and decay start from a checkpoint.
+ */
+void CosineDecayTrap::load_state(CheckpointReader& reader) {
+    IonTrap::load_state(reader);
+    decay_start_ = reader.read_double();
+}
+
+
 /**
  * @brief Calculate the force on an ion from the Mathieu equations. 
  *
@@ -31,14 +31,23 @@ CosineTrap::CosineTrap(const TrapParams& params)
 /**
  *  @brief Update the trap by time interval `dt`.
  *
- *  Increment the current time counter and calculate the amplitude of a cosine
- *  at this new time.
+ *  Increment the current time counter and find the amplitude of a cosine
+ *  at this new time, from the phase table if there is one.
  *
  *  @param dt   Time step.
  */
 void CosineTrap::evolve(double dt) {
-    time_now_ += dt;
-    cos_phase_ = cos(2.0*time_now_);
+    cos_phase_ = advance(dt) ? table_phase() : phase_at(time_now_);
+}
+
+
+/**
+ *  @brief The amplitude of the cosine at time `time`.
+ *
+ *  @param time Time in simulation units.
+ */
+double CosineTrap::phase_at(double time) const {
+    return cos(2.0*time);
 }
 
 
@@ -10,112 +10,529 @@
 #include <assert.h>
 
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
+#include <algorithm>
 #include <array>
-#include <string.h>
+#include <exception>
+#include <stdexcept>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+#include "include/checkpoint.h"
 #include "include/ioncloud.h"
 #include "include/ion.h"
+#include "include/logger.h"
 
 /** @class CoulombForce @brief Calculates a vector of Coulomb interaction
  * forces for the ion positions when update is called.
  *
- * Stores a pointer to the IonCloud for positions and charges. On calling
- * update, the current positions are copied into another vector. This allows
- * the slower Coulomb force calculation to be done in another thread while the
- * trapping forces are calculated and updated.
+ * Stores a pointer to the IonCloud, and reads positions and charges from the
+ * contiguous arrays of its IonStore.
+ *
+ * When `simulation.threads` is greater than zero, update copies the current
+ * positions and charges into a snapshot and returns at once; a worker thread
+ * calculates the force from the snapshot with that many OpenMP threads while
+ * the caller moves the ions under the trap and laser forces. get_force waits
+ * for the result. Otherwise update calculates the force before returning.
+ * The force is the same either way.
+ *
+ * The direct sum also finds the Coulomb energy of the ions as it goes, for
+ * the cost of one multiply-add per pair, and get_energy returns it. The tree,
+ * fast multipole and P3M methods do not give the energy, so for these it is
+ * only found, by a separate sum over all pairs, after calculate_energy(true).
+ */
+
+namespace {
+
+/** @class PairwiseSum
+ * @brief Running sum of vectors with the rounding error of pairwise summation.
+ *
+ * Works like a binary counter: level k holds the sum of a block of 2^k terms,
+ * and two equal blocks are combined as soon as both are complete. Storage is
+ * fixed, nothing is copied, and the error grows as log(n) rather than n.
  */
+class PairwiseSum {
+ public:
+    PairwiseSum() : count_(0) {}
+
+    void clear() { count_ = 0; }
+
+    void add(const Vector3D& v) {
+        double x = v.x, y = v.y, z = v.z;
+        int k = 0;
+        for (unsigned c = count_; c & 1; c >>= 1, ++k) {
+            x += level_[k][0];
+            y += level_[k][1];
+            z += level_[k][2];
+        }
+        level_[k][0] = x;
+        level_[k][1] = y;
+        level_[k][2] = z;
+        ++count_;
+    }
+
+    Vector3D total() const {
+        Vector3D s;
+        for (int k = 0; k < levels_ && count_ >> k; ++k) {
+            if (count_ >> k & 1)
+                s += Vector3D(level_[k][0], level_[k][1], level_[k][2]);
+        }
+        return s;
+    }
+
+ private:
+    static const int levels_ = 32;
+    unsigned count_;             ///< Number of terms added so far.
+    double level_[levels_][3];   ///< Partial sum of 2^k terms at level k.
+};
+
+}  // namespace
+
+const long CoulombForce::max_chunks_;
+const long CoulombForce::min_chunk_rows_;
+const long CoulombForce::block_rows_;
+const long CoulombForce::tile_size_;
 
 /** @brief Construct a new CoulombForce object that stores a pointer to the
  * IonCloud and SimParams.
  *
  */
 CoulombForce::CoulombForce(const IonCloud_ptr ic, const SimParams& sp)
-    : cloud_(ic), params_(sp) {
+    : cloud_(ic), params_(sp),
+      kernel_(sp.coulomb_kernel, sp.coulomb_precision), energy_(0.0),
+      energy_known_(false), energy_wanted_(false), busy_(false),
+      stop_(false) {
+    if (kernel_.precision() != SimParams::full)
+        kernel_.report_error(cloud_->store_);
+    if (sp.coulomb_method == SimParams::tree) {
+        tree_.reset(new BarnesHut(sp, kernel_));
+        Logger::getInstance().info("Coulomb force from Barnes-Hut tree, theta "
+                                   + std::to_string(sp.tree_theta));
+    } else if (sp.coulomb_method == SimParams::fmm) {
+        fmm_.reset(new FastMultipole(sp, kernel_));
+        Logger::getInstance().info("Coulomb force from fast multipole method, "
+                                   "order " + std::to_string(sp.fmm_order)
+                                   + ", theta "
+                                   + std::to_string(sp.tree_theta));
+    } else if (sp.coulomb_method == SimParams::p3m) {
+        p3m_.reset(new ParticleMesh(sp));
+        Logger::getInstance().info("Coulomb force from P3M, mesh "
+                                   + std::to_string(sp.p3m_mesh)
+                                   + ", cutoff "
+                                   + std::to_string(sp.p3m_cutoff));
+    }
+    if (sp.coulomb_threads > 0) {
+        snapshot_.reset(new IonStore(cloud_->store_.size()));
+        worker_ = std::thread(&CoulombForce::work, this);
+    }
+}
+
+
+/** @brief Stop the worker thread, after any force calculation in progress.
+ */
+CoulombForce::~CoulombForce() {
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        worker_.join();
     }
+}
 
 
 /** @brief Start calculating Coulomb force vector.
  *
- * This function makes use of the antisymmetric nature of the force : F_ji =
- * -F_ij, so only calculates the upper triangle of the NxN array.
+ * With a worker thread, waits for any calculation still running, copies the
+ * positions and charges to the snapshot and hands it to the worker.
+ * Otherwise calculates the force straight away.
  */
 void CoulombForce::update() {
-    Vector3D r1, r2, f, tot;
-    double r, r3;
-    int q1, q2;
-    int i,j;
-    int cloud_size = cloud_->number_of_ions();
+    if (!worker_.joinable()) {
+        compute(cloud_->store_);
+        return;
+    }
+    wait();
+    const IonStore& store = cloud_->store_;
+    std::copy(store.x.begin(), store.x.end(), snapshot_->x.begin());
+    std::copy(store.y.begin(), store.y.end(), snapshot_->y.begin());
+    std::copy(store.z.begin(), store.z.end(), snapshot_->z.begin());
+    std::copy(store.charge.begin(), store.charge.end(),
+              snapshot_->charge.begin());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        busy_ = true;
+    }
+    wake_.notify_one();
+}
 
-    // Initialise vector that will contain force on each ion when we're done.
-    force_ = std::vector<Vector3D>(cloud_->number_of_ions());
-    Vector3D null_vec = Vector3D(0.0, 0.0, 0.0);
-    std::fill(force_.begin(), force_.end(), null_vec);
 
+/** @brief Calculate the force on the ions in store.
+ *
+ * Uses the method chosen by `simulation.method`. The direct sum uses the
+ * vectorised CoulombKernel chosen at start-up, or the scalar reference sum
+ * when the scalar kernel is selected. Either gives the energy as well; the
+ * other methods are followed by pair_energy if the energy is wanted.
+ */
+void CoulombForce::compute(const IonStore& store) {
+    if (params_.coulomb_method == SimParams::tree) {
+        tree_->compute(store, force_);
+    } else if (params_.coulomb_method == SimParams::fmm) {
+        fmm_->compute(store, force_);
+    } else if (params_.coulomb_method == SimParams::p3m) {
+        p3m_->compute(store, force_);
+    } else if (kernel_.isa() == SimParams::scalar) {
+        direct_force(store);
+        energy_known_ = true;
+        return;
+    } else {
+        vector_force(store);
+        energy_known_ = true;
+        return;
+    }
+    energy_known_ = energy_wanted_;
+    if (energy_wanted_)
+        energy_ = pair_energy(store);
+}
+
+
+/** @brief Body of the worker thread: calculate the force from the snapshot
+ * each time update hands one over.
+ *
+ * OpenMP settings belong to each thread, so the worker's parallel regions use
+ * `simulation.threads` threads without changing those of the caller. An
+ * exception is kept and thrown again by the next get_force or update.
+ */
+void CoulombForce::work() {
 #ifdef _OPENMP
+    omp_set_num_threads(params_.coulomb_threads);
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return busy_ || stop_; });
+        if (stop_)
+            return;
+        lock.unlock();
+        try {
+            compute(*snapshot_);
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        lock.lock();
+        busy_ = false;
+        done_.notify_all();
+    }
+}
+
+
+/** @brief Wait for the worker to finish, and pass on any exception it threw.
+ */
+void CoulombForce::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !busy_; });
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+
+/** @brief Scalar reference sum of the Coulomb force on each ion.
+ *
+ * Evaluates every one of the NxN pairs, with the terms for each ion added by
+ * a PairwiseSum. This is slow, but kept as the reference the vectorised
+ * half-pair sum is checked against. The energy is half the sum of q_i times
+ * the potential at each ion.
+ */
+void CoulombForce::direct_force(const IonStore& store) {
+    // Read positions and charges straight from the contiguous store.
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double* q = store.charge.data();
+    const long cloud_size = store.size();
+
+    force_.resize(cloud_size);
+    std::vector<double> energy(cloud_size);
 
-#pragma omp parallel default(shared) private(i,j, r1, q1, r2, q2, r3, f, r)
-{   
-#pragma omp for
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
 #endif
+    for (long i = 0; i < cloud_size; ++i) {
+        Vector3D r1(x[i], y[i], z[i]);
+        PairwiseSum sum;
+        double phi = 0.0;
+        for (long j = 0; j < cloud_size; ++j) {
+            if (j == i)
+                continue;
+            Vector3D r2(x[j], y[j], z[j]);
+            double r = Vector3D::dist(r1, r2);
+            sum.add((r1 - r2)/(r*r*r)*q[j]);
+            phi += q[j]/r;
+        }
+        force_[i] = sum.total()*q[i];
+        energy[i] = 0.5*q[i]*phi;
+    }
+    energy_ = 0.0;
+    for (long i = 0; i < cloud_size; ++i)
+        energy_ += energy[i];
+}
 
-    // sum Coulomb force over all particles
-    for (i = 0; i < cloud_size; ++i) {
-        Vector3D forces[cloud_size];
-        for (j = 0; j < cloud_size; ++j) {
-            if (i==j) {
-                forces[j] = Vector3D(0,0,0);
+
+/** @brief Sum the Coulomb force on each ion with the vectorised kernel.
+ *
+ * Each pair is evaluated once: the row for ion i runs over j > i, adds the
+ * force to ion i and the equal and opposite force to ion j. The rows are
+ * split into a fixed number of chunks with equal numbers of pairs, and each
+ * chunk accumulates into its own force buffer. Chunks are shared between
+ * OpenMP threads, then the buffers are added together in chunk order. As the
+ * chunks depend only on the number of ions, the result is identical for any
+ * number of threads.
+ *
+ * Within a chunk the rows are taken in blocks of block_rows_, and each block
+ * is swept over tiles of tile_size_ sources small enough to stay in L1 cache.
+ * A row adds its partial sum for each tile to a PairwiseSum, and the
+ * reactions on a tile are gathered in a zeroed scratch array before being
+ * added to the chunk buffer, so no long run of terms is summed one at a time.
+ *
+ * The kernel also sums the potential of the sources of each row, j > i, so
+ * q_i times it counts each pair's energy once. Each chunk adds these up, and
+ * the chunk energies are added in chunk order.
+ */
+void CoulombForce::vector_force(const IonStore& store) {
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double* q = store.charge.data();
+    const long cloud_size = store.size();
+
+    if (chunk_start_.empty() || chunk_start_.back() != cloud_size) {
+        make_chunks(cloud_size);
+    }
+    const int n_chunks = chunk_start_.size() - 1;
+    const long stride = 3*cloud_size;
+
+    force_.resize(cloud_size);
+
+#ifdef _OPENMP
+#pragma omp parallel
+{
+#endif
+    // Reactions on the sources of the current tile, [xyz][scratch_size].
+    const long scratch_size = tile_size_ + block_rows_;
+    AlignedVector scratch(3*scratch_size);
+    double* sx = scratch.data();
+    double* sy = sx + scratch_size;
+    double* sz = sy + scratch_size;
+    PairwiseSum row_sum[block_rows_];
+    double row_phi[block_rows_];
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int k = 0; k < n_chunks; ++k) {
+        const long i_begin = chunk_start_[k];
+        const long i_end = chunk_start_[k+1];
+        // Reactions only reach ions from the start of this chunk onwards.
+        double* rx = &accum_[k*stride];
+        double* ry = rx + cloud_size;
+        double* rz = ry + cloud_size;
+        std::fill(rx + i_begin, rx + cloud_size, 0.0);
+        std::fill(ry + i_begin, ry + cloud_size, 0.0);
+        std::fill(rz + i_begin, rz + cloud_size, 0.0);
+        double energy = 0.0;
+
+        for (long b0 = i_begin; b0 < i_end; b0 += block_rows_) {
+            const long b1 = std::min(b0 + block_rows_, i_end);
+            for (long i = b0; i < b1; ++i) {
+                row_sum[i - b0].clear();
+                row_phi[i - b0] = 0.0;
+            }
+
+            // Tile t gives row i the tile_size_ sources from i+1+t*tile_size_,
+            // so only the last piece of each row has a ragged end.
+            for (long j0 = b0 + 1; j0 < cloud_size; j0 += tile_size_) {
+                const long len = std::min(tile_size_ + block_rows_ - 1,
+                                          cloud_size - j0);
+                std::fill(sx, sx + len, 0.0);
+                std::fill(sy, sy + len, 0.0);
+                std::fill(sz, sz + len, 0.0);
+                for (long i = b0; i < b1; ++i) {
+                    const long begin = i - b0;
+                    const long end = std::min(begin + tile_size_, len);
+                    if (begin >= end)
+                        continue;
+                    Vector3D ri(x[i], y[i], z[i]);
+                    row_sum[i - b0].add(kernel_.pair(x + j0, y + j0, z + j0,
+                                                     q + j0, ri, q[i],
+                                                     begin, end, sx, sy, sz,
+                                                     &row_phi[i - b0]));
+                }
+                for (long j = 0; j < len; ++j) {
+                    rx[j0 + j] += sx[j];
+                    ry[j0 + j] += sy[j];
+                    rz[j0 + j] += sz[j];
+                }
             }
-            else
-            {
-                r1 = cloud_->ionVec_[i]->get_pos();
-                q1 = cloud_->ionVec_[i]->get_charge();
-                r2 = cloud_->ionVec_[j]->get_pos();
-                q2 = cloud_->ionVec_[j]->get_charge();
-
-                // force term calculation
-                r = Vector3D::dist(r1, r2);
-                r3 = r*r*r;
-                forces[j] = (r1-r2)/r3*q1*q2;
+
+            for (long i = b0; i < b1; ++i) {
+                Vector3D fi = row_sum[i - b0].total()*q[i];
+                rx[i] += fi.x;
+                ry[i] += fi.y;
+                rz[i] += fi.z;
+                energy += q[i]*row_phi[i - b0];
             }
         }
-        Vector3D totalforce = Reduction(forces,cloud_size);
-        tot += totalforce;
-        force_[i] = totalforce;            
+        chunk_energy_[k] = energy;
+    }
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (long i = 0; i < cloud_size; ++i) {
+        PairwiseSum f;
+        for (int k = 0; k < n_chunks && chunk_start_[k] <= i; ++k) {
+            const double* r = &accum_[k*stride];
+            f.add(Vector3D(r[i], r[i + cloud_size], r[i + 2*cloud_size]));
+        }
+        force_[i] = f.total();
+    }
+#ifdef _OPENMP
+}
+#endif
+    energy_ = 0.0;
+    for (int k = 0; k < n_chunks; ++k)
+        energy_ += chunk_energy_[k];
+}
+
+
+/** @brief Divide the rows of the half-pair sum into chunks.
+ *
+ * Row i holds n-1-i pairs, so chunk boundaries are placed at equal steps in
+ * the running total of pairs, rounded to whole blocks of rows. The number of
+ * chunks depends only on the number of ions, which keeps the summation order
+ * independent of thread count.
+ *
+ * @param n Number of ions.
+ */
+void CoulombForce::make_chunks(long n) {
+    int n_chunks = std::max(1L, std::min(max_chunks_, n/min_chunk_rows_));
+    double total_pairs = 0.5*n*(n-1);
+    chunk_start_.assign(1, 0);
+    long i = 0;
+    double pairs = 0.0;
+    for (int k = 1; k < n_chunks; ++k) {
+        double target = total_pairs*k/n_chunks;
+        while (i < n && pairs < target) {
+            long block_end = std::min(n, i + block_rows_);
+            for (; i < block_end; ++i)
+                pairs += n-1-i;
+        }
+        if (i > chunk_start_.back() && i < n)
+            chunk_start_.push_back(i);
     }
+    chunk_start_.push_back(n);
+    accum_.assign(3*n*(chunk_start_.size()-1), 0.0);
+    chunk_energy_.assign(chunk_start_.size()-1, 0.0);
+}
+
+
+/** @brief Coulomb energy of the ions in store, from a separate sum over all
+ * pairs.
+ *
+ * Used by the methods that do not give the energy themselves. Each row is
+ * summed in turn and the rows added in order, so the result does not depend
+ * on the number of threads.
+ */
+double CoulombForce::pair_energy(const IonStore& store) const {
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double* q = store.charge.data();
+    const long n = store.size();
+    std::vector<double> row(n);
+
 #ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (long i = 0; i < n; ++i) {
+        double phi = 0.0;
+        for (long j = i + 1; j < n; ++j) {
+            double dx = x[i] - x[j];
+            double dy = y[i] - y[j];
+            double dz = z[i] - z[j];
+            phi += q[j]/std::sqrt(dx*dx + dy*dy + dz*dz);
+        }
+        row[i] = q[i]*phi;
+    }
+    double e = 0.0;
+    for (long i = 0; i < n; ++i)
+        e += row[i];
+    return e;
+}
+
+
+/** @brief Calculate the Coulomb energy with the force from the next update,
+ * for the methods that do not give it anyway.
+ */
+void CoulombForce::calculate_energy(bool on) {
+    if (worker_.joinable())
+        wait();
+    energy_wanted_ = on;
 }
-#endif    
+
+
+/** @brief Ensure all threads have finished, and return the Coulomb energy of
+ * the ions at the last update.
+ *
+ * Pairs of coincident ions are skipped, as in the force.
+ */
+double CoulombForce::get_energy() {
+    if (worker_.joinable())
+        wait();
+    if (!energy_known_) {
+        Logger& log = Logger::getInstance();
+        log.error("Coulomb energy was not calculated with the force.");
+        throw std::runtime_error("Coulomb energy was not calculated");
+    }
+    return energy_;
 }
 
 
 /** @brief Ensure all threads have finished, and return the force vector.
  */
 const std::vector<Vector3D>& CoulombForce::get_force() {
+    if (worker_.joinable())
+        wait();
     return force_;
 }
 
 
-Vector3D CoulombForce::Reduction(Vector3D x[], int len) {
-    Vector3D s;
-    if (len < 4) {
-        int i = 0;
-        for (i=0; i < len; i++) { s += x[i]; }
-    }
-    else
-    {
-        int halflen = floor(len/2);
-        Vector3D array1[halflen];
-        Vector3D array2[len-halflen];
-        memcpy(array1, x, halflen * sizeof(Vector3D)); 
-        memcpy(array2, &x[halflen], (len-halflen) * sizeof(Vector3D));
-        s = Reduction(array1, halflen) + Reduction(array2, len-halflen);
-    }
-    return s;
+/** @brief Write the force and energy of the last update to a checkpoint.
+ */
+void CoulombForce::save_state(CheckpointWriter& writer) {
+    if (worker_.joinable())
+        wait();
+    writer.write(force_);
+    writer.write(energy_);
+    writer.write(static_cast<std::int64_t>(energy_known_));
+}
+
+
+/** @brief Replace the force and energy of the last update with those from a
+ *  checkpoint.
+ */
+void CoulombForce::load_state(CheckpointReader& reader) {
+    if (worker_.joinable())
+        wait();
+    reader.read(force_);
+    energy_ = reader.read_double();
+    energy_known_ = reader.read_int() != 0;
 }
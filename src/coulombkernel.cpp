@@ -0,0 +1,989 @@
+/**
+ * @file coulombkernel.cpp
+ * @brief Function definitions for the vectorised direct-sum Coulomb kernels.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/coulombkernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CCMD_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#include "include/logger.h"
+
+/**
+ *  @class CoulombKernel
+ *  @brief Inner loop of the direct Coulomb sum, compiled for several
+ *  instruction sets and chosen when the simulation starts.
+ *
+ *  The row function sums the field at one ion from a contiguous range of source
+ *  ions held in the IonStore arrays. The pair function does the same, and also
+ *  subtracts the equal and opposite force from a reaction array for each
+ *  source, so that each pair need only be evaluated once. It also sums the
+ *  potential q_j/r at the ion, which costs one multiply-add per pair since
+ *  q_j/r = r^2 q_j/r^3. Versions are provided for plain scalar code, SSE2 (2
+ *  doubles per register), AVX2 with FMA (4 doubles) and AVX-512 (8 doubles).
+ *  Each vector version is compiled with a function target attribute, so the
+ *  whole program still builds for the baseline instruction set, and the widest
+ *  version supported by the processor (read from CPUID) is picked at run time.
+ *  A narrower version can be requested with the `simulation.kernel` parameter.
+ *
+ *  # Accuracy
+ *
+ *  All versions compute the same terms in double precision with a true
+ *  square root and division; they differ only in the order the terms are
+ *  added, as each vector lane keeps its own partial sum. The force on each ion
+ *  agrees with the scalar sum to within 1e-12 of the sum of the magnitudes of
+ *  its pair forces, which in a crystal is a relative error of order 1e-13 or
+ *  better.
+ *
+ *  # Mixed precision
+ *
+ *  `simulation.coulomb_precision` trades accuracy for speed in the AVX2 and
+ *  AVX-512 kernels. Differences of positions are taken in double precision
+ *  in every mode, and each call returns its sums in double, so the force on
+ *  an ion is still accumulated in double across calls.
+ *
+ *  - \c single evaluates each pair in single precision, with 1/r from the
+ *    hardware reciprocal square root and one Newton step. A vector holds
+ *    twice as many pairs. Each pair term has a relative error of about
+ *    1e-7.
+ *  - \c rsqrt keeps double precision, but replaces the square root and
+ *    division by the reciprocal square root estimate and Newton steps,
+ *    which leave a relative error of about 1e-8 (AVX-512) or 1e-13 (AVX2).
+ *
+ *  The other instruction sets always use double precision. When a mixed
+ *  mode is in use, report_error logs its error against the double precision
+ *  kernel for the starting positions.
+ */
+
+namespace {
+
+Vector3D row_scalar(const double* x, const double* y, const double* z,
+                    const double* q, const Vector3D& ri,
+                    size_t begin, size_t end) {
+    double fx = 0.0, fy = 0.0, fz = 0.0;
+    for (size_t j = begin; j < end; ++j) {
+        double dx = ri.x - x[j];
+        double dy = ri.y - y[j];
+        double dz = ri.z - z[j];
+        double r2 = dx*dx + dy*dy + dz*dz;
+        if (r2 != 0.0) {
+            double s = q[j]/(r2*std::sqrt(r2));
+            fx += dx*s;
+            fy += dy*s;
+            fz += dz*s;
+        }
+    }
+    return Vector3D(fx, fy, fz);
+}
+
+Vector3D pair_scalar(const double* x, const double* y, const double* z,
+                     const double* q, const Vector3D& ri, double qi,
+                     size_t begin, size_t end,
+                     double* rx, double* ry, double* rz, double* phi) {
+    double fx = 0.0, fy = 0.0, fz = 0.0, p = 0.0;
+    for (size_t j = begin; j < end; ++j) {
+        double dx = ri.x - x[j];
+        double dy = ri.y - y[j];
+        double dz = ri.z - z[j];
+        double r2 = dx*dx + dy*dy + dz*dz;
+        if (r2 != 0.0) {
+            double s = q[j]/(r2*std::sqrt(r2));
+            double t = qi*s;
+            fx += dx*s;
+            fy += dy*s;
+            fz += dz*s;
+            p += s*r2;
+            rx[j] -= dx*t;
+            ry[j] -= dy*t;
+            rz[j] -= dz*t;
+        }
+    }
+    *phi += p;
+    return Vector3D(fx, fy, fz);
+}
+
+#ifdef CCMD_X86_KERNELS
+
+__attribute__((target("sse2")))
+Vector3D row_sse2(const double* x, const double* y, const double* z,
+                  const double* q, const Vector3D& ri,
+                  size_t begin, size_t end) {
+    const __m128d xi = _mm_set1_pd(ri.x);
+    const __m128d yi = _mm_set1_pd(ri.y);
+    const __m128d zi = _mm_set1_pd(ri.z);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d fx = zero, fy = zero, fz = zero;
+
+    size_t j = begin;
+    for (; j + 2 <= end; j += 2) {
+        __m128d dx = _mm_sub_pd(xi, _mm_loadu_pd(x + j));
+        __m128d dy = _mm_sub_pd(yi, _mm_loadu_pd(y + j));
+        __m128d dz = _mm_sub_pd(zi, _mm_loadu_pd(z + j));
+        __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx),
+                                           _mm_mul_pd(dy, dy)),
+                                _mm_mul_pd(dz, dz));
+        // Replace coincident pairs by r2 = 1, then zero their contribution.
+        __m128d self = _mm_cmpeq_pd(r2, zero);
+        r2 = _mm_or_pd(_mm_and_pd(self, one), _mm_andnot_pd(self, r2));
+        __m128d s = _mm_div_pd(_mm_loadu_pd(q + j),
+                               _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+        s = _mm_andnot_pd(self, s);
+        fx = _mm_add_pd(fx, _mm_mul_pd(dx, s));
+        fy = _mm_add_pd(fy, _mm_mul_pd(dy, s));
+        fz = _mm_add_pd(fz, _mm_mul_pd(dz, s));
+    }
+    double sx[2], sy[2], sz[2];
+    _mm_storeu_pd(sx, fx);
+    _mm_storeu_pd(sy, fy);
+    _mm_storeu_pd(sz, fz);
+    Vector3D f(sx[0] + sx[1], sy[0] + sy[1], sz[0] + sz[1]);
+    return f + row_scalar(x, y, z, q, ri, j, end);
+}
+
+__attribute__((target("sse2")))
+Vector3D pair_sse2(const double* x, const double* y, const double* z,
+                   const double* q, const Vector3D& ri, double qi,
+                   size_t begin, size_t end,
+                   double* rx, double* ry, double* rz, double* phi) {
+    const __m128d xi = _mm_set1_pd(ri.x);
+    const __m128d yi = _mm_set1_pd(ri.y);
+    const __m128d zi = _mm_set1_pd(ri.z);
+    const __m128d qiv = _mm_set1_pd(qi);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d fx = zero, fy = zero, fz = zero, p = zero;
+
+    size_t j = begin;
+    for (; j + 2 <= end; j += 2) {
+        __m128d dx = _mm_sub_pd(xi, _mm_loadu_pd(x + j));
+        __m128d dy = _mm_sub_pd(yi, _mm_loadu_pd(y + j));
+        __m128d dz = _mm_sub_pd(zi, _mm_loadu_pd(z + j));
+        __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx),
+                                           _mm_mul_pd(dy, dy)),
+                                _mm_mul_pd(dz, dz));
+        __m128d self = _mm_cmpeq_pd(r2, zero);
+        r2 = _mm_or_pd(_mm_and_pd(self, one), _mm_andnot_pd(self, r2));
+        __m128d s = _mm_div_pd(_mm_loadu_pd(q + j),
+                               _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+        s = _mm_andnot_pd(self, s);
+        __m128d t = _mm_mul_pd(qiv, s);
+        fx = _mm_add_pd(fx, _mm_mul_pd(dx, s));
+        fy = _mm_add_pd(fy, _mm_mul_pd(dy, s));
+        fz = _mm_add_pd(fz, _mm_mul_pd(dz, s));
+        p = _mm_add_pd(p, _mm_mul_pd(r2, s));
+        _mm_storeu_pd(rx + j, _mm_sub_pd(_mm_loadu_pd(rx + j),
+                                         _mm_mul_pd(dx, t)));
+        _mm_storeu_pd(ry + j, _mm_sub_pd(_mm_loadu_pd(ry + j),
+                                         _mm_mul_pd(dy, t)));
+        _mm_storeu_pd(rz + j, _mm_sub_pd(_mm_loadu_pd(rz + j),
+                                         _mm_mul_pd(dz, t)));
+    }
+    double sx[2], sy[2], sz[2], sp[2];
+    _mm_storeu_pd(sx, fx);
+    _mm_storeu_pd(sy, fy);
+    _mm_storeu_pd(sz, fz);
+    _mm_storeu_pd(sp, p);
+    *phi += sp[0] + sp[1];
+    Vector3D f(sx[0] + sx[1], sy[0] + sy[1], sz[0] + sz[1]);
+    return f + pair_scalar(x, y, z, q, ri, qi, j, end, rx, ry, rz,
+                           phi);
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D row_avx2(const double* x, const double* y, const double* z,
+                  const double* q, const Vector3D& ri,
+                  size_t begin, size_t end) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d fx = zero, fy = zero, fz = zero;
+
+    size_t j = begin;
+    for (; j + 4 <= end; j += 4) {
+        __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(x + j));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(y + j));
+        __m256d dz = _mm256_sub_pd(zi, _mm256_loadu_pd(z + j));
+        __m256d r2 = _mm256_mul_pd(dx, dx);
+        r2 = _mm256_fmadd_pd(dy, dy, r2);
+        r2 = _mm256_fmadd_pd(dz, dz, r2);
+        // Replace coincident pairs by r2 = 1, then zero their contribution.
+        __m256d self = _mm256_cmp_pd(r2, zero, _CMP_EQ_OQ);
+        r2 = _mm256_blendv_pd(r2, one, self);
+        __m256d s = _mm256_div_pd(_mm256_loadu_pd(q + j),
+                                  _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+        s = _mm256_andnot_pd(self, s);
+        fx = _mm256_fmadd_pd(dx, s, fx);
+        fy = _mm256_fmadd_pd(dy, s, fy);
+        fz = _mm256_fmadd_pd(dz, s, fz);
+    }
+    double sx[4], sy[4], sz[4];
+    _mm256_storeu_pd(sx, fx);
+    _mm256_storeu_pd(sy, fy);
+    _mm256_storeu_pd(sz, fz);
+    Vector3D f((sx[0] + sx[1]) + (sx[2] + sx[3]),
+               (sy[0] + sy[1]) + (sy[2] + sy[3]),
+               (sz[0] + sz[1]) + (sz[2] + sz[3]));
+    return f + row_scalar(x, y, z, q, ri, j, end);
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D pair_avx2(const double* x, const double* y, const double* z,
+                   const double* q, const Vector3D& ri, double qi,
+                   size_t begin, size_t end,
+                   double* rx, double* ry, double* rz, double* phi) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256d qiv = _mm256_set1_pd(qi);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d fx = zero, fy = zero, fz = zero, p = zero;
+
+    size_t j = begin;
+    for (; j + 4 <= end; j += 4) {
+        __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(x + j));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(y + j));
+        __m256d dz = _mm256_sub_pd(zi, _mm256_loadu_pd(z + j));
+        __m256d r2 = _mm256_mul_pd(dx, dx);
+        r2 = _mm256_fmadd_pd(dy, dy, r2);
+        r2 = _mm256_fmadd_pd(dz, dz, r2);
+        __m256d self = _mm256_cmp_pd(r2, zero, _CMP_EQ_OQ);
+        r2 = _mm256_blendv_pd(r2, one, self);
+        __m256d s = _mm256_div_pd(_mm256_loadu_pd(q + j),
+                                  _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+        s = _mm256_andnot_pd(self, s);
+        __m256d t = _mm256_mul_pd(qiv, s);
+        fx = _mm256_fmadd_pd(dx, s, fx);
+        fy = _mm256_fmadd_pd(dy, s, fy);
+        fz = _mm256_fmadd_pd(dz, s, fz);
+        p = _mm256_fmadd_pd(r2, s, p);
+        _mm256_storeu_pd(rx + j,
+                _mm256_fnmadd_pd(dx, t, _mm256_loadu_pd(rx + j)));
+        _mm256_storeu_pd(ry + j,
+                _mm256_fnmadd_pd(dy, t, _mm256_loadu_pd(ry + j)));
+        _mm256_storeu_pd(rz + j,
+                _mm256_fnmadd_pd(dz, t, _mm256_loadu_pd(rz + j)));
+    }
+    double sx[4], sy[4], sz[4], sp[4];
+    _mm256_storeu_pd(sx, fx);
+    _mm256_storeu_pd(sy, fy);
+    _mm256_storeu_pd(sz, fz);
+    _mm256_storeu_pd(sp, p);
+    *phi += (sp[0] + sp[1]) + (sp[2] + sp[3]);
+    Vector3D f((sx[0] + sx[1]) + (sx[2] + sx[3]),
+               (sy[0] + sy[1]) + (sy[2] + sy[3]),
+               (sz[0] + sz[1]) + (sz[2] + sz[3]));
+    return f + pair_scalar(x, y, z, q, ri, qi, j, end, rx, ry, rz,
+                           phi);
+}
+
+__attribute__((target("avx512f")))
+Vector3D row_avx512(const double* x, const double* y, const double* z,
+                    const double* q, const Vector3D& ri,
+                    size_t begin, size_t end) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d fx = zero, fy = zero, fz = zero;
+
+    for (size_t j = begin; j < end; j += 8) {
+        // Mask off lanes past the end of the range on the final pass.
+        size_t left = end - j;
+        __mmask8 valid = left >= 8 ? 0xFF : (__mmask8)((1u << left) - 1);
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(valid, x + j));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(valid, y + j));
+        __m512d dz = _mm512_sub_pd(zi, _mm512_maskz_loadu_pd(valid, z + j));
+        __m512d r2 = _mm512_mul_pd(dx, dx);
+        r2 = _mm512_fmadd_pd(dy, dy, r2);
+        r2 = _mm512_fmadd_pd(dz, dz, r2);
+        // Skip coincident pairs as well as lanes past the end.
+        __mmask8 use = _mm512_mask_cmp_pd_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512d s = _mm512_maskz_div_pd(use,
+                _mm512_maskz_loadu_pd(valid, q + j),
+                _mm512_mul_pd(r2, _mm512_sqrt_pd(r2)));
+        fx = _mm512_fmadd_pd(dx, s, fx);
+        fy = _mm512_fmadd_pd(dy, s, fy);
+        fz = _mm512_fmadd_pd(dz, s, fz);
+    }
+    return Vector3D(_mm512_reduce_add_pd(fx), _mm512_reduce_add_pd(fy),
+                    _mm512_reduce_add_pd(fz));
+}
+
+__attribute__((target("avx512f")))
+Vector3D pair_avx512(const double* x, const double* y, const double* z,
+                     const double* q, const Vector3D& ri, double qi,
+                     size_t begin, size_t end,
+                     double* rx, double* ry, double* rz, double* phi) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512d qiv = _mm512_set1_pd(qi);
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d fx = zero, fy = zero, fz = zero, p = zero;
+
+    for (size_t j = begin; j < end; j += 8) {
+        size_t left = end - j;
+        __mmask8 valid = left >= 8 ? 0xFF : (__mmask8)((1u << left) - 1);
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(valid, x + j));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(valid, y + j));
+        __m512d dz = _mm512_sub_pd(zi, _mm512_maskz_loadu_pd(valid, z + j));
+        __m512d r2 = _mm512_mul_pd(dx, dx);
+        r2 = _mm512_fmadd_pd(dy, dy, r2);
+        r2 = _mm512_fmadd_pd(dz, dz, r2);
+        __mmask8 use = _mm512_mask_cmp_pd_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512d s = _mm512_maskz_div_pd(use,
+                _mm512_maskz_loadu_pd(valid, q + j),
+                _mm512_mul_pd(r2, _mm512_sqrt_pd(r2)));
+        __m512d t = _mm512_mul_pd(qiv, s);
+        fx = _mm512_fmadd_pd(dx, s, fx);
+        fy = _mm512_fmadd_pd(dy, s, fy);
+        fz = _mm512_fmadd_pd(dz, s, fz);
+        p = _mm512_fmadd_pd(r2, s, p);
+        _mm512_mask_storeu_pd(rx + j, valid, _mm512_fnmadd_pd(dx, t,
+                    _mm512_maskz_loadu_pd(valid, rx + j)));
+        _mm512_mask_storeu_pd(ry + j, valid, _mm512_fnmadd_pd(dy, t,
+                    _mm512_maskz_loadu_pd(valid, ry + j)));
+        _mm512_mask_storeu_pd(rz + j, valid, _mm512_fnmadd_pd(dz, t,
+                    _mm512_maskz_loadu_pd(valid, rz + j)));
+    }
+    *phi += _mm512_reduce_add_pd(p);
+    return Vector3D(_mm512_reduce_add_pd(fx), _mm512_reduce_add_pd(fy),
+                    _mm512_reduce_add_pd(fz));
+}
+
+// Mixed-precision versions. Differences of positions are always taken in
+// double precision, as the ions are far closer to each other than to the
+// origin, and the field sums of each call are returned in double.
+
+/** @brief Convert two vectors of 8 doubles to one of 16 floats.
+ */
+__attribute__((target("avx512f")))
+inline __m512 narrow_avx512(__m512d lo, __m512d hi) {
+    return _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))),
+            _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1));
+}
+
+/** @brief Convert the lower (hi = false) or upper 8 floats to double.
+ */
+__attribute__((target("avx512f")))
+inline __m512d widen_avx512(__m512 v, bool hi) {
+    return _mm512_cvtps_pd(hi ? _mm256_castpd_ps(_mm512_extractf64x4_pd(
+                                        _mm512_castps_pd(v), 1))
+                              : _mm512_castps512_ps256(v));
+}
+
+/** @brief Differences xi - x[j] for 16 sources, rounded to single precision.
+ */
+__attribute__((target("avx512f")))
+inline __m512 delta_avx512(__m512d xi, const double* x, __mmask8 lo,
+                           __mmask8 hi) {
+    return narrow_avx512(_mm512_sub_pd(xi, _mm512_maskz_loadu_pd(lo, x)),
+                         _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(hi, x + 8)));
+}
+
+/** @brief q/r^3 in single precision, from rsqrt14 and one Newton step.
+ */
+__attribute__((target("avx512f")))
+inline __m512 strength_avx512_single(__m512 r2, __m512 q, __mmask16 use) {
+    __m512 y = _mm512_maskz_rsqrt14_ps(use, r2);
+    __m512 yy = _mm512_mul_ps(y, y);
+    y = _mm512_mul_ps(y, _mm512_fnmadd_ps(
+            _mm512_mul_ps(_mm512_set1_ps(0.5f), r2), yy,
+            _mm512_set1_ps(1.5f)));
+    return _mm512_mul_ps(q, _mm512_mul_ps(y, _mm512_mul_ps(y, y)));
+}
+
+__attribute__((target("avx512f")))
+Vector3D row_avx512_single(const double* x, const double* y, const double* z,
+                           const double* q, const Vector3D& ri,
+                           size_t begin, size_t end) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 fx = zero, fy = zero, fz = zero;
+
+    for (size_t j = begin; j < end; j += 16) {
+        size_t left = end - j;
+        __mmask16 valid = left >= 16 ? 0xFFFF
+                                     : (__mmask16)((1u << left) - 1);
+        __mmask8 lo = (__mmask8)valid, hi = (__mmask8)(valid >> 8);
+        __m512 dx = delta_avx512(xi, x + j, lo, hi);
+        __m512 dy = delta_avx512(yi, y + j, lo, hi);
+        __m512 dz = delta_avx512(zi, z + j, lo, hi);
+        __m512 qj = narrow_avx512(_mm512_maskz_loadu_pd(lo, q + j),
+                                  _mm512_maskz_loadu_pd(hi, q + j + 8));
+        __m512 r2 = _mm512_mul_ps(dx, dx);
+        r2 = _mm512_fmadd_ps(dy, dy, r2);
+        r2 = _mm512_fmadd_ps(dz, dz, r2);
+        __mmask16 use = _mm512_mask_cmp_ps_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512 s = strength_avx512_single(r2, qj, use);
+        fx = _mm512_fmadd_ps(dx, s, fx);
+        fy = _mm512_fmadd_ps(dy, s, fy);
+        fz = _mm512_fmadd_ps(dz, s, fz);
+    }
+    return Vector3D(
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fx, false),
+                                           widen_avx512(fx, true))),
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fy, false),
+                                           widen_avx512(fy, true))),
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fz, false),
+                                           widen_avx512(fz, true))));
+}
+
+/** @brief Subtract d*t from 16 reactions in double precision.
+ */
+__attribute__((target("avx512f")))
+inline void react_avx512(double* r, __m512 d, __m512 t, __mmask8 lo,
+                         __mmask8 hi) {
+    __m512 dt = _mm512_mul_ps(d, t);
+    _mm512_mask_storeu_pd(r, lo, _mm512_sub_pd(_mm512_maskz_loadu_pd(lo, r),
+                                               widen_avx512(dt, false)));
+    _mm512_mask_storeu_pd(r + 8, hi,
+            _mm512_sub_pd(_mm512_maskz_loadu_pd(hi, r + 8),
+                          widen_avx512(dt, true)));
+}
+
+__attribute__((target("avx512f")))
+Vector3D pair_avx512_single(const double* x, const double* y,
+                            const double* z, const double* q,
+                            const Vector3D& ri, double qi,
+                            size_t begin, size_t end,
+                            double* rx, double* ry, double* rz, double* phi) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512 qiv = _mm512_set1_ps(static_cast<float>(qi));
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 fx = zero, fy = zero, fz = zero, p = zero;
+
+    for (size_t j = begin; j < end; j += 16) {
+        size_t left = end - j;
+        __mmask16 valid = left >= 16 ? 0xFFFF
+                                     : (__mmask16)((1u << left) - 1);
+        __mmask8 lo = (__mmask8)valid, hi = (__mmask8)(valid >> 8);
+        __m512 dx = delta_avx512(xi, x + j, lo, hi);
+        __m512 dy = delta_avx512(yi, y + j, lo, hi);
+        __m512 dz = delta_avx512(zi, z + j, lo, hi);
+        __m512 qj = narrow_avx512(_mm512_maskz_loadu_pd(lo, q + j),
+                                  _mm512_maskz_loadu_pd(hi, q + j + 8));
+        __m512 r2 = _mm512_mul_ps(dx, dx);
+        r2 = _mm512_fmadd_ps(dy, dy, r2);
+        r2 = _mm512_fmadd_ps(dz, dz, r2);
+        __mmask16 use = _mm512_mask_cmp_ps_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512 s = strength_avx512_single(r2, qj, use);
+        __m512 t = _mm512_mul_ps(qiv, s);
+        fx = _mm512_fmadd_ps(dx, s, fx);
+        fy = _mm512_fmadd_ps(dy, s, fy);
+        fz = _mm512_fmadd_ps(dz, s, fz);
+        p = _mm512_fmadd_ps(r2, s, p);
+        react_avx512(rx + j, dx, t, lo, hi);
+        react_avx512(ry + j, dy, t, lo, hi);
+        react_avx512(rz + j, dz, t, lo, hi);
+    }
+    *phi += _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(p, false),
+                                               widen_avx512(p, true)));
+    return Vector3D(
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fx, false),
+                                           widen_avx512(fx, true))),
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fy, false),
+                                           widen_avx512(fy, true))),
+        _mm512_reduce_add_pd(_mm512_add_pd(widen_avx512(fz, false),
+                                           widen_avx512(fz, true))));
+}
+
+/** @brief q/r^3 in double precision, from rsqrt14 and one Newton step,
+ *  which leaves a relative error of about 2^-28.
+ */
+__attribute__((target("avx512f")))
+inline __m512d strength_avx512_rsqrt(__m512d r2, __m512d q, __mmask8 use) {
+    __m512d y = _mm512_maskz_rsqrt14_pd(use, r2);
+    __m512d yy = _mm512_mul_pd(y, y);
+    y = _mm512_mul_pd(y, _mm512_fnmadd_pd(
+            _mm512_mul_pd(_mm512_set1_pd(0.5), r2), yy, _mm512_set1_pd(1.5)));
+    return _mm512_mul_pd(q, _mm512_mul_pd(y, _mm512_mul_pd(y, y)));
+}
+
+__attribute__((target("avx512f")))
+Vector3D row_avx512_rsqrt(const double* x, const double* y, const double* z,
+                          const double* q, const Vector3D& ri,
+                          size_t begin, size_t end) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d fx = zero, fy = zero, fz = zero;
+
+    for (size_t j = begin; j < end; j += 8) {
+        size_t left = end - j;
+        __mmask8 valid = left >= 8 ? 0xFF : (__mmask8)((1u << left) - 1);
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(valid, x + j));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(valid, y + j));
+        __m512d dz = _mm512_sub_pd(zi, _mm512_maskz_loadu_pd(valid, z + j));
+        __m512d r2 = _mm512_mul_pd(dx, dx);
+        r2 = _mm512_fmadd_pd(dy, dy, r2);
+        r2 = _mm512_fmadd_pd(dz, dz, r2);
+        __mmask8 use = _mm512_mask_cmp_pd_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512d s = strength_avx512_rsqrt(r2,
+                _mm512_maskz_loadu_pd(valid, q + j), use);
+        fx = _mm512_fmadd_pd(dx, s, fx);
+        fy = _mm512_fmadd_pd(dy, s, fy);
+        fz = _mm512_fmadd_pd(dz, s, fz);
+    }
+    return Vector3D(_mm512_reduce_add_pd(fx), _mm512_reduce_add_pd(fy),
+                    _mm512_reduce_add_pd(fz));
+}
+
+__attribute__((target("avx512f")))
+Vector3D pair_avx512_rsqrt(const double* x, const double* y, const double* z,
+                           const double* q, const Vector3D& ri, double qi,
+                           size_t begin, size_t end,
+                           double* rx, double* ry, double* rz, double* phi) {
+    const __m512d xi = _mm512_set1_pd(ri.x);
+    const __m512d yi = _mm512_set1_pd(ri.y);
+    const __m512d zi = _mm512_set1_pd(ri.z);
+    const __m512d qiv = _mm512_set1_pd(qi);
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d fx = zero, fy = zero, fz = zero, p = zero;
+
+    for (size_t j = begin; j < end; j += 8) {
+        size_t left = end - j;
+        __mmask8 valid = left >= 8 ? 0xFF : (__mmask8)((1u << left) - 1);
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(valid, x + j));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(valid, y + j));
+        __m512d dz = _mm512_sub_pd(zi, _mm512_maskz_loadu_pd(valid, z + j));
+        __m512d r2 = _mm512_mul_pd(dx, dx);
+        r2 = _mm512_fmadd_pd(dy, dy, r2);
+        r2 = _mm512_fmadd_pd(dz, dz, r2);
+        __mmask8 use = _mm512_mask_cmp_pd_mask(valid, r2, zero, _CMP_NEQ_OQ);
+        __m512d s = strength_avx512_rsqrt(r2,
+                _mm512_maskz_loadu_pd(valid, q + j), use);
+        __m512d t = _mm512_mul_pd(qiv, s);
+        fx = _mm512_fmadd_pd(dx, s, fx);
+        fy = _mm512_fmadd_pd(dy, s, fy);
+        fz = _mm512_fmadd_pd(dz, s, fz);
+        p = _mm512_fmadd_pd(r2, s, p);
+        _mm512_mask_storeu_pd(rx + j, valid, _mm512_fnmadd_pd(dx, t,
+                    _mm512_maskz_loadu_pd(valid, rx + j)));
+        _mm512_mask_storeu_pd(ry + j, valid, _mm512_fnmadd_pd(dy, t,
+                    _mm512_maskz_loadu_pd(valid, ry + j)));
+        _mm512_mask_storeu_pd(rz + j, valid, _mm512_fnmadd_pd(dz, t,
+                    _mm512_maskz_loadu_pd(valid, rz + j)));
+    }
+    *phi += _mm512_reduce_add_pd(p);
+    return Vector3D(_mm512_reduce_add_pd(fx), _mm512_reduce_add_pd(fy),
+                    _mm512_reduce_add_pd(fz));
+}
+
+/** @brief Convert two vectors of 4 doubles to one of 8 floats.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256 narrow_avx2(__m256d lo, __m256d hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                                _mm256_cvtpd_ps(hi), 1);
+}
+
+/** @brief Convert the lower (hi = false) or upper 4 floats to double.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256d widen_avx2(__m256 v, bool hi) {
+    return _mm256_cvtps_pd(hi ? _mm256_extractf128_ps(v, 1)
+                              : _mm256_castps256_ps128(v));
+}
+
+/** @brief Differences xi - x[j] for 8 sources, rounded to single precision.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256 delta_avx2(__m256d xi, const double* x) {
+    return narrow_avx2(_mm256_sub_pd(xi, _mm256_loadu_pd(x)),
+                       _mm256_sub_pd(xi, _mm256_loadu_pd(x + 4)));
+}
+
+/** @brief Sum of the 8 lanes of a float vector, in double precision.
+ */
+__attribute__((target("avx2,fma")))
+inline double reduce_avx2(__m256 v) {
+    double s[4];
+    _mm256_storeu_pd(s, _mm256_add_pd(widen_avx2(v, false),
+                                      widen_avx2(v, true)));
+    return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+/** @brief q/r^3 in single precision, from rsqrt and one Newton step.
+ *  Coincident pairs give zero.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256 strength_avx2_single(__m256 r2, __m256 q) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 self = _mm256_cmp_ps(r2, zero, _CMP_EQ_OQ);
+    r2 = _mm256_blendv_ps(r2, _mm256_set1_ps(1.0f), self);
+    __m256 y = _mm256_rsqrt_ps(r2);
+    __m256 yy = _mm256_mul_ps(y, y);
+    y = _mm256_mul_ps(y, _mm256_fnmadd_ps(
+            _mm256_mul_ps(_mm256_set1_ps(0.5f), r2), yy,
+            _mm256_set1_ps(1.5f)));
+    __m256 s = _mm256_mul_ps(q, _mm256_mul_ps(y, _mm256_mul_ps(y, y)));
+    return _mm256_andnot_ps(self, s);
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D row_avx2_single(const double* x, const double* y, const double* z,
+                         const double* q, const Vector3D& ri,
+                         size_t begin, size_t end) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 fx = zero, fy = zero, fz = zero;
+
+    size_t j = begin;
+    for (; j + 8 <= end; j += 8) {
+        __m256 dx = delta_avx2(xi, x + j);
+        __m256 dy = delta_avx2(yi, y + j);
+        __m256 dz = delta_avx2(zi, z + j);
+        __m256 r2 = _mm256_mul_ps(dx, dx);
+        r2 = _mm256_fmadd_ps(dy, dy, r2);
+        r2 = _mm256_fmadd_ps(dz, dz, r2);
+        __m256 s = strength_avx2_single(r2, narrow_avx2(
+                _mm256_loadu_pd(q + j), _mm256_loadu_pd(q + j + 4)));
+        fx = _mm256_fmadd_ps(dx, s, fx);
+        fy = _mm256_fmadd_ps(dy, s, fy);
+        fz = _mm256_fmadd_ps(dz, s, fz);
+    }
+    Vector3D f(reduce_avx2(fx), reduce_avx2(fy), reduce_avx2(fz));
+    return f + row_scalar(x, y, z, q, ri, j, end);
+}
+
+/** @brief Subtract d*t from 8 reactions in double precision.
+ */
+__attribute__((target("avx2,fma")))
+inline void react_avx2(double* r, __m256 d, __m256 t) {
+    __m256 dt = _mm256_mul_ps(d, t);
+    _mm256_storeu_pd(r, _mm256_sub_pd(_mm256_loadu_pd(r),
+                                      widen_avx2(dt, false)));
+    _mm256_storeu_pd(r + 4, _mm256_sub_pd(_mm256_loadu_pd(r + 4),
+                                          widen_avx2(dt, true)));
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D pair_avx2_single(const double* x, const double* y, const double* z,
+                          const double* q, const Vector3D& ri, double qi,
+                          size_t begin, size_t end,
+                          double* rx, double* ry, double* rz, double* phi) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256 qiv = _mm256_set1_ps(static_cast<float>(qi));
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 fx = zero, fy = zero, fz = zero, p = zero;
+
+    size_t j = begin;
+    for (; j + 8 <= end; j += 8) {
+        __m256 dx = delta_avx2(xi, x + j);
+        __m256 dy = delta_avx2(yi, y + j);
+        __m256 dz = delta_avx2(zi, z + j);
+        __m256 r2 = _mm256_mul_ps(dx, dx);
+        r2 = _mm256_fmadd_ps(dy, dy, r2);
+        r2 = _mm256_fmadd_ps(dz, dz, r2);
+        __m256 s = strength_avx2_single(r2, narrow_avx2(
+                _mm256_loadu_pd(q + j), _mm256_loadu_pd(q + j + 4)));
+        __m256 t = _mm256_mul_ps(qiv, s);
+        fx = _mm256_fmadd_ps(dx, s, fx);
+        fy = _mm256_fmadd_ps(dy, s, fy);
+        fz = _mm256_fmadd_ps(dz, s, fz);
+        p = _mm256_fmadd_ps(r2, s, p);
+        react_avx2(rx + j, dx, t);
+        react_avx2(ry + j, dy, t);
+        react_avx2(rz + j, dz, t);
+    }
+    *phi += reduce_avx2(p);
+    Vector3D f(reduce_avx2(fx), reduce_avx2(fy), reduce_avx2(fz));
+    return f + pair_scalar(x, y, z, q, ri, qi, j, end, rx, ry, rz,
+                           phi);
+}
+
+/** @brief q/r^3 in double precision, from the single precision rsqrt and
+ *  two Newton steps, which leave a relative error of about 2^-44.
+ *  Coincident pairs give zero.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256d strength_avx2_rsqrt(__m256d r2, __m256d q) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    __m256d self = _mm256_cmp_pd(r2, zero, _CMP_EQ_OQ);
+    r2 = _mm256_blendv_pd(r2, _mm256_set1_pd(1.0), self);
+    __m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(r2)));
+    __m256d h = _mm256_mul_pd(half, r2);
+    y = _mm256_mul_pd(y, _mm256_fnmadd_pd(h, _mm256_mul_pd(y, y),
+                                          three_halves));
+    y = _mm256_mul_pd(y, _mm256_fnmadd_pd(h, _mm256_mul_pd(y, y),
+                                          three_halves));
+    __m256d s = _mm256_mul_pd(q, _mm256_mul_pd(y, _mm256_mul_pd(y, y)));
+    return _mm256_andnot_pd(self, s);
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D row_avx2_rsqrt(const double* x, const double* y, const double* z,
+                        const double* q, const Vector3D& ri,
+                        size_t begin, size_t end) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d fx = zero, fy = zero, fz = zero;
+
+    size_t j = begin;
+    for (; j + 4 <= end; j += 4) {
+        __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(x + j));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(y + j));
+        __m256d dz = _mm256_sub_pd(zi, _mm256_loadu_pd(z + j));
+        __m256d r2 = _mm256_mul_pd(dx, dx);
+        r2 = _mm256_fmadd_pd(dy, dy, r2);
+        r2 = _mm256_fmadd_pd(dz, dz, r2);
+        __m256d s = strength_avx2_rsqrt(r2, _mm256_loadu_pd(q + j));
+        fx = _mm256_fmadd_pd(dx, s, fx);
+        fy = _mm256_fmadd_pd(dy, s, fy);
+        fz = _mm256_fmadd_pd(dz, s, fz);
+    }
+    double sx[4], sy[4], sz[4];
+    _mm256_storeu_pd(sx, fx);
+    _mm256_storeu_pd(sy, fy);
+    _mm256_storeu_pd(sz, fz);
+    Vector3D f((sx[0] + sx[1]) + (sx[2] + sx[3]),
+               (sy[0] + sy[1]) + (sy[2] + sy[3]),
+               (sz[0] + sz[1]) + (sz[2] + sz[3]));
+    return f + row_scalar(x, y, z, q, ri, j, end);
+}
+
+__attribute__((target("avx2,fma")))
+Vector3D pair_avx2_rsqrt(const double* x, const double* y, const double* z,
+                         const double* q, const Vector3D& ri, double qi,
+                         size_t begin, size_t end,
+                         double* rx, double* ry, double* rz, double* phi) {
+    const __m256d xi = _mm256_set1_pd(ri.x);
+    const __m256d yi = _mm256_set1_pd(ri.y);
+    const __m256d zi = _mm256_set1_pd(ri.z);
+    const __m256d qiv = _mm256_set1_pd(qi);
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d fx = zero, fy = zero, fz = zero, p = zero;
+
+    size_t j = begin;
+    for (; j + 4 <= end; j += 4) {
+        __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(x + j));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(y + j));
+        __m256d dz = _mm256_sub_pd(zi, _mm256_loadu_pd(z + j));
+        __m256d r2 = _mm256_mul_pd(dx, dx);
+        r2 = _mm256_fmadd_pd(dy, dy, r2);
+        r2 = _mm256_fmadd_pd(dz, dz, r2);
+        __m256d s = strength_avx2_rsqrt(r2, _mm256_loadu_pd(q + j));
+        __m256d t = _mm256_mul_pd(qiv, s);
+        fx = _mm256_fmadd_pd(dx, s, fx);
+        fy = _mm256_fmadd_pd(dy, s, fy);
+        fz = _mm256_fmadd_pd(dz, s, fz);
+        p = _mm256_fmadd_pd(r2, s, p);
+        _mm256_storeu_pd(rx + j,
+                _mm256_fnmadd_pd(dx, t, _mm256_loadu_pd(rx + j)));
+        _mm256_storeu_pd(ry + j,
+                _mm256_fnmadd_pd(dy, t, _mm256_loadu_pd(ry + j)));
+        _mm256_storeu_pd(rz + j,
+                _mm256_fnmadd_pd(dz, t, _mm256_loadu_pd(rz + j)));
+    }
+    double sx[4], sy[4], sz[4], sp[4];
+    _mm256_storeu_pd(sx, fx);
+    _mm256_storeu_pd(sy, fy);
+    _mm256_storeu_pd(sz, fz);
+    _mm256_storeu_pd(sp, p);
+    *phi += (sp[0] + sp[1]) + (sp[2] + sp[3]);
+    Vector3D f((sx[0] + sx[1]) + (sx[2] + sx[3]),
+               (sy[0] + sy[1]) + (sy[2] + sy[3]),
+               (sz[0] + sz[1]) + (sz[2] + sz[3]));
+    return f + pair_scalar(x, y, z, q, ri, qi, j, end, rx, ry, rz,
+                           phi);
+}
+
+#endif  // CCMD_X86_KERNELS
+
+}  // namespace
+
+const size_t CoulombKernel::report_ions_;
+
+
+/**
+ *  @brief Select the kernel for the requested instruction set.
+ *
+ *  `SimParams::automatic` picks the widest supported by this processor. A
+ *  specific instruction set that the processor lacks falls back to the
+ *  automatic choice with a warning.
+ *
+ *  @param requested    Instruction set from the simulation parameters.
+ */
+CoulombKernel::CoulombKernel(SimParams::Kernel requested,
+                             SimParams::Precision precision)
+    : precision_(precision) {
+    Logger& log = Logger::getInstance();
+    isa_ = requested;
+    if (isa_ == SimParams::automatic) {
+        isa_ = detect();
+    } else if (!supported(isa_)) {
+        isa_ = detect();
+        log.warn("Requested Coulomb kernel not supported by this processor.");
+    }
+
+    switch (isa_) {
+#ifdef CCMD_X86_KERNELS
+        case SimParams::avx512:
+            row_ = row_avx512;
+            pair_ = pair_avx512;
+            break;
+        case SimParams::avx2:
+            row_ = row_avx2;
+            pair_ = pair_avx2;
+            break;
+        case SimParams::sse2:
+            row_ = row_sse2;
+            pair_ = pair_sse2;
+            break;
+#endif
+        default:
+            isa_ = SimParams::scalar;
+            row_ = row_scalar;
+            pair_ = pair_scalar;
+    }
+    exact_row_ = row_;
+
+    const bool single = precision_ == SimParams::single;
+    if (precision_ != SimParams::full) {
+        if (isa_ == SimParams::avx512) {
+#ifdef CCMD_X86_KERNELS
+            row_ = single ? row_avx512_single : row_avx512_rsqrt;
+            pair_ = single ? pair_avx512_single : pair_avx512_rsqrt;
+#endif
+        } else if (isa_ == SimParams::avx2) {
+#ifdef CCMD_X86_KERNELS
+            row_ = single ? row_avx2_single : row_avx2_rsqrt;
+            pair_ = single ? pair_avx2_single : pair_avx2_rsqrt;
+#endif
+        } else {
+            precision_ = SimParams::full;
+            log.warn("Mixed precision Coulomb kernels need AVX2 or "
+                     "AVX-512; using double precision.");
+        }
+    }
+    log.info("Coulomb kernel: " + name());
+}
+
+
+/** @brief Name of the instruction set in use.
+ */
+std::string CoulombKernel::name() const {
+    std::string precision;
+    if (precision_ == SimParams::single)
+        precision = ", single precision";
+    else if (precision_ == SimParams::rsqrt)
+        precision = ", rsqrt";
+    switch (isa_) {
+        case SimParams::avx512: return "avx512" + precision;
+        case SimParams::avx2:   return "avx2" + precision;
+        case SimParams::sse2:   return "sse2" + precision;
+        default:                return "scalar" + precision;
+    }
+}
+
+
+/** @brief Log the error of the row sum against the double precision kernel.
+ *
+ *  Compares the field at up to report_ions_ ions, spread evenly through the
+ *  store, from all the other ions. The error is given relative to the field
+ *  on each ion, and relative to the sum of the magnitudes of its pair
+ *  terms, which is the scale of the rounding error; the field itself nearly
+ *  cancels inside a crystal.
+ *
+ *  @param store    Positions and charges of the ions.
+ */
+void CoulombKernel::report_error(const IonStore& store) const {
+    const size_t n = store.size();
+    if (n < 2)
+        return;
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double* q = store.charge.data();
+    const size_t step = (n + report_ions_ - 1)/report_ions_;
+    double mean = 0.0, worst = 0.0, worst_scale = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < n; i += step) {
+        const Vector3D ri(x[i], y[i], z[i]);
+        Vector3D exact = exact_row_(x, y, z, q, ri, 0, n);
+        Vector3D error = row_(x, y, z, q, ri, 0, n) - exact;
+        double scale = 0.0;
+        for (size_t j = 0; j < n; ++j) {
+            double r = Vector3D::dist(ri, Vector3D(x[j], y[j], z[j]));
+            if (r != 0.0)
+                scale += std::abs(q[j])/(r*r);
+        }
+        double relative = exact.norm() > 0.0 ? error.norm()/exact.norm() : 0.0;
+        mean += relative;
+        worst = std::max(worst, relative);
+        worst_scale = std::max(worst_scale, error.norm()/scale);
+        ++count;
+    }
+    mean /= count;
+    std::ostringstream message;
+    message << std::scientific << std::setprecision(2)
+            << "Coulomb " << name() << " error on " << count
+            << " ions: mean relative " << mean << ", max relative " << worst
+            << ", max relative to pair sum " << worst_scale;
+    Logger::getInstance().info(message.str());
+}
+
+
+/** @brief Test whether this processor can run the given instruction set.
+ */
+bool CoulombKernel::supported(SimParams::Kernel isa) {
+#ifdef CCMD_X86_KERNELS
+    __builtin_cpu_init();
+#endif
+    switch (isa) {
+#ifdef CCMD_X86_KERNELS
+        case SimParams::avx512:
+            return __builtin_cpu_supports("avx512f");
+        case SimParams::avx2:
+            return __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma");
+        case SimParams::sse2:
+            return __builtin_cpu_supports("sse2");
+#endif
+        case SimParams::scalar:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/** @brief Find the widest instruction set supported by this processor.
+ */
+SimParams::Kernel CoulombKernel::detect() {
+    if (supported(SimParams::avx512)) return SimParams::avx512;
+    if (supported(SimParams::avx2)) return SimParams::avx2;
+    if (supported(SimParams::sse2)) return SimParams::sse2;
+    return SimParams::scalar;
+}
@@ -9,6 +9,9 @@
 
 #include <list>
 #include <string>
+#include <vector>
+
+#include "include/logger.h"
 
 /**
  *  @class DataWriter
@@ -93,6 +96,52 @@ void DataWriter::writeComment(const std::string& fileName,
     (*out) << std::endl;
 }
 
+/**
+ *  @brief Reopen a file written by an earlier run, keeping only its first
+ *  lines.
+ *
+ *  Used when carrying on from a checkpoint, so that the rows written after
+ *  the checkpoint by the interrupted run are replaced rather than repeated.
+ *  Further rows are appended to those kept.
+ *
+ *  @param fileName The file name.
+ *  @param rows     Number of lines to keep.
+ */
+void DataWriter::keepRows(const std::string& fileName, int rows) {
+    std::vector<std::string> lines;
+    std::ifstream in(fileName.c_str());
+    std::string line;
+    while (static_cast<int>(lines.size()) < rows && std::getline(in, line))
+        lines.push_back(line);
+    in.close();
+    if (static_cast<int>(lines.size()) < rows) {
+        Logger& log = Logger::getInstance();
+        log.warn("Only " + std::to_string(lines.size()) + " of "
+                 + std::to_string(rows) + " rows of " + fileName
+                 + " were found.");
+    }
+
+    if (streamlist_.count(fileName))
+        streamlist_[fileName]->close();
+    StreamPt stream(new std::ofstream(
+                fileName.c_str(), std::ofstream::out | std::ofstream::trunc));
+    for (const auto& l : lines)
+        (*stream) << l << '\n';
+    streamlist_[fileName] = stream;
+}
+
+
+/**
+ *  @brief Write everything buffered so far to the files, so that they are
+ *  complete up to a checkpoint.
+ */
+void DataWriter::flush() {
+    for (auto it : streamlist_) {
+        it.second->flush();
+    }
+}
+
+
 /**
  *  @brief Get the stored file stream pointer, or create a new one.
  *
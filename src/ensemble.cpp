@@ -0,0 +1,457 @@
+/**
+ * @file ensemble.cpp
+ * @brief Function definitions for an ensemble of replica simulations.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/ensemble.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "include/ion.h"
+#include "include/logger.h"
+#include "include/minimiser.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CCMD_X86_KERNELS
+#include "include/coulombkernel.h"
+#endif
+
+namespace {
+
+/**
+ *  @brief Add the Coulomb force and energy of every pair of ions, for all
+ *  replicas together.
+ *
+ *  Each pair (i, j) is evaluated once, adding the force to ion i and the
+ *  equal and opposite force to ion j. The charges are the same in every
+ *  replica. The innermost loop runs over the replicas, which are
+ *  independent, so it is vectorised whatever the number of ions. The body
+ *  is inlined into a copy compiled for each instruction set.
+ */
+inline __attribute__((always_inline))
+void replica_pairs(const IonStore& store, size_t n_rep,
+                   double* fx, double* fy, double* fz, double* e) {
+    const size_t n_ions = store.size()/n_rep;
+    for (size_t i = 0; i < n_ions; ++i) {
+        const size_t ki = i*n_rep;
+        const double* xi = store.x.data() + ki;
+        const double* yi = store.y.data() + ki;
+        const double* zi = store.z.data() + ki;
+        double* fxi = fx + ki;
+        double* fyi = fy + ki;
+        double* fzi = fz + ki;
+        for (size_t j = i + 1; j < n_ions; ++j) {
+            const size_t kj = j*n_rep;
+            const double* xj = store.x.data() + kj;
+            const double* yj = store.y.data() + kj;
+            const double* zj = store.z.data() + kj;
+            double* fxj = fx + kj;
+            double* fyj = fy + kj;
+            double* fzj = fz + kj;
+            const double qq = store.charge[ki]*store.charge[kj];
+            // The replicas are independent, so the arrays do not overlap.
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+            for (size_t r = 0; r < n_rep; ++r) {
+                double dx = xi[r] - xj[r];
+                double dy = yi[r] - yj[r];
+                double dz = zi[r] - zj[r];
+                double inv_r = 1.0/std::sqrt(dx*dx + dy*dy + dz*dz);
+                double f = qq*inv_r*inv_r*inv_r;
+                fxi[r] += f*dx;
+                fyi[r] += f*dy;
+                fzi[r] += f*dz;
+                fxj[r] -= f*dx;
+                fyj[r] -= f*dy;
+                fzj[r] -= f*dz;
+                e[r] += qq*inv_r;
+            }
+        }
+    }
+}
+
+void pairs_default(const IonStore& store, size_t n_rep,
+                   double* fx, double* fy, double* fz, double* e) {
+    replica_pairs(store, n_rep, fx, fy, fz, e);
+}
+
+#ifdef CCMD_X86_KERNELS
+__attribute__((target("avx2,fma")))
+void pairs_avx2(const IonStore& store, size_t n_rep,
+                double* fx, double* fy, double* fz, double* e) {
+    replica_pairs(store, n_rep, fx, fy, fz, e);
+}
+
+__attribute__((target("avx512f")))
+void pairs_avx512(const IonStore& store, size_t n_rep,
+                  double* fx, double* fy, double* fz, double* e) {
+    replica_pairs(store, n_rep, fx, fy, fz, e);
+}
+#endif  // CCMD_X86_KERNELS
+
+}  // namespace
+
+
+/**
+ *  @class Replica
+ *  @brief One simulation of an Ensemble.
+ *
+ *  Loads every parameter set from \c trap.info in the working directory, as
+ *  the program does for a single run, then builds the trap and ion cloud.
+ *  Output files of the replica are written to the same directory.
+ *
+ *  @param path         Working directory, ending in a '/'.
+ *  @param default_seed Random seed used if \c simulation.seed is not set,
+ *                      different for each replica.
+ */
+Replica::Replica(const std::string& path, int default_seed)
+    : path(path), trap_params(path + "trap.info"),
+      cloud_params(path + "trap.info"),
+      integration_params(path + "trap.info"),
+      microscope_params(path + "trap.info"),
+      sim_params(path + "trap.info"), laser_params(path + "trap.info") {
+    if (sim_params.random_seed < 0) {
+        sim_params.random_seed = default_seed;
+        Logger& log = Logger::getInstance();
+        log.info("Random seed " + std::to_string(default_seed) + " for "
+                 + path);
+    }
+    trap = make_trap(trap_params, integration_params);
+    trap->use_phase_table(integration_params.time_step/2.0);
+    cloud = std::make_shared<IonCloud>(trap, cloud_params, sim_params,
+                                       trap_params, laser_params);
+    if (integration_params.relax_steps > 0) {
+        Minimiser minimiser(cloud, integration_params, sim_params);
+        minimiser.relax();
+    }
+}
+
+
+/**
+ *  @class Ensemble
+ *  @brief Velocity Verlet integration of a set of replicas in one process.
+ *
+ *  Parameter sweeps run the same crystal many times with a different trap
+ *  voltage, laser detuning or seed. Each replica is loaded from its own
+ *  working directory, but all must hold the same ions in the same order, so
+ *  ion \c i is the same species in every replica. The positions and
+ *  velocities are then kept in one IonStore with the replicas interleaved:
+ *  ion \c i of replica \c r is at index \c i*R+r. The innermost loop of the
+ *  trap kick, drift and Coulomb sum runs over the replicas, which are
+ *  independent, so it vectorises for any number of ions. For the small
+ *  crystals of most sweeps this is much faster than one process per point.
+ *
+ *  The step is that of VerletIntegrator. The Coulomb force is a direct sum
+ *  over the pairs of each replica, whatever \c simulation.method is set to,
+ *  and the Coulomb energy is found with it. The scattering and heating of
+ *  laser cooled ions are random and applied ion by ion, by the Ion objects
+ *  of each replica's own cloud.
+ *
+ *  After each step the state is copied back to each replica's IonCloud, and
+ *  the listeners registered for that replica are told, so the output files
+ *  are the same as those of a single run. All replicas must take the same
+ *  number of steps of the same size. Each replica's ions draw from the
+ *  random number generator of its own cloud, seeded by its own
+ *  \c simulation.seed, or from the time plus its index if that is not set,
+ *  so a replica follows the same trajectory whichever
+ *  replicas it is run with.
+ */
+
+/**
+ *  @brief Load each replica, check they can run together and interleave
+ *  their ions.
+ *
+ *  @param paths    Working directory of each replica, ending in a '/'.
+ */
+Ensemble::Ensemble(const std::vector<std::string>& paths)
+    : n_ions_(0), n_iter_(0) {
+    Logger& log = Logger::getInstance();
+    if (paths.empty()) {
+        log.error("An ensemble needs at least one replica.");
+        throw std::runtime_error("empty ensemble");
+    }
+    // Replicas without a seed of their own are seeded from the time, each
+    // with a different seed.
+    const int time_seed = static_cast<int>(std::time(0));
+    for (const auto& path : paths) {
+        log.info("Loading replica " + path);
+        const int default_seed =
+            time_seed + static_cast<int>(replicas_.size());
+        replicas_.push_back(Replica_ptr(new Replica(path, default_seed)));
+    }
+    check_replicas();
+
+    const size_t n_rep = replicas_.size();
+    n_ions_ = replicas_[0]->cloud->number_of_ions();
+    store_.reset(new IonStore(n_ions_*n_rep));
+    for (size_t r = 0; r < n_rep; ++r) {
+        const IonStore& s = replicas_[r]->cloud->get_store();
+        for (size_t i = 0; i < n_ions_; ++i) {
+            size_t k = i*n_rep + r;
+            store_->set_pos(k, s.get_pos(i));
+            store_->set_vel(k, s.get_vel(i));
+            store_->mass[k] = s.mass[i];
+            store_->charge[k] = s.charge[i];
+        }
+    }
+
+    const Ion_ptr_vector& ions = replicas_[0]->cloud->get_ions();
+    for (size_t i = 0; i < n_ions_; ++i) {
+        if (ions[i]->get_type().is_laser_cooled)
+            cooled_.push_back(i);
+    }
+
+    fx_.resize(n_ions_*n_rep);
+    fy_.resize(n_ions_*n_rep);
+    fz_.resize(n_ions_*n_rep);
+    energy_.resize(n_rep);
+    cx_.resize(n_rep);
+    cy_.resize(n_rep);
+    cz_.resize(n_rep);
+
+    // The same instruction set as the Coulomb kernel of a single run.
+    SimParams::Kernel isa = replicas_[0]->sim_params.coulomb_kernel;
+#ifdef CCMD_X86_KERNELS
+    if (isa == SimParams::automatic || !CoulombKernel::supported(isa))
+        isa = CoulombKernel::detect();
+    if (isa == SimParams::avx512) {
+        pairs_ = pairs_avx512;
+    } else if (isa == SimParams::avx2) {
+        pairs_ = pairs_avx2;
+    } else {
+        pairs_ = pairs_default;
+    }
+#else
+    pairs_ = pairs_default;
+#endif
+    update_coulomb();
+
+    log.info("Ensemble of " + std::to_string(n_rep) + " replicas of "
+             + std::to_string(n_ions_) + " ions.");
+}
+
+
+/**
+ *  @brief Check that every replica has the same ions and step sequence as
+ *  the first.
+ *
+ *  Throws a runtime_error if not.
+ */
+void Ensemble::check_replicas() const {
+    Logger& log = Logger::getInstance();
+    const Replica& first = *replicas_[0];
+    const Ion_ptr_vector& ions = first.cloud->get_ions();
+    for (const auto& rep : replicas_) {
+        if (rep->integration_params.method != IntegrationParams::verlet) {
+            log.error("Replica " + rep->path
+                      + " must use the verlet integrator in an ensemble.");
+            throw std::runtime_error("ensemble needs the verlet integrator");
+        }
+        if (rep->integration_params.cooling_model != IntegrationParams::rf) {
+            log.error("Replica " + rep->path
+                      + " must cool in the RF trap in an ensemble.");
+            throw std::runtime_error("ensemble needs RF cooling");
+        }
+        if (rep->integration_params.checkpoint_periods > 0.0) {
+            log.error("Replica " + rep->path
+                      + " cannot write checkpoints in an ensemble.");
+            throw std::runtime_error("ensemble cannot write checkpoints");
+        }
+        if (rep->integration_params.steps_per_period
+                != first.integration_params.steps_per_period
+            || rep->integration_params.cool_steps
+                != first.integration_params.cool_steps
+            || rep->integration_params.hist_steps
+                != first.integration_params.hist_steps
+            || rep->integration_params.min_cool_steps
+                != first.integration_params.min_cool_steps) {
+            log.error("Replica " + rep->path
+                      + " does not take the same steps as " + first.path);
+            throw std::runtime_error("ensemble steps differ");
+        }
+        const Ion_ptr_vector& other = rep->cloud->get_ions();
+        bool same = other.size() == ions.size();
+        for (size_t i = 0; same && i < ions.size(); ++i) {
+            same = other[i]->get_mass() == ions[i]->get_mass()
+                && other[i]->get_charge() == ions[i]->get_charge()
+                && other[i]->get_type().is_laser_cooled
+                    == ions[i]->get_type().is_laser_cooled;
+        }
+        if (!same) {
+            log.error("Replica " + rep->path
+                      + " does not hold the same ions as " + first.path);
+            throw std::runtime_error("ensemble ions differ");
+        }
+    }
+}
+
+
+void Ensemble::registerListener(size_t r, const IntegratorListener_ptr& l) {
+    l->setCloud(replicas_[r]->cloud);
+    replicas_[r]->listeners.push_back(l);
+}
+
+void Ensemble::deregisterListener(size_t r, const IntegratorListener_ptr& l) {
+    std::vector<IntegratorListener_ptr>& listeners = replicas_[r]->listeners;
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), l),
+                    listeners.end());
+    l->finished();
+}
+
+void Ensemble::notifyListeners(const int i) const {
+    for (const auto& rep : replicas_) {
+        for (auto l : rep->listeners) {
+            l->update(i);
+        }
+    }
+}
+
+
+/** @brief Advance every replica by one velocity Verlet step of \c dt.
+ *
+ *  The same sequence as VerletIntegrator::evolve: the Coulomb force is
+ *  evaluated once per step, after the drift, and kept for the first
+ *  half-kick of the next step.
+ *
+ *  @param dt   Time step.
+ */
+void Ensemble::evolve(double dt) {
+    const double half_dt = dt/2.0;
+
+    kick(half_dt);
+    drift(dt);
+    update_coulomb();
+    for (const auto& rep : replicas_)
+        rep->trap->evolve(half_dt);
+
+    kick(half_dt);
+    for (const auto& rep : replicas_)
+        rep->trap->evolve(half_dt);
+
+    scatter();
+    notifyListeners(n_iter_++);
+}
+
+
+/**
+ *  @brief Kick every ion by the Coulomb and trap forces, then apply the
+ *  heating and laser cooling of the cooled ions.
+ *
+ *  The trap force on ion \c i of replica \c r is its charge times
+ *  (cx_[r] x, cy_[r] y, cz_[r] z), with the coefficients from
+ *  IonTrap::force_coefficients.
+ *
+ *  @param dt   Time step.
+ */
+void Ensemble::kick(double dt) {
+    const size_t n_rep = replicas_.size();
+    for (size_t r = 0; r < n_rep; ++r) {
+        Vector3D c = replicas_[r]->trap->force_coefficients();
+        cx_[r] = c.x;
+        cy_[r] = c.y;
+        cz_[r] = c.z;
+    }
+
+    const double* cx = cx_.data();
+    const double* cy = cy_.data();
+    const double* cz = cz_.data();
+    for (size_t i = 0; i < n_ions_; ++i) {
+        const size_t k = i*n_rep;
+        const double* x = store_->x.data() + k;
+        const double* y = store_->y.data() + k;
+        const double* z = store_->z.data() + k;
+        const double* fx = fx_.data() + k;
+        const double* fy = fy_.data() + k;
+        const double* fz = fz_.data() + k;
+        double* vx = store_->vx.data() + k;
+        double* vy = store_->vy.data() + k;
+        double* vz = store_->vz.data() + k;
+        // Same species in every replica.
+        const double time_over_mass = dt/store_->mass[k];
+        const double q = store_->charge[k];
+        for (size_t r = 0; r < n_rep; ++r) {
+            vx[r] += (fx[r] + q*cx[r]*x[r])*time_over_mass;
+            vy[r] += (fy[r] + q*cy[r]*y[r])*time_over_mass;
+            vz[r] += (fz[r] + q*cz[r]*z[r])*time_over_mass;
+        }
+    }
+
+    // The laser forces depend on the velocity and random numbers, so are
+    // applied by each ion object to its entry in its own cloud.
+    for (size_t r = 0; r < n_rep; ++r) {
+        IonCloud& cloud = *replicas_[r]->cloud;
+        const Ion_ptr_vector& ions = cloud.get_ions();
+        for (size_t i : cooled_) {
+            const size_t k = i*n_rep + r;
+            cloud.store_.set_vel(i, store_->get_vel(k));
+            ions[i]->heat(dt);
+            ions[i]->cool(dt);
+            store_->set_vel(k, cloud.store_.get_vel(i));
+        }
+    }
+}
+
+
+/**
+ *  @brief Move every ion at its velocity for a time \c dt.
+ *
+ *  @param dt   Time step.
+ */
+void Ensemble::drift(double dt) {
+    const size_t n = store_->size();
+    double* x = store_->x.data();
+    double* y = store_->y.data();
+    double* z = store_->z.data();
+    const double* vx = store_->vx.data();
+    const double* vy = store_->vy.data();
+    const double* vz = store_->vz.data();
+    for (size_t i = 0; i < n; ++i) {
+        x[i] += vx[i]*dt;
+        y[i] += vy[i]*dt;
+        z[i] += vz[i]*dt;
+    }
+}
+
+
+/**
+ *  @brief Sum the Coulomb force and energy of each replica directly over
+ *  its pairs, with the copy of the sum chosen for this processor.
+ */
+void Ensemble::update_coulomb() {
+    std::fill(fx_.begin(), fx_.end(), 0.0);
+    std::fill(fy_.begin(), fy_.end(), 0.0);
+    std::fill(fz_.begin(), fz_.end(), 0.0);
+    std::fill(energy_.begin(), energy_.end(), 0.0);
+    pairs_(*store_, replicas_.size(), fx_.data(), fy_.data(), fz_.data(),
+           energy_.data());
+}
+
+
+/**
+ *  @brief Copy the positions and velocities of each replica back to its
+ *  ion cloud, for the listeners.
+ */
+void Ensemble::scatter() {
+    const size_t n_rep = replicas_.size();
+    for (size_t r = 0; r < n_rep; ++r) {
+        IonStore& s = replicas_[r]->cloud->store_;
+        for (size_t i = 0; i < n_ions_; ++i) {
+            const size_t k = i*n_rep + r;
+            s.x[i] = store_->x[k];
+            s.y[i] = store_->y[k];
+            s.z[i] = store_->z[k];
+            s.vx[i] = store_->vx[k];
+            s.vy[i] = store_->vy[k];
+            s.vz[i] = store_->vz[k];
+        }
+    }
+}
@@ -0,0 +1,213 @@
+/**
+ * @file fft.cpp
+ * @brief Function definitions for a three dimensional complex FFT.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  @class FFT3D
+ *  @brief In-place complex FFT of a three dimensional array whose sides are
+ *  powers of two.
+ *
+ *  Each axis is transformed in turn by an iterative radix-2 Cooley-Tukey FFT
+ *  on one line at a time. Lines along the contiguous z axis are transformed
+ *  where they lie; lines along x and y are copied into a buffer a few
+ *  columns at a time. Lines are shared between OpenMP threads. Twiddle
+ *  factors and bit reversal tables are computed once on construction.
+ *
+ *  For zero-padded convolutions the forward transform can skip the lines
+ *  that are known to be zero, and the inverse transform the lines that are
+ *  not wanted, which saves more than half of the work.
+ */
+
+const int FFT3D::block_;
+
+/** @brief Construct an FFT for an nx by ny by nz array.
+ */
+FFT3D::FFT3D(int nx, int ny, int nz) {
+    n_[0] = nx;
+    n_[1] = ny;
+    n_[2] = nz;
+    const double pi = std::acos(-1.0);
+    for (int a = 0; a < 3; ++a) {
+        const int n = n_[a];
+        if (!is_power_of_two(n))
+            throw std::runtime_error("FFT size must be a power of two");
+        twiddle_[a].resize(n/2 + 1);
+        for (int k = 0; k <= n/2; ++k)
+            twiddle_[a][k] = std::polar(1.0, -2.0*pi*k/n);
+        reverse_[a].resize(n);
+        int bits = 0;
+        while ((1 << bits) < n)
+            ++bits;
+        for (int i = 0; i < n; ++i) {
+            int r = 0;
+            for (int b = 0; b < bits; ++b)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            reverse_[a][i] = r;
+        }
+    }
+}
+
+
+/** @brief Forward transform, sum_x f(x) exp(-2 pi i k.x/n).
+ *
+ *  @param data     Array to transform in place.
+ *  @param padded   Set if data is zero outside the lower half of every axis,
+ *                  so that lines known to be zero can be skipped.
+ */
+void FFT3D::forward(Complex* data, bool padded) const {
+    transform_z(data, padded ? n_[0]/2 : n_[0], padded ? n_[1]/2 : n_[1],
+                false);
+    transform_y(data, padded ? n_[0]/2 : n_[0], false);
+    transform_x(data, false);
+}
+
+
+/** @brief Inverse transform, including the factor 1/(nx ny nz).
+ *
+ *  @param data     Array to transform in place.
+ *  @param padded   Set if only the lower half of every axis of the result is
+ *                  wanted; the rest of the array is left undefined.
+ */
+void FFT3D::inverse(Complex* data, bool padded) const {
+    const int nx = padded ? n_[0]/2 : n_[0];
+    const int ny = padded ? n_[1]/2 : n_[1];
+    transform_x(data, true);
+    transform_y(data, nx, true);
+    transform_z(data, nx, ny, true);
+
+    const double scale = 1.0/points();
+    const long n = static_cast<long>(nx)*ny;
+    const int nz = n_[2];
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long l = 0; l < n; ++l) {
+        Complex* line = data + (l/ny*n_[1] + l%ny)*nz;
+        for (int k = 0; k < nz; ++k)
+            line[k] *= scale;
+    }
+}
+
+
+/** @brief Transform the contiguous lines along z for x < nx and y < ny.
+ */
+void FFT3D::transform_z(Complex* data, int nx, int ny, bool inverse) const {
+    const long n = static_cast<long>(nx)*ny;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (long l = 0; l < n; ++l)
+        transform_line(data + (l/ny*n_[1] + l%ny)*n_[2], 2, inverse);
+}
+
+
+/** @brief Transform the lines along y for x < nx.
+ *
+ *  A block of neighbouring z columns is copied out at once, so every read
+ *  uses whole cache lines.
+ */
+void FFT3D::transform_y(Complex* data, int nx, bool inverse) const {
+    const int ny = n_[1], nz = n_[2];
+    const int block = std::min(nz, block_);
+    const long n = static_cast<long>(nx)*(nz/block);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+{
+    std::vector<Complex> lines(static_cast<long>(block)*ny);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (long l = 0; l < n; ++l) {
+        Complex* start = data + l/(nz/block)*ny*nz + l%(nz/block)*block;
+        copy_lines(start, nz, ny, block, lines.data(), true);
+        for (int b = 0; b < block; ++b)
+            transform_line(&lines[static_cast<long>(b)*ny], 1, inverse);
+        copy_lines(start, nz, ny, block, lines.data(), false);
+    }
+}
+}
+
+
+/** @brief Transform all lines along x, a block of z columns at a time.
+ */
+void FFT3D::transform_x(Complex* data, bool inverse) const {
+    const int nx = n_[0], ny = n_[1], nz = n_[2];
+    const int block = std::min(nz, block_);
+    const long n = static_cast<long>(ny)*(nz/block);
+    const long stride = static_cast<long>(ny)*nz;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+{
+    std::vector<Complex> lines(static_cast<long>(block)*nx);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (long l = 0; l < n; ++l) {
+        Complex* start = data + l/(nz/block)*nz + l%(nz/block)*block;
+        copy_lines(start, stride, nx, block, lines.data(), true);
+        for (int b = 0; b < block; ++b)
+            transform_line(&lines[static_cast<long>(b)*nx], 0, inverse);
+        copy_lines(start, stride, nx, block, lines.data(), false);
+    }
+}
+}
+
+
+/** @brief Copy block columns of length n and the given stride to or from
+ *  contiguous lines.
+ */
+void FFT3D::copy_lines(Complex* start, long stride, int n, int block,
+                       Complex* lines, bool out) {
+    for (int i = 0; i < n; ++i) {
+        Complex* row = start + i*stride;
+        for (int b = 0; b < block; ++b) {
+            if (out)
+                lines[static_cast<long>(b)*n + i] = row[b];
+            else
+                row[b] = lines[static_cast<long>(b)*n + i];
+        }
+    }
+}
+
+
+/** @brief Transform one contiguous line of length n_[a].
+ */
+void FFT3D::transform_line(Complex* line, int a, bool inverse) const {
+    const int n = n_[a];
+    const std::vector<int>& rev = reverse_[a];
+    const std::vector<Complex>& tw = twiddle_[a];
+    for (int i = 0; i < n; ++i) {
+        if (i < rev[i])
+            std::swap(line[i], line[rev[i]]);
+    }
+    for (int len = 2; len <= n; len *= 2) {
+        const int half = len/2;
+        const int step = n/len;
+        for (int i = 0; i < n; i += len) {
+            for (int j = 0; j < half; ++j) {
+                Complex w = inverse ? std::conj(tw[j*step]) : tw[j*step];
+                Complex u = line[i + j];
+                Complex v = line[i + j + half]*w;
+                line[i + j] = u + v;
+                line[i + j + half] = u - v;
+            }
+        }
+    }
+}
@@ -0,0 +1,371 @@
+/**
+ * @file fmm.cpp
+ * @brief Function definitions for the fast multipole method for the Coulomb
+ * force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/fmm.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  @class FastMultipole
+ *  @brief Coulomb force on every ion by the fast multipole method, in O(N)
+ *  time.
+ *
+ *  Expansions are in scaled solid harmonics, as used by Dehnen (2014):
+ *
+ *      R_n^m(r) = r^n P_n^m(cos t) e^{i m p} / (n+m)!
+ *      I_n^m(r) = (n-m)! P_n^m(cos t) e^{i m p} / r^{n+1}
+ *
+ *  with which 1/|x - y| = sum_{n,m} conj(R_n^m(y)) I_n^m(x) for |y| < |x|,
+ *  and every translation is a plain convolution of coefficients. Both are
+ *  generated by recurrences in the Cartesian components, with no
+ *  trigonometric functions. Expansions run to degree `simulation.fmmorder`,
+ *  and the error falls roughly as theta^(order+1).
+ *
+ *  Each call rebuilds the Octree and then
+ *  - forms the multipole expansion of every leaf from its ions, and of every
+ *    larger cell from its children, about the cell centre (P2M, M2M);
+ *  - walks pairs of cells from the root (a dual tree walk). A pair whose
+ *    radii sum to less than theta times their separation contributes a
+ *    multipole to local translation (M2L), unless the cells hold so few ions
+ *    that summing them directly is cheaper. Neighbouring leaves are summed
+ *    directly with the CoulombKernel; otherwise the larger cell is split;
+ *  - passes local expansions down the tree and evaluates the field at each
+ *    ion from its leaf's expansion (L2L, L2P).
+ *
+ *  The walk is shared between threads by target subtree, so each thread
+ *  writes only to the cells and ions of its own subtrees and the result does
+ *  not depend on the number of threads.
+ */
+
+const long FastMultipole::leaf_size_;
+const int FastMultipole::min_tasks_;
+
+namespace {
+
+/** @brief Position of coefficient (n, m) in an expansion.
+ */
+inline int coeff(int n, int m) { return n*n + n + m; }
+
+/** @brief Scaled regular solid harmonics R_n^m(x, y, z) for n <= p.
+ */
+void regular(int p, double x, double y, double z, std::complex<double>* r) {
+    const double r2 = x*x + y*y + z*z;
+    const std::complex<double> w(x, y);
+    r[0] = 1.0;
+    for (int n = 1; n <= p; ++n)
+        r[coeff(n, n)] = r[coeff(n-1, n-1)]*w/(2.0*n);
+    for (int m = 0; m < p; ++m) {
+        r[coeff(m+1, m)] = z*r[coeff(m, m)];
+        for (int n = m+2; n <= p; ++n)
+            r[coeff(n, m)] = ((2*n - 1)*z*r[coeff(n-1, m)]
+                              - r2*r[coeff(n-2, m)])/double((n + m)*(n - m));
+    }
+    for (int n = 1; n <= p; ++n) {
+        for (int m = 1; m <= n; ++m) {
+            std::complex<double> c = std::conj(r[coeff(n, m)]);
+            r[coeff(n, -m)] = m & 1 ? -c : c;
+        }
+    }
+}
+
+/** @brief Scaled irregular solid harmonics I_n^m(x, y, z) for n <= p.
+ */
+void irregular(int p, double x, double y, double z, std::complex<double>* s) {
+    const double inv_r2 = 1.0/(x*x + y*y + z*z);
+    const std::complex<double> w(x, y);
+    s[0] = std::sqrt(inv_r2);
+    for (int n = 1; n <= p; ++n)
+        s[coeff(n, n)] = s[coeff(n-1, n-1)]*w*((2*n - 1)*inv_r2);
+    for (int m = 0; m < p; ++m) {
+        s[coeff(m+1, m)] = (2*m + 1)*z*inv_r2*s[coeff(m, m)];
+        for (int n = m+2; n <= p; ++n)
+            s[coeff(n, m)] = ((2*n - 1)*z*s[coeff(n-1, m)]
+                              - double((n-1)*(n-1) - m*m)*s[coeff(n-2, m)])
+                             *inv_r2;
+    }
+    for (int n = 1; n <= p; ++n) {
+        for (int m = 1; m <= n; ++m) {
+            std::complex<double> c = std::conj(s[coeff(n, m)]);
+            s[coeff(n, -m)] = m & 1 ? -c : c;
+        }
+    }
+}
+
+}  // namespace
+
+/** @brief Construct a fast multipole solver using the simulation parameters.
+ *
+ *  @param sp       Simulation parameters; uses fmm_order and tree_theta.
+ *  @param kernel   Direct sum used for neighbouring leaves.
+ */
+FastMultipole::FastMultipole(const SimParams& sp, const CoulombKernel& kernel)
+    : kernel_(kernel), order_(sp.fmm_order),
+      n_coeffs_((sp.fmm_order + 1)*(sp.fmm_order + 1)),
+      theta_(sp.tree_theta), direct_pairs_(4*n_coeffs_), tree_(leaf_size_) {}
+
+
+/** @brief Calculate the Coulomb force on every ion.
+ *
+ *  @param store    Positions and charges of the ions.
+ *  @param force    Set to the force on each ion, in IonStore order.
+ */
+void FastMultipole::compute(const IonStore& store,
+                            std::vector<Vector3D>& force) {
+    tree_.build(store);
+    const std::vector<Octree::Node>& nodes = tree_.nodes();
+    const int n_nodes = nodes.size();
+    const int levels = tree_.levels();
+    const long n = store.size();
+
+    bmax_.resize(n_nodes);
+    multipole_.assign(n_nodes*n_coeffs_, Complex());
+    local_.assign(n_nodes*n_coeffs_, Complex());
+    field_.assign(n, Vector3D());
+    force.resize(n);
+
+    // Targets for the walk: every cell of the first level with enough cells
+    // to share out, and any leaf above it.
+    task_.clear();
+    int task_level = 0;
+    while (task_level < levels - 1 &&
+           tree_.level_start(task_level + 1) - tree_.level_start(task_level)
+               < min_tasks_)
+        ++task_level;
+    for (int k = 0; k < n_nodes && nodes[k].level <= task_level; ++k) {
+        if (nodes[k].level == task_level || nodes[k].is_leaf())
+            task_.push_back(k);
+    }
+    const int n_tasks = task_.size();
+
+#ifdef _OPENMP
+#pragma omp parallel
+{
+#endif
+    std::vector<Complex> work(2*n_coeffs_);
+
+    for (int l = levels - 1; l >= 0; --l) {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int k = tree_.level_start(l); k < tree_.level_start(l + 1); ++k)
+            upward(k, work);
+    }
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int i = 0; i < n_tasks; ++i)
+        interact(task_[i], 0, work);
+
+    for (int l = 0; l < levels; ++l) {
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int k = tree_.level_start(l); k < tree_.level_start(l + 1); ++k)
+            downward(k, work);
+    }
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (long t = 0; t < n; ++t)
+        force[tree_.order[t]] = field_[t]*tree_.q[t];
+#ifdef _OPENMP
+}
+#endif
+}
+
+
+/** @brief Radius and multipole expansion of cell k.
+ *
+ *  A leaf is expanded from its ions (P2M), a larger cell by translating the
+ *  expansions of its children to its centre (M2M).
+ */
+void FastMultipole::upward(int k, std::vector<Complex>& work) {
+    const Octree::Node& node = tree_.nodes()[k];
+    Complex* m = multipole(k);
+    Complex* r = work.data();
+
+    double b2 = 0.0;
+    for (long i = node.begin; i < node.end; ++i) {
+        double dx = tree_.x[i] - node.cx;
+        double dy = tree_.y[i] - node.cy;
+        double dz = tree_.z[i] - node.cz;
+        b2 = std::max(b2, dx*dx + dy*dy + dz*dz);
+    }
+    bmax_[k] = std::sqrt(b2);
+
+    if (node.is_leaf()) {
+        for (long i = node.begin; i < node.end; ++i) {
+            regular(order_, tree_.x[i] - node.cx, tree_.y[i] - node.cy,
+                    tree_.z[i] - node.cz, r);
+            for (int j = 0; j < n_coeffs_; ++j)
+                m[j] += tree_.q[i]*std::conj(r[j]);
+        }
+        return;
+    }
+
+    const int c_end = node.first_child + node.n_children;
+    for (int c = node.first_child; c < c_end; ++c) {
+        const Octree::Node& child = tree_.nodes()[c];
+        const Complex* mc = multipole(c);
+        regular(order_, child.cx - node.cx, child.cy - node.cy,
+                child.cz - node.cz, r);
+        for (int n = 0; n <= order_; ++n) {
+            for (int mm = -n; mm <= n; ++mm) {
+                Complex s;
+                for (int j = 0; j <= n; ++j) {
+                    int l0 = std::max(-j, mm - (n - j));
+                    int l1 = std::min(j, mm + (n - j));
+                    for (int l = l0; l <= l1; ++l)
+                        s += std::conj(r[coeff(j, l)])*mc[coeff(n-j, mm-l)];
+                }
+                m[coeff(n, mm)] += s;
+            }
+        }
+    }
+}
+
+
+/** @brief Dual tree walk for target cell t and source cell s.
+ */
+void FastMultipole::interact(int t, int s, std::vector<Complex>& work) {
+    const Octree::Node& a = tree_.nodes()[t];
+    const Octree::Node& b = tree_.nodes()[s];
+    double dx = a.cx - b.cx;
+    double dy = a.cy - b.cy;
+    double dz = a.cz - b.cz;
+    double d = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+    if (theta_*d > bmax_[t] + bmax_[s]) {
+        // Pairs of small cells are cheaper to sum directly.
+        if ((a.end - a.begin)*(b.end - b.begin) < direct_pairs_)
+            direct(t, s);
+        else
+            multipole_to_local(t, s, work);
+    } else if (a.is_leaf() && b.is_leaf()) {
+        direct(t, s);
+    } else if (b.is_leaf() || (!a.is_leaf() && bmax_[t] >= bmax_[s])) {
+        const int c_end = a.first_child + a.n_children;
+        for (int c = a.first_child; c < c_end; ++c)
+            interact(c, s, work);
+    } else {
+        const int c_end = b.first_child + b.n_children;
+        for (int c = b.first_child; c < c_end; ++c)
+            interact(t, c, work);
+    }
+}
+
+
+/** @brief Add the multipole expansion of cell s to the local expansion of
+ *  cell t (M2L).
+ */
+void FastMultipole::multipole_to_local(int t, int s,
+                                       std::vector<Complex>& work) {
+    const Octree::Node& a = tree_.nodes()[t];
+    const Octree::Node& b = tree_.nodes()[s];
+    const Complex* m = multipole(s);
+    Complex* loc = local(t);
+    Complex* irr = work.data();
+    irregular(order_, a.cx - b.cx, a.cy - b.cy, a.cz - b.cz, irr);
+
+    // Only m >= 0 is summed; L_n^-m = (-1)^m conj(L_n^m) gives the rest.
+    for (int n = 0; n <= order_; ++n) {
+        for (int mm = 0; mm <= n; ++mm) {
+            double re = 0.0, im = 0.0;
+            for (int j = 0; j <= order_ - n; ++j) {
+                const Complex* mj = m + coeff(j, 0);
+                const Complex* ij = irr + coeff(n+j, mm);
+                for (int l = -j; l <= j; ++l) {
+                    re += mj[l].real()*ij[l].real() - mj[l].imag()*ij[l].imag();
+                    im += mj[l].real()*ij[l].imag() + mj[l].imag()*ij[l].real();
+                }
+            }
+            Complex sum = n & 1 ? Complex(-re, -im) : Complex(re, im);
+            loc[coeff(n, mm)] += sum;
+            if (mm > 0)
+                loc[coeff(n, -mm)] += mm & 1 ? -std::conj(sum) : std::conj(sum);
+        }
+    }
+}
+
+
+/** @brief Add the field from the ions of leaf s to the ions of leaf t.
+ */
+void FastMultipole::direct(int t, int s) {
+    const Octree::Node& a = tree_.nodes()[t];
+    const Octree::Node& b = tree_.nodes()[s];
+    for (long i = a.begin; i < a.end; ++i) {
+        Vector3D ri(tree_.x[i], tree_.y[i], tree_.z[i]);
+        field_[i] += kernel_.row(tree_.x.data(), tree_.y.data(),
+                                 tree_.z.data(), tree_.q.data(), ri,
+                                 b.begin, b.end);
+    }
+}
+
+
+/** @brief Pass the local expansion of cell k down the tree.
+ *
+ *  A larger cell translates its expansion to the centre of each child (L2L).
+ *  A leaf evaluates the field, minus the gradient of its expansion, at each
+ *  of its ions (L2P).
+ */
+void FastMultipole::downward(int k, std::vector<Complex>& work) {
+    const Octree::Node& node = tree_.nodes()[k];
+    const Complex* loc = local(k);
+    Complex* r = work.data();
+
+    if (!node.is_leaf()) {
+        const int c_end = node.first_child + node.n_children;
+        for (int c = node.first_child; c < c_end; ++c) {
+            const Octree::Node& child = tree_.nodes()[c];
+            Complex* lc = local(c);
+            regular(order_, child.cx - node.cx, child.cy - node.cy,
+                    child.cz - node.cz, r);
+            for (int n = 0; n <= order_; ++n) {
+                for (int mm = -n; mm <= n; ++mm) {
+                    Complex s;
+                    for (int j = 0; j <= order_ - n; ++j) {
+                        for (int l = -j; l <= j; ++l)
+                            s += loc[coeff(n+j, mm+l)]
+                                 *std::conj(r[coeff(j, l)]);
+                    }
+                    lc[coeff(n, mm)] += s;
+                }
+            }
+        }
+        return;
+    }
+
+    // d/dz conj(R_n^m) = conj(R_{n-1}^m), and (d/dx -/+ i d/dy) give
+    // conj(R_{n-1}^{m+1}) and -conj(R_{n-1}^{m-1}).
+    for (long i = node.begin; i < node.end; ++i) {
+        regular(order_ - 1, tree_.x[i] - node.cx, tree_.y[i] - node.cy,
+                tree_.z[i] - node.cz, r);
+        Complex gx, gy, gz;
+        for (int n = 1; n <= order_; ++n) {
+            for (int mm = -n; mm <= n; ++mm) {
+                const Complex& c = loc[coeff(n, mm)];
+                Complex lo = mm - 1 >= -(n-1) ? std::conj(r[coeff(n-1, mm-1)])
+                                              : Complex();
+                Complex hi = mm + 1 <= n-1 ? std::conj(r[coeff(n-1, mm+1)])
+                                           : Complex();
+                gx += c*(lo - hi);
+                gy += c*(lo + hi);
+                if (mm > -n && mm < n)
+                    gz += c*std::conj(r[coeff(n-1, mm)]);
+            }
+        }
+        field_[i] += Vector3D(-0.5*gx.real(), -0.5*gy.imag(), -gz.real());
+    }
+}
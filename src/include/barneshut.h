@@ -0,0 +1,54 @@
+/** @file barneshut.h
+ *
+ * @brief Declaration of the Barnes-Hut tree code for the Coulomb force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_BARNESHUT_H_
+#define INCLUDE_BARNESHUT_H_
+
+#include <vector>
+
+#include "ccmdsim.h"
+#include "coulombkernel.h"
+#include "ionstore.h"
+#include "octree.h"
+#include "vector3D.h"
+
+class BarnesHut {
+ public:
+    BarnesHut(const SimParams& sp, const CoulombKernel& kernel);
+
+    void compute(const IonStore& store, std::vector<Vector3D>& force);
+
+    BarnesHut(const BarnesHut&) = delete;
+    BarnesHut& operator=(const BarnesHut&) = delete;
+
+ private:
+    /// Multipole moments of one cell about its centre of charge.
+    struct Moments {
+        double cx, cy, cz;   ///< Expansion centre.
+        double bmax;         ///< Distance from centre to furthest ion.
+        double abs_q;        ///< Sum of |q|, weights the centre.
+        double q;            ///< Total charge.
+        double px, py, pz;   ///< Dipole moment.
+        /// Traceless quadrupole sum q(3 r_a r_b - r^2 delta_ab).
+        double qxx, qyy, qzz, qxy, qxz, qyz;
+    };
+
+    void leaf_moments(const Octree::Node& node, Moments& m) const;
+    void merge_moments(const Octree::Node& node, Moments& m) const;
+    Vector3D field(long t) const;
+
+    const CoulombKernel& kernel_;   ///< Direct sum for ions in nearby leaves.
+    const double theta2_;           ///< Square of the opening angle.
+    Octree tree_;                   ///< Tree, rebuilt on every call.
+    std::vector<Moments> moments_;  ///< Moments of each node of tree_.
+
+    /// Most ions in a leaf of the tree.
+    static const long leaf_size_ = 16;
+};
+
+#endif  // INCLUDE_BARNESHUT_H_
@@ -69,8 +69,47 @@ class IntegrationParams {
 
     /// Number of RESPA inner loop steps between Coulomb force updates
     int respa_steps;
+
+    /// Available integrators.
+    enum Method {verlet, respa, split, transfer,
+                 forestruth, yoshida6, blanesmoan};
+    Method method;           ///< Integrator to use. Default verlet.
+    /** Distance beyond which the split integrator treats the Coulomb force as
+     far field. Default 4. */
+    double split_radius;
+    /** Steps between far field updates of the split integrator. Default 4. */
+    int far_steps;
+    /** Extra distance in the near field neighbour list of the split
+     integrator. Default 1. */
+    double skin;
+    /// Trap force during the cooling stage.
+    enum CoolingModel {rf, pseudopotential};
+    CoolingModel cooling_model;   ///< Default rf, the full RF trap.
+    /** Time steps in 1 RF period during the cooling stage; the same as
+     steps_per_period unless cooling in the pseudopotential. */
+    int cool_steps_per_period;
+    double cool_time_step;   ///< Time interval during the cooling stage.
     int cool_steps;          ///< Number of timesteps for cooling stage.
     int hist_steps;          ///< Number of steps to collect statistics.
+    /** RF periods between checkpoints of the run; 0, the default, for
+     none. */
+    double checkpoint_periods;
+    /// Tests of the cooling energy that may end the cooling stage early.
+    enum Convergence {fixed, plateau, slope};
+    Convergence convergence;    ///< Default fixed, always take cool_steps.
+    /** RF periods in each window of the convergence test. Default 50. */
+    int convergence_window;
+    /** Relative change of the energy taken as converged. Default 0.02. */
+    double convergence_tolerance;
+    /** Fewest cooling steps before the convergence test can end the
+     stage. */
+    int min_cool_steps;
+    /** Most steps of the energy minimisation of the starting ions; 0, the
+     default, for none. */
+    int relax_steps;
+    /** RMS force, relative to the RMS Coulomb force, at which the
+     minimisation stops. Default 1e-4. */
+    double relax_tolerance;
 
     IntegrationParams(const IntegrationParams&) = delete;
     const IntegrationParams& operator=(const IntegrationParams&) = delete;
@@ -110,6 +149,9 @@ class CloudParams {
 
     /// List to hold an IonType for each ion type used.
     std::list<IonType> ion_type_list;
+    /** Snapshot file or working directory of an earlier run to take the
+     starting ions from; empty, the default, for the cubic lattice. */
+    std::string start_from;
 };
 
 /*
@@ -148,11 +190,41 @@ class SimParams {
  public:
     explicit SimParams(const std::string& file_name);
 
-    /** Number of threads to use in CoulombForce calculation. Default 0. */
+    /// Instruction sets for the direct-sum Coulomb kernel.
+    enum Kernel {automatic, scalar, sse2, avx2, avx512};
+    /// Methods for calculating the Coulomb force.
+    enum Method {direct, tree, fmm, p3m};
+    /// Arithmetic of the direct-sum Coulomb kernel.
+    enum Precision {full, single, rsqrt};
+
+    /** Number of threads to use in CoulombForce calculation. Greater than
+     zero calculates the force in a background thread. Default 0. */
     int coulomb_threads;
     /** Seed for random number generator used by stochastic_heat. -1 chooses
      seed from system clock and will be different for every run. Default -1. */
     int random_seed;
+    /** Instruction set used for the Coulomb force sum. Default automatic,
+     which picks the widest supported by the processor. */
+    Kernel coulomb_kernel;
+    /** Arithmetic of the pair terms in the Coulomb kernel. Default full,
+     double precision throughout. */
+    Precision coulomb_precision;
+    /** Method used for the Coulomb force. Default direct, the exact sum over
+     all pairs. */
+    Method coulomb_method;
+    /** Opening angle of the Barnes-Hut tree: a cell is used whole when its
+     size is less than theta times its distance. The fast multipole method
+     uses it for pairs of cells. Default 0.5. */
+    double tree_theta;
+    /** Highest degree of the multipole and local expansions of the fast
+     multipole method. Default 6. */
+    int fmm_order;
+    /** Mesh points along the longest side of the cloud for the P3M method,
+     a power of two. Default 0, which sizes the mesh from the number of
+     ions. */
+    int p3m_mesh;
+    /** Short-range cutoff of the P3M method in mesh spacings. Default 4. */
+    double p3m_cutoff;
 
  private:
     SimParams(const SimParams& ) = delete;
@@ -169,6 +241,9 @@ class LaserParams {
 	float delta;
 	// I/Isat
 	float IdIsat;
+    /// Ways of applying the photon scattering of laser cooled ions.
+    enum Scattering {stepped, events};
+    Scattering scattering;   ///< Default stepped.
 	
 	private:
     LaserParams(const LaserParams& ) = delete;
@@ -0,0 +1,125 @@
+/**
+ * @file checkpoint.h
+ * @brief Class declarations for writing and reading binary checkpoints.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_CHECKPOINT_H_
+#define INCLUDE_CHECKPOINT_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ionstore.h"
+#include "vector3D.h"
+
+class IntegrationParams;
+class Integrator;
+class IonCloud;
+class IonTrap;
+class SimParams;
+
+/**
+ *  @class CheckpointWriter
+ *  @brief Writes numbers and arrays to a binary checkpoint file, in the byte
+ *  order of the machine.
+ */
+class CheckpointWriter {
+ public:
+    explicit CheckpointWriter(const std::string& file_name);
+
+    void write(std::int64_t i);
+    void write(double d);
+    void write(const Vector3D& v);
+    void write(const std::string& s);
+    void write(const AlignedVector& a);
+    void write(const std::vector<double>& a);
+    void write(const std::vector<Vector3D>& a);
+    void close();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    const CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+ private:
+    void write_bytes(const void* p, size_t n);
+
+    std::string file_name_;
+    std::ofstream stream_;
+};
+
+/**
+ *  @class CheckpointReader
+ *  @brief Reads back what a CheckpointWriter wrote, in the same order.
+ *
+ *  A short or failed read throws a std::runtime_error.
+ */
+class CheckpointReader {
+ public:
+    explicit CheckpointReader(const std::string& file_name);
+
+    std::int64_t read_int();
+    double read_double();
+    Vector3D read_vector();
+    std::string read_string();
+    void read(AlignedVector& a);
+    void read(std::vector<double>& a);
+    void read(std::vector<Vector3D>& a);
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    const CheckpointReader& operator=(const CheckpointReader&) = delete;
+ private:
+    void read_bytes(void* p, size_t n);
+
+    std::string file_name_;
+    std::ifstream stream_;
+};
+
+/**
+ *  @class Checkpoint
+ *  @brief The state of a single run saved to, and restored from, the file
+ *  \c checkpoint.bin in the working directory.
+ */
+class Checkpoint {
+ public:
+    /// Stages of a run.
+    enum Stage {cooling, histogram};
+    /// Where the run had got to, and the sums taken so far.
+    struct Progress {
+        Stage stage;        ///< Stage the run was in.
+        int step;           ///< Steps completed in that stage.
+        double ke_sum;      ///< Sum of the kinetic energy over the histogram.
+        double etot_sum;    ///< Sum of the total energy over the histogram.
+        /// MeanEnergyListener::state of the cooling convergence test.
+        std::vector<double> cool_state;
+    };
+
+    Checkpoint(const std::string& path, const IntegrationParams& params,
+               const SimParams& sp);
+
+    bool exists() const;
+    void save(const Progress& progress, const IonTrap& trap,
+              const IonCloud& cloud, Integrator& integrator) const;
+    Progress load(IonTrap& trap, IonCloud& cloud);
+    void load_integrator(Integrator& integrator);
+    void remove() const;
+
+    Checkpoint(const Checkpoint&) = delete;
+    const Checkpoint& operator=(const Checkpoint&) = delete;
+ private:
+    void check_params(CheckpointReader& reader, size_t n_ions) const;
+
+    const std::string file_name_;
+    const IntegrationParams& params_;
+    const SimParams& sim_params_;   ///< For the Coulomb method.
+    /// Open between load and load_integrator.
+    std::unique_ptr<CheckpointReader> reader_;
+
+    static const std::int64_t magic_;
+    static const std::int64_t version_;
+};
+
+#endif  // INCLUDE_CHECKPOINT_H_
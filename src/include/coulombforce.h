@@ -9,31 +9,77 @@
 #ifndef INCLUDE_COULOMBFORCE_H_
 #define INCLUDE_COULOMBFORCE_H_
 
+#include <condition_variable>
+#include <exception>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
+#include "barneshut.h"
+#include "coulombkernel.h"
+#include "fmm.h"
+#include "particlemesh.h"
 #include "vector3D.h"
 #include "ioncloud.h"
 
 class IonCloud;
+class CheckpointReader;
+class CheckpointWriter;
 
 class CoulombForce {
  public:
     CoulombForce(const IonCloud_ptr ic, const SimParams& sp);
+    ~CoulombForce();
     const std::vector<Vector3D>& get_force();
+    void save_state(CheckpointWriter& writer);
+    void load_state(CheckpointReader& reader);
+    double get_energy();
+    void calculate_energy(bool on);
+    double pair_energy(const IonStore& store) const;
     void update();
 
     CoulombForce( const CoulombForce & other ) = delete;
     CoulombForce& operator=( const CoulombForce& ) = delete;
-    Vector3D Reduction(Vector3D x[], int len);
  private:
-    void direct_force();
-    void split_force(int n);
+    void compute(const IonStore& store);
+    void direct_force(const IonStore& store);
+    void vector_force(const IonStore& store);
+    void make_chunks(long n);
+    void work();
+    void wait();
 
     const IonCloud_ptr cloud_;   ///< Pointer to IonCloud.
     const SimParams& params_;  ///< Simulation parameters; uses coulomb_threads.
+    CoulombKernel kernel_;     ///< Vectorised pair sum chosen at start-up.
+    std::unique_ptr<BarnesHut> tree_;  ///< Tree code, if selected.
+    std::unique_ptr<FastMultipole> fmm_;  ///< Fast multipole, if selected.
+    std::unique_ptr<ParticleMesh> p3m_;   ///< P3M solver, if selected.
     std::vector<Vector3D> force_;   ///< Vector of forces when completed.
+    double energy_;          ///< Coulomb energy of the ions, if known.
+    bool energy_known_;      ///< energy_ is for the last update.
+    bool energy_wanted_;     ///< Calculate the energy for the other methods.
+
+    /// Largest number of chunks the half-pair sum is split into.
+    static const long max_chunks_ = 64;
+    /// Fewest rows in each chunk of the half-pair sum.
+    static const long min_chunk_rows_ = 32;
+    /// Rows swept together over each source tile.
+    static const long block_rows_ = 32;
+    /// Sources in each tile; positions, charges and reactions fit in L1.
+    static const long tile_size_ = 256;
+    std::vector<long> chunk_start_;  ///< First row of each chunk, then n.
+    AlignedVector accum_;   ///< Force buffer for each chunk, [chunk][xyz][ion].
+    std::vector<double> chunk_energy_;  ///< Coulomb energy of each chunk.
+
+    std::unique_ptr<IonStore> snapshot_;  ///< Positions for the worker.
+    std::thread worker_;    ///< Calculates the force, if threads > 0.
+    std::mutex mutex_;      ///< Guards busy_, stop_ and error_.
+    std::condition_variable wake_;  ///< Signals a new snapshot or stop.
+    std::condition_variable done_;  ///< Signals the force is ready.
+    bool busy_;             ///< The worker has a snapshot to process.
+    bool stop_;             ///< The worker should exit.
+    std::exception_ptr error_;  ///< Exception thrown by the worker.
 };
 
 #endif  // INCLUDE_COULOMBFORCE_H_
@@ -0,0 +1,78 @@
+/** @file coulombkernel.h
+ *
+ * @brief Declaration of vectorised direct-sum Coulomb kernels.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_COULOMBKERNEL_H_
+#define INCLUDE_COULOMBKERNEL_H_
+
+#include <cstddef>
+#include <string>
+
+#include "ccmdsim.h"
+#include "ionstore.h"
+#include "vector3D.h"
+
+class CoulombKernel {
+ public:
+    CoulombKernel(SimParams::Kernel requested,
+                  SimParams::Precision precision);
+
+    /** @brief Sum the field at `ri` from the charges in `[begin, end)`.
+     *
+     * Returns the sum of q_j (r_i - r_j)/|r_i - r_j|^3, skipping any source
+     * at exactly the same position (including the ion itself).
+     */
+    Vector3D row(const double* x, const double* y, const double* z,
+                 const double* q, const Vector3D& ri,
+                 size_t begin, size_t end) const {
+        return row_(x, y, z, q, ri, begin, end);
+    }
+
+    /** @brief Sum the field at `ri` and apply the reaction to each source.
+     *
+     * As row, but for each source j also subtracts the force on ion i,
+     * qi q_j (r_i - r_j)/|r_i - r_j|^3, from the reaction arrays at j, and
+     * adds the potential of the sources, the sum of q_j/|r_i - r_j|, to
+     * `*phi`.
+     */
+    Vector3D pair(const double* x, const double* y, const double* z,
+                  const double* q, const Vector3D& ri, double qi,
+                  size_t begin, size_t end,
+                  double* rx, double* ry, double* rz, double* phi) const {
+        return pair_(x, y, z, q, ri, qi, begin, end, rx, ry, rz, phi);
+    }
+
+    SimParams::Kernel isa() const { return isa_; }
+    SimParams::Precision precision() const { return precision_; }
+    std::string name() const;
+    void report_error(const IonStore& store) const;
+
+    static SimParams::Kernel detect();
+    static bool supported(SimParams::Kernel isa);
+
+    CoulombKernel(const CoulombKernel&) = delete;
+    CoulombKernel& operator=(const CoulombKernel&) = delete;
+
+ private:
+    typedef Vector3D (*RowFunction)(const double*, const double*,
+                                    const double*, const double*,
+                                    const Vector3D&, size_t, size_t);
+    typedef Vector3D (*PairFunction)(const double*, const double*,
+                                     const double*, const double*,
+                                     const Vector3D&, double, size_t, size_t,
+                                     double*, double*, double*, double*);
+    SimParams::Kernel isa_;   ///< Instruction set in use.
+    SimParams::Precision precision_;  ///< Arithmetic of the pair terms.
+    RowFunction row_;         ///< Row sum for this instruction set.
+    PairFunction pair_;       ///< Half-pair sum for this instruction set.
+    RowFunction exact_row_;   ///< Double precision row sum, for checks.
+
+    /// Most ions sampled by report_error.
+    static const size_t report_ions_ = 500;
+};
+
+#endif  // INCLUDE_COULOMBKERNEL_H_
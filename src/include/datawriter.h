@@ -23,6 +23,8 @@ class DataWriter {
              const std::list<double>& rowData);
      void writeComment(const std::string& fileName,
              const std::string& commentText);
+     void keepRows(const std::string& fileName, int rows);
+     void flush();
 
      DataWriter(const DataWriter&) = delete;
      const DataWriter& operator=(const DataWriter&) = delete;
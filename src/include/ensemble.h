@@ -0,0 +1,90 @@
+/**
+ * @file ensemble.h
+ * @brief Class declarations for an ensemble of replica simulations advanced
+ * together.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_ENSEMBLE_H_
+#define INCLUDE_ENSEMBLE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ccmdsim.h"
+#include "integratorlistener.h"
+#include "ioncloud.h"
+#include "ionstore.h"
+#include "iontrap.h"
+
+/**
+ *  @class Replica
+ *  @brief The parameters, trap and ion cloud of one point of an ensemble,
+ *  loaded from the \c trap.info in its working directory.
+ */
+class Replica {
+ public:
+    Replica(const std::string& path, int default_seed);
+
+    const std::string path;    ///< Working directory, ending in a '/'.
+    TrapParams trap_params;
+    CloudParams cloud_params;
+    IntegrationParams integration_params;
+    MicroscopeParams microscope_params;
+    SimParams sim_params;
+    LaserParams laser_params;
+    IonTrap_ptr trap;
+    IonCloud_ptr cloud;
+    std::vector<IntegratorListener_ptr> listeners;
+
+    Replica(const Replica&) = delete;
+    const Replica& operator=(const Replica&) = delete;
+};
+typedef std::unique_ptr<Replica> Replica_ptr;
+
+//
+// Velocity Verlet integration of several replicas of the same cloud at once,
+// with their ion data interleaved so the loops vectorise across replicas.
+//
+class Ensemble {
+ public:
+    explicit Ensemble(const std::vector<std::string>& paths);
+
+    void evolve(double dt);
+
+    size_t size() const { return replicas_.size(); }
+    Replica& replica(size_t r) { return *replicas_[r]; }
+    double coulomb_energy(size_t r) const { return energy_[r]; }
+
+    void registerListener(size_t r, const IntegratorListener_ptr& l);
+    void deregisterListener(size_t r, const IntegratorListener_ptr& l);
+
+    Ensemble(const Ensemble&) = delete;
+    const Ensemble& operator=(const Ensemble&) = delete;
+ private:
+    void check_replicas() const;
+    void kick(double dt);
+    void drift(double dt);
+    void update_coulomb();
+    void scatter();
+    void notifyListeners(const int i) const;
+
+    typedef void (*PairFunction)(const IonStore&, size_t,
+                                 double*, double*, double*, double*);
+
+    std::vector<Replica_ptr> replicas_;
+    size_t n_ions_;     ///< Number of ions in each replica.
+    /** Ion i of replica r is at index i*size() + r. */
+    std::unique_ptr<IonStore> store_;
+    AlignedVector fx_, fy_, fz_;   ///< Coulomb force on each ion.
+    std::vector<double> energy_;   ///< Coulomb energy of each replica.
+    AlignedVector cx_, cy_, cz_;   ///< Trap force coefficients of each replica.
+    std::vector<size_t> cooled_;   ///< Ions that are laser cooled.
+    PairFunction pairs_;           ///< Coulomb sum for this instruction set.
+    int n_iter_;
+};
+
+#endif  // INCLUDE_ENSEMBLE_H_
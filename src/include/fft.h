@@ -0,0 +1,47 @@
+/** @file fft.h
+ *
+ * @brief Declaration of a three dimensional complex FFT.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_FFT_H_
+#define INCLUDE_FFT_H_
+
+#include <complex>
+#include <vector>
+
+class FFT3D {
+ public:
+    typedef std::complex<double> Complex;
+
+    FFT3D(int nx, int ny, int nz);
+
+    void forward(Complex* data, bool padded = false) const;
+    void inverse(Complex* data, bool padded = false) const;
+
+    /// Number of points along axis a; the data is indexed [x][y][z].
+    int size(int a) const { return n_[a]; }
+    /// Total number of points.
+    long points() const { return static_cast<long>(n_[0])*n_[1]*n_[2]; }
+
+    static bool is_power_of_two(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+ private:
+    void transform_z(Complex* data, int nx, int ny, bool inverse) const;
+    void transform_y(Complex* data, int nx, bool inverse) const;
+    void transform_x(Complex* data, bool inverse) const;
+    void transform_line(Complex* line, int a, bool inverse) const;
+    static void copy_lines(Complex* start, long stride, int n, int block,
+                           Complex* lines, bool out);
+
+    int n_[3];                          ///< Points along each axis.
+    std::vector<Complex> twiddle_[3];   ///< exp(-2 pi i k/n) for each axis.
+    std::vector<int> reverse_[3];       ///< Bit reversed index for each axis.
+
+    /// Columns copied together for the strided transforms.
+    static const int block_ = 8;
+};
+
+#endif  // INCLUDE_FFT_H_
@@ -0,0 +1,61 @@
+/** @file fmm.h
+ *
+ * @brief Declaration of the fast multipole method for the Coulomb force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_FMM_H_
+#define INCLUDE_FMM_H_
+
+#include <complex>
+#include <vector>
+
+#include "ccmdsim.h"
+#include "coulombkernel.h"
+#include "ionstore.h"
+#include "octree.h"
+#include "vector3D.h"
+
+class FastMultipole {
+ public:
+    FastMultipole(const SimParams& sp, const CoulombKernel& kernel);
+
+    void compute(const IonStore& store, std::vector<Vector3D>& force);
+
+    FastMultipole(const FastMultipole&) = delete;
+    FastMultipole& operator=(const FastMultipole&) = delete;
+
+ private:
+    typedef std::complex<double> Complex;
+
+    void upward(int k, std::vector<Complex>& work);
+    void interact(int t, int s, std::vector<Complex>& work);
+    void multipole_to_local(int t, int s, std::vector<Complex>& work);
+    void direct(int t, int s);
+    void downward(int k, std::vector<Complex>& work);
+
+    Complex* multipole(int k) { return &multipole_[k*n_coeffs_]; }
+    Complex* local(int k) { return &local_[k*n_coeffs_]; }
+
+    const CoulombKernel& kernel_;   ///< Direct sum for neighbouring leaves.
+    const int order_;               ///< Highest degree of the expansions.
+    const int n_coeffs_;            ///< Coefficients per expansion.
+    const double theta_;            ///< Opening angle for cell pairs.
+    const long direct_pairs_;       ///< Fewer ion pairs are summed directly.
+    Octree tree_;                   ///< Tree, rebuilt on every call.
+
+    std::vector<double> bmax_;         ///< Radius of each cell about centre.
+    std::vector<Complex> multipole_;   ///< Multipole expansion of each cell.
+    std::vector<Complex> local_;       ///< Local expansion of each cell.
+    std::vector<Vector3D> field_;      ///< Field on each ion, tree order.
+    std::vector<int> task_;            ///< Target subtrees shared by threads.
+
+    /// Most ions in a leaf of the tree.
+    static const long leaf_size_ = 64;
+    /// Fewest target subtrees to share between threads.
+    static const int min_tasks_ = 64;
+};
+
+#endif  // INCLUDE_FMM_H_
@@ -9,13 +9,18 @@
 #ifndef INCLUDE_INTEGRATOR_H_
 #define INCLUDE_INTEGRATOR_H_
 
+#include <vector>
+
 #include "coulombforce.h"
 #include "iontrap.h"
 #include "ioncloud.h"
 #include "integratorlistener.h"
+#include "nearfield.h"
 
 class Vector3D;
 class IntegrationParams;
+class CheckpointReader;
+class CheckpointWriter;
 
 class Integrator {
     friend class CoulombForce;
@@ -28,6 +33,12 @@ class Integrator {
     void deregisterListener(const IntegratorListener_ptr& l);
     void notifyListeners(const int i) const;
 
+    void calculate_energy(bool on);
+    double coulomb_energy();
+
+    virtual void save_state(CheckpointWriter& writer);
+    virtual void load_state(CheckpointReader& reader);
+
     virtual ~Integrator();
     virtual void evolve(double dt)=0;
 
@@ -39,6 +50,9 @@ class Integrator {
     CoulombForce coulomb_;
     const IntegrationParams& params_;
     std::vector<IntegratorListener_ptr> listeners_;
+    int n_iter_;    ///< Steps taken.
+    /// The last force update of a step is at its final positions.
+    bool energy_at_update_;
 };
 
 //
@@ -53,25 +67,164 @@ class RespaIntegrator : public Integrator {
                      const IntegrationParams& integrationParams,
                      const SimParams& sp);
 
-    void evolve(double dt);
+    void evolve(double dt) { (this->*step_)(dt); }
 
     RespaIntegrator(RespaIntegrator&) = delete;
     const RespaIntegrator operator=(const RespaIntegrator&) = delete;
  private:
-    int n_iter_;
+    template <class Trap, bool Cooled> void step(double dt);
+    template <class Trap> void select_step();
+
+    void (RespaIntegrator::*step_)(double);  ///< Step for this trap.
+    std::vector<Ion_ptr> cooled_;  ///< Laser cooled ions.
+};
+
+//
+// RESPA with the Coulomb force split by distance: the near field is updated
+// every step and the far field every far_steps steps.
+//
+class SplitRespaIntegrator : public Integrator {
+ public:
+    SplitRespaIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
+                         const IntegrationParams& integrationParams,
+                         const SimParams& sp);
+
+    void evolve(double dt);
+    void save_state(CheckpointWriter& writer);
+    void load_state(CheckpointReader& reader);
+
+    SplitRespaIntegrator(SplitRespaIntegrator&) = delete;
+    const SplitRespaIntegrator operator=(const SplitRespaIntegrator&) = delete;
+ private:
+    void split_far();
+
+    NearField near_;
+    std::vector<Vector3D> near_force_;  ///< Near field at the last update.
+    std::vector<Vector3D> far_force_;   ///< Far field at the last update.
 };
 
+//
+// RESPA with the trap sub-steps of each step applied to the ions as one 2x2
+// transfer matrix per axis and species.
+//
+class TransferIntegrator : public Integrator {
+ public:
+    TransferIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
+                       const IntegrationParams& integrationParams,
+                       const SimParams& sp);
+
+    void evolve(double dt);
+
+    TransferIntegrator(TransferIntegrator&) = delete;
+    const TransferIntegrator operator=(const TransferIntegrator&) = delete;
+ private:
+    /// Map (x, v) to (a x + b v, c x + d v) along one axis.
+    struct Transfer {
+        double a, b, c, d;
+    };
+    /// Ions begin to end - 1 of the IonStore are all of one species.
+    struct Run {
+        size_t begin, end;
+        size_t species;
+    };
+
+    void find_species();
+    void kick_transfer(double dt);
+    void drift_transfer(double dt);
+    void apply_transfer();
+
+    std::vector<double> charge_over_mass_;  ///< Of each species.
+    std::vector<Transfer> transfer_;        ///< Each axis of each species.
+    std::vector<Run> runs_;                 ///< Ions moved by transfer_.
+    std::vector<Ion_ptr> cooled_;           ///< Ions moved step by step.
+};
+
+//
+// Symmetric composition of kicks and drifts, accurate to higher order than
+// velocity Verlet. The Scheme gives the stage coefficients: stages drifts of
+// drift[i]*dt, each between kicks of kick[i]*dt and kick[i+1]*dt.
+//
+template <class Scheme>
+class CompositionIntegrator : public Integrator {
+ public:
+    CompositionIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
+                          const IntegrationParams& integrationParams,
+                          const SimParams& sp);
+
+    void evolve(double dt);
+
+    CompositionIntegrator(CompositionIntegrator&) = delete;
+    const CompositionIntegrator operator=(const CompositionIntegrator&)
+        = delete;
+ private:
+    void kick(double dt);
+
+};
+
+/// Forest-Ruth, or Yoshida's, 4th order scheme of three stages.
+struct ForestRuth {
+    static const int stages = 3;
+    static const double kick[stages + 1];
+    static const double drift[stages];
+    static const char* const name;
+};
+
+/// Yoshida's 6th order scheme of seven stages, solution A.
+struct Yoshida6 {
+    static const int stages = 7;
+    static const double kick[stages + 1];
+    static const double drift[stages];
+    static const char* const name;
+};
+
+/// Blanes and Moan's 4th order scheme of six stages.
+struct BlanesMoan {
+    static const int stages = 6;
+    static const double kick[stages + 1];
+    static const double drift[stages];
+    static const char* const name;
+};
+
+//
+// Velocity Verlet in the time-averaged pseudopotential of the trap, with no
+// micromotion, for a long time step while cooling.
+//
+class PseudoIntegrator : public Integrator {
+ public:
+    PseudoIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
+                     const IntegrationParams& integrationParams,
+                     const SimParams& sp);
+
+    void evolve(double dt);
+
+    PseudoIntegrator(PseudoIntegrator&) = delete;
+    const PseudoIntegrator operator=(const PseudoIntegrator&) = delete;
+ private:
+    AlignedVector cx_, cy_, cz_;   ///< Pseudopotential force of each ion.
+    std::vector<Ion_ptr> cooled_;  ///< Laser cooled ions.
+};
+
+//
+// Velocity Verlet, with the step specialised at compile time for the type of
+// trap and whether any ions are laser cooled.
+//
 class VerletIntegrator : public Integrator {
  public:
     VerletIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
                      const IntegrationParams& integrationParams,
                      const SimParams& sp);
 
-    void evolve(double dt);
+    void evolve(double dt) { (this->*step_)(dt); }
 
     VerletIntegrator(VerletIntegrator&) = delete;
     const VerletIntegrator operator=(const VerletIntegrator&) = delete;
  private:
-    int n_iter_;
+    template <class Trap, bool Cooled> void step(double dt);
+    template <class Trap, bool Cooled> void trap_kick(Trap& trap, double dt);
+    template <class Trap> void select_step();
+
+    void (VerletIntegrator::*step_)(double);  ///< Step for this trap.
+    std::vector<Ion_ptr> cooled_;  ///< Laser cooled ions.
+    std::vector<size_t> uncooled_; ///< Store index of the other ions.
 };
 #endif  // INCLUDE_INTEGRATOR_H_
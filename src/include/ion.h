@@ -13,30 +13,37 @@
 
 #include "ccmdsim.h"
 #include "ionhistogram.h"
+#include "ionstore.h"
 #include "iontrap.h"
 #include "stats.h"
 #include "stochastic_heat.h"
 
 class Vector3D;
 class IonHistogram;
+class CheckpointReader;
+class CheckpointWriter;
 template <class T> class Stats;
 
 class Ion {
  public:
-    explicit Ion(const IonType& type, const LaserParams& lp);
+    Ion(const IonType& type, const LaserParams& lp, IonStore& store,
+        size_t index);
     virtual ~Ion() {}
     // Shift ion position.
-    void move(const Vector3D &move_va) { pos_ += move_va; }
+    void move(const Vector3D &move_va) {
+        store_.set_pos(index_, get_pos() + move_va); }
 
     // Base class functions
     void drift(double dt);
     void recordKE(IonHistogram_ptr ionHistogram, const TrapParams& trapParams) const;
     void updateStats();
     void update_from(const IonType& from);
+    virtual void save_state(CheckpointWriter& writer) const;
+    virtual void load_state(CheckpointReader& reader);
 
     // These should only be called once on initialising the ion;
-    void set_position(const Vector3D &r) { pos_ = r; }
-    void set_velocity(const Vector3D &v) { vel_ = v; }
+    void set_position(const Vector3D &r) { store_.set_pos(index_, r); }
+    void set_velocity(const Vector3D &v) { store_.set_vel(index_, v); }
     void set_ElecState(const int &ES)    { ElecState = ES;}
 
     // velocity modifying functions
@@ -45,16 +52,18 @@ class Ion {
     virtual void kick(double dt, const Vector3D &f);
     virtual void velocity_scale(double dt) {}
     virtual void heat(double dt) {}
+    virtual void cool(double dt) {}
 
     // accessor functions
     const IonType& get_type()               const {return ionType_; }
     std::string name()                      const {return ionType_.name;}
     std::string formula()                   const {return ionType_.formula;}
-    const Vector3D& get_pos()               const {return pos_;}
-    const Vector3D& get_vel()               const {return vel_;}
+    Vector3D get_pos()                      const {return store_.get_pos(index_);}
+    Vector3D get_vel()                      const {return store_.get_vel(index_);}
     const int& get_state()                  const {return ElecState;}
     double get_mass()                       const {return ionType_.mass;}
     double get_charge()                     const {return ionType_.charge;}
+    size_t get_index()                      const {return index_;}
     const Stats<Vector3D> get_posStats()    const {return posStats_;}
     const Stats<double> get_velStats()      const {return velStats_;}
 
@@ -64,8 +73,8 @@ class Ion {
  protected:
     const IonType& ionType_;
     const LaserParams& lp_;
-    Vector3D pos_;
-    Vector3D vel_;
+    IonStore& store_;      ///< Arrays holding position and velocity.
+    const size_t index_;   ///< Index of this ion in the store arrays.
     int ElecState;		   ///< Electronic energy level, 0 == Ground State, 1 == Excited State, (2 == Dark State)
  
     // Store statistics for this ion
@@ -76,7 +85,8 @@ class Ion {
 
 class TrappedIon : public Ion {
  public:
-    TrappedIon(const IonTrap_ptr trap, const IonType& type, const LaserParams& lp);
+    TrappedIon(const IonTrap_ptr trap, const IonType& type,
+               const LaserParams& lp, IonStore& store, size_t index);
     ~TrappedIon() {}
 
     virtual void kick(double dt);
@@ -92,12 +102,17 @@ class TrappedIon : public Ion {
 
 class LaserCooledIon : public TrappedIon {
  public:
-    LaserCooledIon(const IonTrap_ptr ion_trap, const TrapParams& trap_params, const IonType& type, const SimParams& sp, const LaserParams& lp);
+    LaserCooledIon(const IonTrap_ptr ion_trap, const TrapParams& trap_params,
+                   const IonType& type, std::mt19937& generator,
+                   const LaserParams& lp, IonStore& store, size_t index);
     ~LaserCooledIon() {}
 
     void kick(double dt);
     void velocity_scale(double dt);
     void heat(double dt);
+    void cool(double dt);
+    void save_state(CheckpointWriter& writer) const;
+    void load_state(CheckpointReader& reader);
 	Vector3D Emit(double dt);
 	Vector3D Absorb(double dt);
 
@@ -106,9 +121,17 @@ class LaserCooledIon : public TrappedIon {
  private:
 	double fscatt(double LaserDirection);
 	Vector3D isoEmit();
+    void scatter_events(double dt);
     Stochastic_heat heater_;
     Vector3D get_friction() const;
     const TrapParams& trap_params; 
+    double Gamma_;       ///< Natural linewidth, in simulation units.
+    double delta_;       ///< Laser detuning, in simulation units.
+    double k_;           ///< Laser wavenumber, in simulation units.
+    double rate_scale_;  ///< Numerator of the scattering rate.
+    /** Integrated scattering rate left until the next photon event, for
+     scatter_events; negative until drawn. */
+    double hazard_;
 };
 
 /// Ion pointer type.
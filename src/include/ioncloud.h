@@ -10,12 +10,16 @@
 #define INCLUDE_IONCLOUD_H_
 
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
 #include "ion.h"
+#include "ionstore.h"
 #include "iontrap.h"
 
+class CheckpointReader;
+class CheckpointWriter;
 class ImageCollection;
 class IonHistogram;
 class IonTrap;
@@ -35,7 +39,13 @@ class IonCloud {
     void drift(double t);
     void kick(double t);
     void kick(double t, const std::vector<Vector3D>& fc);
+    void linear_kick(double t, const Vector3D& c);
+    void linear_kick(double t, const Vector3D& c,
+                     const std::vector<size_t>& index);
+    void linear_kick(double t, const AlignedVector& cx,
+                     const AlignedVector& cy, const AlignedVector& cz);
     void heat(double t);
+    void cool(double t);
     void velocity_scale(double dt);
     void updateStats();
 
@@ -47,6 +57,7 @@ class IonCloud {
 
     size_t number_of_ions() const { return ionVec_.size(); }
     const Ion_ptr_vector& get_ions() const { return ionVec_; }
+    const IonStore& get_store() const { return store_; }
 
     void update_position_histogram(ImageCollection&) const;
     void update_energy_histogram(IonHistogram_ptr) const;
@@ -57,6 +68,11 @@ class IonCloud {
                    const double time_scale) const;
 
     void swap_first(const IonType& from, const IonType& to);
+    void pseudo_coefficients(AlignedVector& cx, AlignedVector& cy,
+                             AlignedVector& cz) const;
+
+    void save_state(CheckpointWriter& writer) const;
+    void load_state(CheckpointReader& reader);
 
     IonCloud(const IonCloud&) = delete;
     const IonCloud& operator=(const IonCloud&) = delete;
@@ -67,16 +83,34 @@ class IonCloud {
     const SimParams& simParams_;
     const TrapParams& trapParams_;
     const LaserParams& lp_;
-    /** A list of pointers to the ion objects. */
+    /** Contiguous arrays of ion position, velocity, mass and charge. */
+    IonStore store_;
+    /** A list of pointers to the ion objects, ordered as in store_. */
     Ion_ptr_vector ionVec_;
+    /** The trap, for the force on all ions at once. */
+    const IonTrap_ptr trap_;
+    /** The laser cooled ions, which also feel the laser in kick. */
+    Ion_ptr_vector cooled_;
+    /** Random numbers of the laser cooled ions, seeded by simulation.seed. */
+    std::mt19937 generator_;
+    /** Trap force on each ion, filled by kick. */
+    AlignedVector fx_, fy_, fz_;
 
     Vector3D get_cloud_centre() const;
     void move_centre(const Vector3D& v);
+    void warm_start();
     static std::vector<Vector3D> get_lattice(size_t n);
     static int get_nearest_cube(int n);
+    static size_t count_ions(const CloudParams& cp);
 
     /** @brief CoulombForce needs direct access to the list of ions. */
     friend class CoulombForce;
+    /** @brief TransferIntegrator moves the ions by the trap directly. */
+    friend class TransferIntegrator;
+    /** @brief Ensemble copies its interleaved ion data to each cloud. */
+    friend class Ensemble;
+    /** @brief Minimiser moves the ions and sets their velocities. */
+    friend class Minimiser;
 };
 
 typedef std::shared_ptr<IonCloud> IonCloud_ptr;
@@ -0,0 +1,101 @@
+/**
+ * @file ionstore.h
+ * @brief Declaration of contiguous structure-of-arrays storage for ion data.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_IONSTORE_H_
+#define INCLUDE_IONSTORE_H_
+
+#include <xmmintrin.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "vector3D.h"
+
+/**
+ *  @class AlignedAllocator
+ *  @brief Standard library allocator returning memory aligned to a cache
+ *  line.
+ *
+ *  Aligning the start of each array lets the compiler use aligned vector
+ *  loads and stores in the loops over ion data.
+ */
+template <class T, std::size_t Alignment = 64>
+class AlignedAllocator {
+ public:
+    typedef T value_type;
+
+    template <class U> struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() {}
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        void* p = _mm_malloc(n*sizeof(T), Alignment);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, std::size_t) { _mm_free(p); }
+
+    template <class U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+/// Cache-line aligned array of doubles.
+typedef std::vector<double, AlignedAllocator<double> > AlignedVector;
+
+/**
+ *  @class IonStore
+ *  @brief Position, velocity, mass and charge of every ion held in separate
+ *  contiguous arrays.
+ *
+ *  The arrays are sized once on construction and never reallocated, so an
+ *  Ion can hold a reference to the store and its own index into it. Loops
+ *  over all ions read straight from these arrays rather than following a
+ *  pointer to each Ion object.
+ */
+class IonStore {
+ public:
+    explicit IonStore(std::size_t n)
+        : x(n), y(n), z(n), vx(n), vy(n), vz(n), mass(n), charge(n), n_(n) {}
+
+    std::size_t size() const { return n_; }
+
+    Vector3D get_pos(std::size_t i) const { return Vector3D(x[i], y[i], z[i]); }
+    Vector3D get_vel(std::size_t i) const {
+        return Vector3D(vx[i], vy[i], vz[i]); }
+
+    void set_pos(std::size_t i, const Vector3D& r) {
+        x[i] = r.x; y[i] = r.y; z[i] = r.z; }
+    void set_vel(std::size_t i, const Vector3D& v) {
+        vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+
+    AlignedVector x, y, z;        ///< Position components.
+    AlignedVector vx, vy, vz;     ///< Velocity components.
+    AlignedVector mass;           ///< Mass of each ion.
+    AlignedVector charge;         ///< Charge of each ion.
+
+    IonStore(const IonStore&) = delete;
+    const IonStore& operator=(const IonStore&) = delete;
+
+ private:
+    std::size_t n_;
+};
+
+#endif  // INCLUDE_IONSTORE_H_
@@ -9,12 +9,16 @@
 #define INCLUDE_IONTRAP_H_
 
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "ccmdsim.h"
 #include "vector3D.h"
 
+class CheckpointReader;
+class CheckpointWriter;
+
 class IonTrap {
  public:
     explicit IonTrap(const TrapParams& params);
@@ -29,6 +33,10 @@ class IonTrap {
      */
     virtual Vector3D force_now(const Vector3D& r) const = 0;
 
+    void force_batch(const double* x, const double* y, const double* z,
+                     const double* charge, double* fx, double* fy, double* fz,
+                     size_t n);
+
     /** @brief evolves trap through a timestep.
      *
      * Subclasses use this function to update the time-dependent voltage on the
@@ -40,17 +48,70 @@ class IonTrap {
 
 
     // Return the current value of the trapping voltage multiplier.
-    virtual double get_phase() = 0;
+    virtual double get_phase() const = 0;
+
+    Vector3D force_coefficients();
+
+    /** @brief The force coefficients of force_coefficients at a given value
+     *  of get_phase(), inline for the specialised integrator steps.
+     */
+    Vector3D coefficients_at(double phase) const {
+        return Vector3D(+2*q_unit_mass_*phase - a_unit_mass_,
+                        -2*q_unit_mass_*phase - a_unit_mass_,
+                        2*a_unit_mass_);
+    }
+
+    /// The type of RF waveform, as given in the trap parameters.
+    TrapParams::Waveform wave() const { return params_.wave; }
+
+    void use_phase_table(double tick);
+
+    Vector3D pseudo_coefficients(double charge_over_mass) const;
+
+    /** @brief Called as the histogram stage begins, at the trap time it
+     *  starts from.
+     */
+    virtual void begin_histogram() {}
+
+    virtual void save_state(CheckpointWriter& writer) const;
+    virtual void load_state(CheckpointReader& reader);
 
     IonTrap(const IonTrap&) = delete;
     const IonTrap& operator=(const IonTrap&) = delete;
 
  protected:
+    /** @brief The periodic part of get_phase() at a given time, used to fill
+     *  the phase table and when there is none.
+     */
+    virtual double phase_at(double time) const = 0;
+
+    /** @brief The time after which phase_at repeats, or zero if it never
+     *  does.
+     */
+    virtual double period() const { return pi; }
+
+    /** @brief Set the value get_phase() returns, on restoring a checkpoint.
+     */
+    virtual void set_phase(double phase) = 0;
+
+    bool advance(double dt);
+
+    /** @brief The value of phase_at for the current time, when advance
+     *  returned true.
+     */
+    double table_phase() const { return phase_table_[table_index_]; }
+
     double a_unit_mass_;     ///< Mathieu \c a parameter.
     double q_unit_mass_;     ///< Matheiu \c q parameter.
 
     double time_now_;        ///< Current time in simulation units.
 
+    std::vector<double> phase_table_;  ///< phase_at over one period.
+    double tick_;            ///< Time between entries of phase_table_.
+    double ticks_per_time_;  ///< Inverse of tick_.
+    std::uint64_t tick_count_;   ///< Ticks since time zero.
+    size_t table_index_;     ///< Entry of phase_table_ for time_now_.
+
     static const double pi;
     static const double epsilon_0;
     static const double electron_charge;
@@ -61,17 +122,24 @@ class IonTrap {
 };
 typedef std::shared_ptr<IonTrap> IonTrap_ptr;
 
+IonTrap_ptr make_trap(TrapParams& params,
+                      const IntegrationParams& integration_params);
+
 class CosineTrap : public IonTrap {
  public:
     explicit CosineTrap(const TrapParams& params);
 
     Vector3D force_now(const Vector3D& r) const;
     void evolve(double time);
-    double get_phase () { return cos_phase_; }
+    double get_phase () const { return cos_phase_; }
 
     CosineTrap(const CosineTrap&) = delete;
     const CosineTrap& operator=(const CosineTrap&) = delete;
 
+ protected:
+    double phase_at(double time) const;
+    void set_phase(double phase) { cos_phase_ = phase; }
+
  private:
     double cos_phase_;    ///< Magnitude of the cosine function at current time.
 };
@@ -81,13 +149,20 @@ class CosineDecayTrap : public CosineTrap {
     explicit CosineDecayTrap(const TrapParams& params);
     Vector3D force_now(const Vector3D& r) const;
     void evolve(double time);
-    double get_phase () { return cos_phase_; }
+    double get_phase () const { return cos_phase_; }
+    void begin_histogram();
+    void save_state(CheckpointWriter& writer) const;
+    void load_state(CheckpointReader& reader);
 
     CosineDecayTrap(const CosineDecayTrap&) = delete;
     const CosineDecayTrap operator=(const CosineDecayTrap&) = delete;
 
+ protected:
+    void set_phase(double phase) { cos_phase_ = phase; }
+
  private:
     double cos_phase_;    ///< Magnitude of the cosine function at current time.
+    double decay_start_;  ///< Trap time at which the decay starts.
 };
 
 class TwoFreq_trap : public IonTrap {
@@ -96,11 +171,16 @@ class TwoFreq_trap : public IonTrap {
 
     Vector3D force_now(const Vector3D& r) const;
     void evolve(double time);
-    double get_phase () { return cos_phase; }
+    double get_phase () const { return cos_phase; }
 
     TwoFreq_trap(const TwoFreq_trap&) = delete;
     const TwoFreq_trap& operator=(const TwoFreq_trap&) = delete;
 
+ protected:
+    double phase_at(double time) const;
+    double period() const;
+    void set_phase(double phase) { cos_phase = phase; }
+
  private:
     double cos_phase;    ///< Magnitude of the cosine function at current time.
     double freq_mult;    ///< Multiplier for second frequency
@@ -112,11 +192,15 @@ class PulsedTrap : public IonTrap {
 
     Vector3D force_now(const Vector3D& r) const;
     void evolve(double time);
-    double get_phase () { return pulse_height_; }
+    double get_phase () const { return pulse_height_; }
 
     PulsedTrap(const PulsedTrap&) = delete;
     const PulsedTrap& operator=(const PulsedTrap&) = delete;
 
+ protected:
+    double phase_at(double time) const;
+    void set_phase(double phase) { pulse_height_ = phase; }
+
  private:
     double pulse_height_;
 };
@@ -127,10 +211,15 @@ class WaveformTrap : public IonTrap {
 
     Vector3D force_now(const Vector3D& r) const;
     void evolve(double time);
-    double get_phase () { return potential_; }
+    double get_phase () const { return potential_; }
 
     WaveformTrap(const WaveformTrap&) = delete;
     const WaveformTrap& operator=(const WaveformTrap&) = delete;
+
+ protected:
+    double phase_at(double time) const;
+    void set_phase(double phase) { potential_ = phase; }
+
  private:
     std::vector<double> amplitudes_;
 
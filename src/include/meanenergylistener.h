@@ -16,7 +16,9 @@
 #include "datawriter.h"
 #include "logger.h"
 
+#include <deque>
 #include <string>
+#include <vector>
 
 class MeanEnergyListener : public IntegratorListener {
  public:
@@ -26,6 +28,10 @@ class MeanEnergyListener : public IntegratorListener {
 
   void update(const int i);
   void finished();
+  void resume(int n_iter, const std::vector<double>& state);
+  void flush();
+  bool converged() const;
+  std::vector<double> state() const;
 
   MeanEnergyListener(const MeanEnergyListener&) = delete;
   const MeanEnergyListener& operator=(const MeanEnergyListener&) = delete;
@@ -36,6 +42,10 @@ class MeanEnergyListener : public IntegratorListener {
   std::string stats_file_;
   int write_every_;
   int energy_row_;
+  /// Energy of the latest periods, as many as the convergence test uses.
+  std::deque<double> history_;
+  double period_sum_;    ///< Sum of the energy over the period so far.
+  int period_count_;     ///< Steps in the period so far.
   DataWriter writer_;
   Logger& log_;
 };
@@ -0,0 +1,55 @@
+/**
+ * @file minimiser.h
+ * @brief Class declaration for relaxing the starting ions to a minimum of the
+ * pseudopotential and Coulomb energy.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_MINIMISER_H_
+#define INCLUDE_MINIMISER_H_
+
+#include "coulombforce.h"
+#include "ioncloud.h"
+#include "ionstore.h"
+#include "iontrap.h"
+
+class IntegrationParams;
+class SimParams;
+
+/**
+ *  @class Minimiser
+ *  @brief FIRE relaxation of the ion positions in the trap pseudopotential
+ *  and the Coulomb force of the ions.
+ */
+class Minimiser {
+ public:
+    Minimiser(const IonCloud_ptr ic, const IntegrationParams& params,
+              const SimParams& sp);
+
+    void relax();
+
+    Minimiser(const Minimiser&) = delete;
+    const Minimiser& operator=(const Minimiser&) = delete;
+ private:
+    void update_force();
+    double energy();
+
+    const IonCloud_ptr ions_;
+    CoulombForce coulomb_;
+    const IntegrationParams& params_;
+    AlignedVector cx_, cy_, cz_;   ///< Pseudopotential force of each ion.
+    AlignedVector fx_, fy_, fz_;   ///< Total force on each ion.
+    double coulomb_rms_;           ///< RMS Coulomb force, for the tolerance.
+
+    // FIRE parameters, from Bitzek et al., Phys. Rev. Lett. 97, 170201.
+    static const int n_min_;
+    static const double dt_grow_;
+    static const double dt_shrink_;
+    static const double dt_max_factor_;
+    static const double alpha_start_;
+    static const double alpha_shrink_;
+};
+
+#endif  // INCLUDE_MINIMISER_H_
@@ -0,0 +1,42 @@
+/** @file nearfield.h
+ *
+ * @brief Declaration of the short-range part of a distance-split Coulomb
+ * force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_NEARFIELD_H_
+#define INCLUDE_NEARFIELD_H_
+
+#include <vector>
+
+#include "ionstore.h"
+#include "neighbourlist.h"
+#include "vector3D.h"
+
+class NearField {
+ public:
+    NearField(double radius, double skin);
+
+    void compute(const IonStore& store, std::vector<Vector3D>& force);
+
+    /// Distance beyond which the near field is zero.
+    double radius() const { return radius_; }
+    /// Number of times the neighbour list has been built.
+    long list_builds() const { return list_.builds(); }
+
+    NearField(const NearField&) = delete;
+    NearField& operator=(const NearField&) = delete;
+
+ private:
+    const double radius_;       ///< Pairs at or beyond this are far field.
+    const double inner_;        ///< Pairs closer than this are all near field.
+    NeighbourList list_;        ///< Ions within radius_ plus a skin.
+
+    /// Width of the switch from near to far as a fraction of the radius.
+    static constexpr double switch_width_ = 0.2;
+};
+
+#endif  // INCLUDE_NEARFIELD_H_
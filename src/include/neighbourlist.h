@@ -0,0 +1,62 @@
+/** @file neighbourlist.h
+ *
+ * @brief Declaration of a Verlet neighbour list with a skin distance.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_NEIGHBOURLIST_H_
+#define INCLUDE_NEIGHBOURLIST_H_
+
+#include <vector>
+
+#include "ionstore.h"
+
+class NeighbourList {
+ public:
+    NeighbourList(double cutoff, double skin);
+
+    bool update(const IonStore& store);
+
+    /// First entry of neighbours() for ion i; the last is at begin(i+1) - 1.
+    long begin(long i) const { return start_[i]; }
+    /// IonStore indices of the neighbours of every ion, ion by ion.
+    const std::vector<long>& neighbours() const { return neighbours_; }
+    /// Distance the list covers without a rebuild.
+    double cutoff() const { return cutoff_; }
+    /// Number of times the list has been built.
+    long builds() const { return builds_; }
+
+    NeighbourList(const NeighbourList&) = delete;
+    NeighbourList& operator=(const NeighbourList&) = delete;
+
+ private:
+    bool moved(const IonStore& store) const;
+    void build(const IonStore& store);
+    void sort_ions(const IonStore& store);
+    template <bool fill> void search(long n);
+
+    const double cutoff_;       ///< Distance the list must cover.
+    const double skin_;         ///< Extra distance listed, for movement.
+    const double reach_;        ///< cutoff_ + skin_.
+
+    std::vector<long> start_;         ///< First neighbour of each ion, then n.
+    std::vector<long> neighbours_;    ///< Neighbours, ion by ion.
+    AlignedVector x0_, y0_, z0_;      ///< Positions when the list was built.
+    long builds_;                     ///< Number of builds.
+
+    int nc_[3];                       ///< Cells along each axis.
+    int span_[3];                     ///< Cells to search along each axis.
+    std::vector<long> cell_start_;    ///< First sorted ion of each cell.
+    std::vector<long> order_;         ///< IonStore index of each sorted ion.
+    std::vector<long> cell_of_;       ///< Cell of each ion, IonStore order.
+    AlignedVector x_, y_, z_;         ///< Ions sorted by cell.
+
+    /// Cells of the search per listed distance.
+    static const int cell_split_ = 2;
+    /// Most cells per ion, for sparse clouds.
+    static const int max_cells_per_ion_ = 4;
+};
+
+#endif  // INCLUDE_NEIGHBOURLIST_H_
@@ -0,0 +1,68 @@
+/** @file octree.h
+ *
+ * @brief Declaration of the octree used by the tree-code Coulomb solvers.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_OCTREE_H_
+#define INCLUDE_OCTREE_H_
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ionstore.h"
+
+class Octree {
+ public:
+    /// Cubic cell of the tree, holding a contiguous range of sorted ions.
+    struct Node {
+        double cx, cy, cz;   ///< Geometric centre of the cell.
+        double half;         ///< Half the side length of the cell.
+        long begin, end;     ///< Range of sorted ions in the cell.
+        int first_child;     ///< Index of first child node, -1 for a leaf.
+        int n_children;      ///< Number of non-empty children.
+        int level;           ///< Depth of the cell, zero for the root.
+
+        bool is_leaf() const { return first_child < 0; }
+    };
+
+    explicit Octree(long leaf_size);
+
+    void build(const IonStore& store);
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    /// Number of levels in the tree.
+    int levels() const { return level_start_.size() - 1; }
+    /// Nodes of level l are [level_start(l), level_start(l+1)).
+    int level_start(int l) const { return level_start_[l]; }
+
+    /// Position and charge of the ions in tree order.
+    AlignedVector x, y, z, q;
+    /// Index into the IonStore of each ion in tree order.
+    std::vector<long> order;
+
+    Octree(const Octree&) = delete;
+    Octree& operator=(const Octree&) = delete;
+
+ private:
+    typedef std::pair<uint64_t, long> KeyIndex;
+
+    void sort_keys();
+    void split_levels();
+
+    /// Bits of each coordinate in the Morton key, and the deepest level.
+    static const int max_depth_ = 21;
+
+    long leaf_size_;                   ///< Most ions in a leaf.
+    std::vector<KeyIndex> keys_;       ///< Morton key of each ion.
+    std::vector<KeyIndex> buffer_;     ///< Merge buffer for the sort.
+    std::vector<Node> nodes_;          ///< Nodes in breadth-first order.
+    std::vector<int> level_start_;     ///< First node of each level, then size.
+    std::vector<std::array<long, 9> > split_;  ///< Child ranges while building.
+};
+
+#endif  // INCLUDE_OCTREE_H_
@@ -0,0 +1,76 @@
+/** @file particlemesh.h
+ *
+ * @brief Declaration of the particle-particle/particle-mesh (P3M) Coulomb
+ * solver.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_PARTICLEMESH_H_
+#define INCLUDE_PARTICLEMESH_H_
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include "ccmdsim.h"
+#include "fft.h"
+#include "ionstore.h"
+#include "vector3D.h"
+
+class ParticleMesh {
+ public:
+    explicit ParticleMesh(const SimParams& sp);
+
+    void compute(const IonStore& store, std::vector<Vector3D>& force);
+
+    ParticleMesh(const ParticleMesh&) = delete;
+    ParticleMesh& operator=(const ParticleMesh&) = delete;
+
+ private:
+    typedef std::complex<double> Complex;
+
+    double mesh_spacing(const double extent[3], long n) const;
+    bool mesh_fits(const double extent[3], double spacing) const;
+    void resize_mesh(const double extent[3], double spacing);
+    void mesh_field(const IonStore& store, const double lo[3]);
+    void short_range(const IonStore& store, const double lo[3],
+                     const double extent[3]);
+
+    const int mesh_points_;     ///< Mesh points on the longest axis, or 0.
+    const double cutoff_cells_;  ///< Short-range cutoff in mesh spacings.
+
+    double h_;                  ///< Mesh spacing.
+    double alpha_;              ///< Splitting parameter of erf(alpha r)/r.
+    double cutoff_;             ///< Short-range cutoff distance.
+    int m_[3];                  ///< Mesh points on each axis.
+    double origin_[3];          ///< Position of mesh point (0, 0, 0).
+    std::unique_ptr<FFT3D> fft_;      ///< FFT of the zero-padded mesh.
+    std::vector<Complex> kernel_xy_;  ///< Transform of K_x + i K_y.
+    std::vector<Complex> kernel_z_;   ///< Transform of K_z.
+    std::vector<Complex> rho_;        ///< Charge on the mesh, then E_z.
+    std::vector<Complex> exy_;        ///< E_x + i E_y on the mesh.
+
+    std::vector<Vector3D> field_;     ///< Field on each ion, IonStore order.
+    std::vector<long> cell_start_;    ///< First sorted ion of each cell.
+    std::vector<long> order_;         ///< IonStore index of each sorted ion.
+    std::vector<long> cell_of_;       ///< Cell of each ion, IonStore order.
+    AlignedVector x_, y_, z_, q_;     ///< Ions sorted by cell.
+    std::vector<double> screen_;      ///< Short-range screening table.
+
+    /// alpha times the cutoff; erfc(3.2) = 6e-6.
+    static constexpr double alpha_cutoff_ = 3.2;
+    /// Spare room on the mesh as a fraction of the cloud size.
+    static constexpr double slack_ = 0.2;
+    /// Ions per mesh cell when the mesh is sized automatically.
+    static constexpr double ions_per_cell_ = 0.5;
+    /// Most mesh points on any axis when the mesh is sized automatically.
+    static const int max_points_ = 128;
+    /// Cells of the short-range search per cutoff distance.
+    static const int cell_split_ = 2;
+    /// Intervals of the screening table.
+    static const int table_size_ = 4096;
+};
+
+#endif  // INCLUDE_PARTICLEMESH_H_
@@ -0,0 +1,59 @@
+/**
+ * @file snapshot.h
+ * @brief Class declaration for the final ion positions and velocities of a
+ * run, used to start another.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#ifndef INCLUDE_SNAPSHOT_H_
+#define INCLUDE_SNAPSHOT_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vector3D.h"
+
+class CloudParams;
+class IonCloud;
+class TrapParams;
+
+/**
+ *  @class Snapshot
+ *  @brief Positions and velocities of the ions of an earlier run, by species,
+ *  in the simulation units of this run.
+ */
+class Snapshot {
+ public:
+    Snapshot(const std::string& from, const CloudParams& cp,
+             const TrapParams& tp);
+
+    static void write(const std::string& file_name, const IonCloud& cloud,
+                      const CloudParams& cp, const TrapParams& tp);
+
+    void take(const std::string& name, size_t n,
+              std::vector<Vector3D>& pos, std::vector<Vector3D>& vel) const;
+
+    Snapshot(const Snapshot&) = delete;
+    const Snapshot& operator=(const Snapshot&) = delete;
+ private:
+    /// Positions and velocities of the ions of one species.
+    struct Species {
+        std::vector<Vector3D> pos;
+        std::vector<Vector3D> vel;
+    };
+
+    void read_binary(const std::string& file_name, const TrapParams& tp);
+    void read_csv(const std::string& path, const CloudParams& cp,
+                  const TrapParams& tp);
+
+    std::map<std::string, Species> species_;   ///< Ions by species name.
+
+    static const std::int64_t magic_;
+    static const std::int64_t version_;
+};
+
+#endif  // INCLUDE_SNAPSHOT_H_
@@ -70,6 +70,24 @@ class Stats {
     T count() const {
         return count_;
     }
+
+    /**
+     *  @brief The working variables, for a checkpoint.
+     */
+    void get_state(int& count, T& mean, T& n_variance) const {
+        count = count_;
+        mean = mean_;
+        n_variance = n_variance_;
+    }
+
+    /**
+     *  @brief Restore the working variables from a checkpoint.
+     */
+    void set_state(int count, const T& mean, const T& n_variance) {
+        count_ = count;
+        mean_ = mean;
+        n_variance_ = n_variance;
+    }
   private:
     /** @brief A running count of the number of elements added to this object.
      */
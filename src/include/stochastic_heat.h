@@ -9,18 +9,22 @@
 #include "vector3D.h"
 #include "logger.h"
 
+#include <cmath>
 #include <random>
 #include <ctime>
 #include <cstdlib>
 
+class CheckpointReader;
+class CheckpointWriter;
+
 //Sample Code for usage of mtrnd
 //MT::MersenneTwist mtrnd;
 //mtrnd.init_genrand(5489UL); //initialize the Mersenne Twister.
 //int n = static_cast<int>(floor(mtrnd.genrand_res53()*Nmax)); 
 
 class Stochastic_heat {
-     // create a Mersenne twister random number generator
-    static std::mt19937 generator;
+    // Mersenne twister random number generator of the ion cloud
+    std::mt19937& generator;
     // select Gaussian probability distribution
     std::normal_distribution<double> norm_dist;
     // bind random number generator to distribution, forming a function
@@ -31,15 +35,12 @@ class Stochastic_heat {
     
     double kick_size;
 public:
-    Stochastic_heat(int seed)
-        :norm_dist(0.0,1.0), flat_dist(0, 1), kick_size(0.01) {
+    explicit Stochastic_heat(std::mt19937& gen)
+        :generator(gen), norm_dist(0.0,1.0), flat_dist(0, 1), kick_size(0.01) {
     //: normal(generator, norm_dist), flat_dist(0,1), flat(generator, flat_dist)
-        if (seed<0) {
-            seed = (int)std::time(0);
-        }
-        generator.seed(static_cast<unsigned int>(seed));
-            
     }
+
+    static void seed(std::mt19937& gen, int seed);
     Vector3D random_kick() 
        //{ return Vector3D( normal(), normal(), normal())*kick_size; }
        { return Vector3D(norm_dist(generator), norm_dist(generator), norm_dist(generator))*kick_size; }
@@ -52,6 +53,12 @@ public:
     
     Stochastic_heat(const Stochastic_heat&) = delete;
     const Stochastic_heat& operator=(const Stochastic_heat&) = delete;
+
+    static void save_generator(CheckpointWriter& writer,
+                               const std::mt19937& gen);
+    static void load_generator(CheckpointReader& reader, std::mt19937& gen);
+    void save_state(CheckpointWriter& writer) const;
+    void load_state(CheckpointReader& reader);
     
 	
 	Vector3D random_sphere_vector() {
@@ -74,6 +81,11 @@ public:
 //        int tid = omp_get_thread_num()
         return (flat_dist(generator) < fscatt);       
     }
+
+    /// A random number with a unit exponential distribution.
+    double exponential() {
+        return -std::log(1.0 - flat_dist(generator));
+    }
 };
 
 #endif
@@ -7,10 +7,12 @@
  */
 
 #include "include/ccmdsim.h"
+#include "include/checkpoint.h"
 #include "include/integrator.h"
 #include "include/ion.h"
 #include "include/iontrap.h"
 
+#include <cstdint>
 #include <iostream>
 #include <algorithm>
 
@@ -23,7 +25,8 @@
  */
 Integrator::Integrator(const IonTrap_ptr it, const IonCloud_ptr ic,
                        const IntegrationParams& params, const SimParams& sp)
-    : trap_(it), ions_(ic), coulomb_(ic, sp), params_(params), listeners_(){
+    : trap_(it), ions_(ic), coulomb_(ic, sp), params_(params), listeners_(),
+      n_iter_(0), energy_at_update_(true) {
     // get Coulomb forces on construction
     coulomb_.update();
     }
@@ -46,3 +49,44 @@ void Integrator::notifyListeners(const int i) const {
         l->update(i);
     }
 }
+
+
+/** @brief Ask for the Coulomb energy from every force update, when the
+ *  Coulomb method does not give it anyway.
+ */
+void Integrator::calculate_energy(bool on) {
+    if (energy_at_update_)
+        coulomb_.calculate_energy(on);
+}
+
+
+/** @brief Coulomb energy of the ions at the end of the last step.
+ *
+ *  Comes from the last force update when that is at the final positions, as
+ *  for the Verlet integrator. The RESPA integrator's update is at the start
+ *  of the step, and the split RESPA integrator's at the end of the last far
+ *  field cycle, so for those the pairs are summed again.
+ */
+double Integrator::coulomb_energy() {
+    if (energy_at_update_)
+        return coulomb_.get_energy();
+    return coulomb_.pair_energy(ions_->get_store());
+}
+
+
+/** @brief Write the step counter and the Coulomb force of the last update
+ *  to a checkpoint.
+ */
+void Integrator::save_state(CheckpointWriter& writer) {
+    writer.write(static_cast<std::int64_t>(n_iter_));
+    coulomb_.save_state(writer);
+}
+
+
+/** @brief Restore the step counter and Coulomb force from a checkpoint, in
+ *  place of those the constructor found from the restored positions.
+ */
+void Integrator::load_state(CheckpointReader& reader) {
+    n_iter_ = static_cast<int>(reader.read_int());
+    coulomb_.load_state(reader);
+}
@@ -9,6 +9,7 @@
 #include "include/ion.h"
 
 #include "include/ccmdsim.h"
+#include "include/checkpoint.h"
 #include "include/ionhistogram.h"
 #include "include/stats.h"
 
@@ -29,14 +30,20 @@
  *  and uses this to update the velocity, and the LaserCooledIon uses both this 
  *  and laser forces.
  *
- *  The position and velocity vectors are hidden as private variables; they
- *  can be read-out, but only modified correctly by a force or free flight.
+ *  The position and velocity are not held by the ion itself, but in the
+ *  IonStore arrays shared by the whole cloud; an ion keeps only its index into
+ *  these. This lets the cloud and Coulomb force loop over contiguous arrays,
+ *  while the ion remains a view on its own entries. They can be read-out, but
+ *  only modified correctly by a force or free flight.
  *
  *  @see TrappedIon, LaserCooledIon
  */
 
-Ion::Ion(const IonType& type, const LaserParams& lp): 
-    ionType_(type), lp_(lp) {
+Ion::Ion(const IonType& type, const LaserParams& lp, IonStore& store,
+         size_t index):
+    ionType_(type), lp_(lp), store_(store), index_(index) {
+    store_.mass[index_] = ionType_.mass;
+    store_.charge[index_] = ionType_.charge;
 }
 
 /**
@@ -47,7 +54,9 @@ Ion::Ion(const IonType& type, const LaserParams& lp):
  *  @param dt Time step.
  */
 void Ion::drift(double dt) {
-    pos_ += vel_*dt;
+    store_.x[index_] += store_.vx[index_]*dt;
+    store_.y[index_] += store_.vy[index_]*dt;
+    store_.z[index_] += store_.vz[index_]*dt;
 }
 
 /**
@@ -57,7 +66,9 @@ void Ion::drift(double dt) {
  */
  inline void Ion::kick(const double dt, const Vector3D& f) {
     double time_over_mass = dt/ionType_.mass;
-    vel_ += f*time_over_mass;
+    store_.vx[index_] += f.x*time_over_mass;
+    store_.vy[index_] += f.y*time_over_mass;
+    store_.vz[index_] += f.z*time_over_mass;
  }
 /**
  *  @brief Add the kinetic energy of this ion to a histogram.
@@ -72,17 +83,18 @@ void Ion::drift(double dt) {
 void Ion::recordKE(IonHistogram_ptr ionHistogram, const TrapParams& trapParams) const {
     double energy;
     double mon2 = 0.5 * ionType_.mass;
+    Vector3D vel = get_vel();
     // total
-    energy = mon2 * vel_.norm_sq() * trapParams.energy_scale;
+    energy = mon2 * vel.norm_sq() * trapParams.energy_scale;
     ionHistogram->addIon(name() + "_total", energy);
     // x - directed
-    energy = mon2 * vel_[0] * vel_[0] * trapParams.energy_scale;
+    energy = mon2 * vel[0] * vel[0] * trapParams.energy_scale;
     ionHistogram->addIon(name() + "_x", energy);
     // y - directed
-    energy = mon2 * vel_[1] * vel_[1] * trapParams.energy_scale;
+    energy = mon2 * vel[1] * vel[1] * trapParams.energy_scale;
     ionHistogram->addIon(name() + "_y", energy);
     // z - directed
-    energy = mon2 * vel_[2] * vel_[2] * trapParams.energy_scale;
+    energy = mon2 * vel[2] * vel[2] * trapParams.energy_scale;
     ionHistogram->addIon(name() + "_z", energy);
 }
 
@@ -95,9 +107,45 @@ void Ion::recordKE(IonHistogram_ptr ionHistogram, const TrapParams& trapParams)
  *  coordinates around zero. The velocity vector is recorded as the speed.
  */
 void Ion::updateStats() {
-    double r = sqrt(pos_.x*pos_.x + pos_.y * pos_.y);
-    posStats_.append(Vector3D(r, pos_.z, 0));
-    velStats_.append(vel_.norm());
+    Vector3D pos = get_pos();
+    double r = sqrt(pos.x*pos.x + pos.y * pos.y);
+    posStats_.append(Vector3D(r, pos.z, 0));
+    velStats_.append(get_vel().norm());
+}
+
+/**
+ * @brief Write the electronic state and statistics to a checkpoint.
+ *
+ * The position and velocity are in the IonStore, saved by IonCloud.
+ */
+void Ion::save_state(CheckpointWriter& writer) const {
+    writer.write(static_cast<std::int64_t>(ElecState));
+    int count;
+    Vector3D pos_mean, pos_var;
+    double vel_mean, vel_var;
+    posStats_.get_state(count, pos_mean, pos_var);
+    writer.write(static_cast<std::int64_t>(count));
+    writer.write(pos_mean);
+    writer.write(pos_var);
+    velStats_.get_state(count, vel_mean, vel_var);
+    writer.write(static_cast<std::int64_t>(count));
+    writer.write(vel_mean);
+    writer.write(vel_var);
+}
+
+/**
+ * @brief Restore the electronic state and statistics from a checkpoint.
+ */
+void Ion::load_state(CheckpointReader& reader) {
+    ElecState = static_cast<int>(reader.read_int());
+    int count = static_cast<int>(reader.read_int());
+    Vector3D pos_mean = reader.read_vector();
+    Vector3D pos_var = reader.read_vector();
+    posStats_.set_state(count, pos_mean, pos_var);
+    count = static_cast<int>(reader.read_int());
+    double vel_mean = reader.read_double();
+    double vel_var = reader.read_double();
+    velStats_.set_state(count, vel_mean, vel_var);
 }
 
 /**
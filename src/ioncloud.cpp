@@ -11,15 +11,19 @@
 #include <algorithm>
 #include <functional>
 #include <list>
+#include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "include/checkpoint.h"
 #include "include/datawriter.h"
 #include "include/imagecollection.h"
 #include "include/ion.h"
 #include "include/ionhistogram.h"
 #include "include/logger.h"
+#include "include/snapshot.h"
 #include "include/stats.h"
 #include "include/vector3D.h"
 
@@ -27,9 +31,9 @@ class Hist3D;
 int get_nearest_cube(int n);
 std::vector<Vector3D> get_lattice(size_t n);
 
-struct compare_ions_by_mass {
-    bool operator()(const Ion_ptr& lhs, const Ion_ptr& rhs) const {
-        return lhs->get_mass() < rhs->get_mass();
+struct compare_types_by_mass {
+    bool operator()(const IonType* lhs, const IonType* rhs) const {
+        return lhs->mass < rhs->mass;
     }
 };
 
@@ -72,6 +76,14 @@ struct position_ions {
  *  in a list. The initial position of each ion is arranged on a cubic lattice,
  *  and the initial velocity is zero.
  *
+ *  # Storage
+ *
+ *  Position, velocity, mass and charge are held in the contiguous arrays of an
+ *  IonStore, with ion `i` in the list at index `i` of each array. Functions
+ *  that do the same thing to every ion, such as drift and kick with a given
+ *  force, loop directly over these arrays. The Ion objects are views onto
+ *  their entries in the store, so listeners can still work ion-by-ion.
+ *
  *  @see Ion, TrappedIon, LaserCooledIon
  */
 
@@ -91,24 +103,42 @@ struct position_ions {
  */
 IonCloud::IonCloud(const IonTrap_ptr ion_trap, const CloudParams& cp,
         const SimParams& sp, const TrapParams& tp, const LaserParams& lp)
-: cloudParams_(cp), simParams_(sp), trapParams_(tp), lp_(lp) {
-    // loop over ion types to initialise ion cloud
+: cloudParams_(cp), simParams_(sp), trapParams_(tp), lp_(lp),
+  store_(count_ions(cp)), trap_(ion_trap), fx_(store_.size()),
+  fy_(store_.size()), fz_(store_.size()) {
+    // sort ion types by mass, so the ions are created in mass order and their
+    // index in the store matches their position in the list.
+    std::vector<const IonType*> types;
     for (auto& it : cloudParams_.ion_type_list) {
+        types.push_back(&it);
+    }
+    std::stable_sort(types.begin(), types.end(), compare_types_by_mass());
+    Stochastic_heat::seed(generator_, simParams_.random_seed);
+
+    // loop over ion types to initialise ion cloud
+    size_t index = 0;
+    for (auto it : types) {
         // loop over ions number for type, construct ions using *trap to ensure
         // that changes to ion trap parameters are felt by the ions
-        for (int i = 0; i < it.number; ++i) {
-            if (it.is_laser_cooled) {
+        for (int i = 0; i < it->number; ++i, ++index) {
+            if (it->is_laser_cooled) {
                 ionVec_.push_back(
                         std::make_shared<LaserCooledIon>(
-                            ion_trap, tp, it, simParams_, lp_));
+                            ion_trap, tp, *it, generator_, lp_,
+                            store_, index));
+                cooled_.push_back(ionVec_.back());
             } else {
                 ionVec_.push_back(
-                        std::make_shared<TrappedIon>(ion_trap, it, lp_));
+                        std::make_shared<TrappedIon>(
+                            ion_trap, *it, lp_, store_, index));
             }
         }
     }
-    // sort ions by mass
-    std::sort(ionVec_.begin(), ionVec_.end(), compare_ions_by_mass() );
+
+    if (!cloudParams_.start_from.empty()) {
+        warm_start();
+        return;
+    }
 
     // generate initial positions
     std::vector<Vector3D> lattice = get_lattice(number_of_ions());
@@ -119,10 +149,7 @@ IonCloud::IonCloud(const IonTrap_ptr ion_trap, const CloudParams& cp,
                    position_ions() );
 
     // move cloud centre to the origin
-    Vector3D to_origin = -get_cloud_centre();
-    for (auto ion : ionVec_) {
-        ion->move(to_origin);
-    }
+    move_centre(-get_cloud_centre());
 
     // r02 = ion_trap->trapParams->r0;
 }
@@ -143,20 +170,52 @@ IonCloud::~IonCloud() {
  *  @param dt   Time step.
  */
 void IonCloud::drift(double dt) {
-    for (auto ion : ionVec_) {
-        ion->drift(dt);
+    const size_t n = store_.size();
+    double* x = store_.x.data();
+    double* y = store_.y.data();
+    double* z = store_.z.data();
+    const double* vx = store_.vx.data();
+    const double* vy = store_.vy.data();
+    const double* vz = store_.vz.data();
+    for (size_t i = 0; i < n; ++i) {
+        x[i] += vx[i]*dt;
+        y[i] += vy[i]*dt;
+        z[i] += vz[i]*dt;
     }
 }
 
 
 /**
- *  @brief Call the Ion::kick function on each ion.
+ *  @brief Kick each ion by the trap force, and the laser cooled ions by the
+ *  laser as well.
+ *
+ *  The same as calling Ion::kick on each ion, but the trap force on all ions
+ *  is found at once by IonTrap::force_batch, and the velocities updated in
+ *  one loop over the store. Only the laser cooled ions are then visited one
+ *  by one, for Ion::cool.
  *
  *  @param dt   Time step.
  */
 void IonCloud::kick(double dt) {
-    for (auto ion : ionVec_) {
-        ion->kick(dt);
+    const size_t n = store_.size();
+    trap_->force_batch(store_.x.data(), store_.y.data(), store_.z.data(),
+                       store_.charge.data(),
+                       fx_.data(), fy_.data(), fz_.data(), n);
+    double* vx = store_.vx.data();
+    double* vy = store_.vy.data();
+    double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
+    const double* fx = fx_.data();
+    const double* fy = fy_.data();
+    const double* fz = fz_.data();
+    for (size_t i = 0; i < n; ++i) {
+        double time_over_mass = dt/mass[i];
+        vx[i] += fx[i]*time_over_mass;
+        vy[i] += fy[i]*time_over_mass;
+        vz[i] += fz[i]*time_over_mass;
+    }
+    for (const auto& ion : cooled_) {
+        ion->cool(dt);
     }
 }
 
@@ -210,8 +269,16 @@ void IonCloud::swap_first(const IonType& from, const IonType& to) {
  *  @param f    Force vector.
  */
 void IonCloud::kick(double dt, const std::vector<Vector3D>& f) {
-    for (int i = 0; i < ionVec_.size(); ++i) {
-        ionVec_[i]->kick(dt, f[i]);
+    const size_t n = store_.size();
+    double* vx = store_.vx.data();
+    double* vy = store_.vy.data();
+    double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
+    for (size_t i = 0; i < n; ++i) {
+        double time_over_mass = dt/mass[i];
+        vx[i] += f[i].x*time_over_mass;
+        vy[i] += f[i].y*time_over_mass;
+        vz[i] += f[i].z*time_over_mass;
     }
 }
 
@@ -227,19 +294,144 @@ void IonCloud::kick(double dt, const std::vector<Vector3D>& f) {
  *  @param dt   Time step.
  */
 void IonCloud::velocity_scale(double dt) {
-    for (auto ion : ionVec_) {
+    for (const auto& ion : ionVec_) {
         ion->velocity_scale(dt);
     }
 }
 
 
+/**
+ *  @brief Kick each ion by a force linear in its position.
+ *
+ *  The force on an ion of charge Q at r is Q (c.x r.x, c.y r.y, c.z r.z), as
+ *  for the trap force with the coefficients from
+ *  IonTrap::force_coefficients.
+ *
+ *  @param dt   Time step.
+ *  @param c    Force per unit charge and displacement along each axis.
+ */
+void IonCloud::linear_kick(double dt, const Vector3D& c) {
+    const size_t n = store_.size();
+    const double* x = store_.x.data();
+    const double* y = store_.y.data();
+    const double* z = store_.z.data();
+    double* vx = store_.vx.data();
+    double* vy = store_.vy.data();
+    double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
+    const double* charge = store_.charge.data();
+    for (size_t i = 0; i < n; ++i) {
+        // The same order of operations as TrappedIon::kick.
+        double time_over_mass = dt/mass[i];
+        vx[i] += x[i]*c.x*charge[i]*time_over_mass;
+        vy[i] += y[i]*c.y*charge[i]*time_over_mass;
+        vz[i] += z[i]*c.z*charge[i]*time_over_mass;
+    }
+}
+
+
+/**
+ *  @brief Kick the listed ions by a force linear in their position, as
+ *  linear_kick of all ions.
+ *
+ *  @param dt       Time step.
+ *  @param c        Force per unit charge and displacement along each axis.
+ *  @param index    Indices in the store of the ions to kick.
+ */
+void IonCloud::linear_kick(double dt, const Vector3D& c,
+                           const std::vector<size_t>& index) {
+    const double* x = store_.x.data();
+    const double* y = store_.y.data();
+    const double* z = store_.z.data();
+    double* vx = store_.vx.data();
+    double* vy = store_.vy.data();
+    double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
+    const double* charge = store_.charge.data();
+    for (size_t i : index) {
+        double time_over_mass = dt/mass[i];
+        vx[i] += x[i]*c.x*charge[i]*time_over_mass;
+        vy[i] += y[i]*c.y*charge[i]*time_over_mass;
+        vz[i] += z[i]*c.z*charge[i]*time_over_mass;
+    }
+}
+
+
+/**
+ *  @brief Kick each ion by a force linear in its position, with coefficients
+ *  that differ from ion to ion.
+ *
+ *  @param dt           Time step.
+ *  @param cx, cy, cz   Force per unit charge and displacement of each ion.
+ */
+void IonCloud::linear_kick(double dt, const AlignedVector& cx,
+                           const AlignedVector& cy, const AlignedVector& cz) {
+    const size_t n = store_.size();
+    const double* x = store_.x.data();
+    const double* y = store_.y.data();
+    const double* z = store_.z.data();
+    double* vx = store_.vx.data();
+    double* vy = store_.vy.data();
+    double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
+    const double* charge = store_.charge.data();
+    for (size_t i = 0; i < n; ++i) {
+        double time_over_mass = dt/mass[i];
+        vx[i] += x[i]*cx[i]*charge[i]*time_over_mass;
+        vy[i] += y[i]*cy[i]*charge[i]*time_over_mass;
+        vz[i] += z[i]*cz[i]*charge[i]*time_over_mass;
+    }
+}
+
+
+/**
+ *  @brief Force coefficients of the trap pseudopotential for each ion, for
+ *  linear_kick.
+ *
+ *  IonTrap::pseudo_coefficients is found once for each charge to mass ratio.
+ *
+ *  @param cx, cy, cz   Resized and filled with the coefficients of each ion.
+ */
+void IonCloud::pseudo_coefficients(AlignedVector& cx, AlignedVector& cy,
+                                   AlignedVector& cz) const {
+    const size_t n = store_.size();
+    cx.resize(n);
+    cy.resize(n);
+    cz.resize(n);
+    std::map<double, Vector3D> species;
+    for (size_t i = 0; i < n; ++i) {
+        const double charge_over_mass = store_.charge[i]/store_.mass[i];
+        auto found = species.find(charge_over_mass);
+        if (found == species.end()) {
+            found = species.emplace(charge_over_mass,
+                    trap_->pseudo_coefficients(charge_over_mass)).first;
+        }
+        cx[i] = found->second.x;
+        cy[i] = found->second.y;
+        cz[i] = found->second.z;
+    }
+}
+
+
+/**
+ *  @brief Call the Ion::cool function on each ion.
+ *
+ *  @param dt   Time step.
+ */
+void IonCloud::cool(double dt) {
+    for (const auto& ion : ionVec_) {
+        ion->cool(dt);
+    }
+}
+
+
 /**
  *  @brief Call the Ion::heat function on each ion.
  *
  *  @param dt   Time step.
  */
 void IonCloud::heat(double dt) {
-    for (auto ion : ionVec_) {
+    for (const auto& ion : ionVec_) {
         ion->heat(dt);
     }
 }
@@ -253,11 +445,14 @@ void IonCloud::heat(double dt) {
  *  @return The total kinetic energy.
  */
 double IonCloud::kinetic_energy() const {
+    const size_t n = store_.size();
+    const double* vx = store_.vx.data();
+    const double* vy = store_.vy.data();
+    const double* vz = store_.vz.data();
+    const double* mass = store_.mass.data();
     double e = 0;
-    double m;
-    for (auto ion : ionVec_) {
-        m = ion->get_mass();
-        e += 0.5*m*(ion->get_vel().norm_sq());
+    for (size_t i = 0; i < n; ++i) {
+        e += 0.5*mass[i]*(vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i]);
     }
     return e;
 }
@@ -271,26 +466,28 @@ double IonCloud::kinetic_energy() const {
  *  @return The total Coulomb energy.
  */
 double IonCloud::coulomb_energy() const {
-    Vector3D r1, r2;
-    int q1, q2;
+    const size_t n = store_.size();
+    const double* x = store_.x.data();
+    const double* y = store_.y.data();
+    const double* z = store_.z.data();
+    const double* q = store_.charge.data();
     double e = 0;
-    double r;
 
-    for (int i = 0; i < ionVec_.size(); ++i) {
-        r1 = ionVec_[i]->get_pos();
-        q1 = ionVec_[i]->get_charge();
-        for (int j = i+1; j < ionVec_.size(); ++j) {
-            r2 = ionVec_[j]->get_pos();
-            q2 = ionVec_[j]->get_charge();
-
-            if (r1 != r2) {
-                r = Vector3D::dist(r1, r2);
-            } else {
-                std::cout << i << ' ' << r1 << ' ' << j << ' ' << r2 << '\n';
+    for (size_t i = 0; i < n; ++i) {
+        double ei = 0;
+        for (size_t j = i+1; j < n; ++j) {
+            double dx = x[i] - x[j];
+            double dy = y[i] - y[j];
+            double dz = z[i] - z[j];
+            double r2 = dx*dx + dy*dy + dz*dz;
+            if (r2 == 0.0) {
+                std::cout << i << ' ' << store_.get_pos(i) << ' '
+                          << j << ' ' << store_.get_pos(j) << '\n';
                 std::abort();
             }
-        e += q1*q2/r;
+            ei += q[j]/std::sqrt(r2);
         }
+        e += q[i]*ei;
     }
     return e;
 }
@@ -315,7 +512,7 @@ double IonCloud::total_energy() const {
  *  @param dt   Time step.
  */
 void IonCloud::updateStats() {
-    for (auto ion : ionVec_) {
+    for (const auto& ion : ionVec_) {
         ion->updateStats();
     }
 }
@@ -524,10 +721,10 @@ double IonCloud::aspect_ratio() const {
     double y_max = 0.0;
     double z_max = 0.0;
 
-    for (auto ion : ionVec_) {
-        x_max = std::max(x_max, std::abs(ion->get_pos().x) );
-        y_max = std::max(y_max, std::abs(ion->get_pos().y) );
-        z_max = std::max(z_max, std::abs(ion->get_pos().z) );
+    for (size_t i = 0; i < store_.size(); ++i) {
+        x_max = std::max(x_max, std::abs(store_.x[i]) );
+        y_max = std::max(y_max, std::abs(store_.y[i]) );
+        z_max = std::max(z_max, std::abs(store_.z[i]) );
     }
     return z_max/std::max(x_max, y_max);
 
@@ -566,6 +763,28 @@ double IonCloud::aspect_ratio() const {
 
 // Utility functions for generating initial positions
 
+/**
+ *  @brief Start each species from the positions and velocities of the same
+ *  species in an earlier run, as they were, without moving the centre.
+ */
+void IonCloud::warm_start() {
+    Snapshot snapshot(cloudParams_.start_from, cloudParams_, trapParams_);
+    for (auto& type : cloudParams_.ion_type_list) {
+        std::vector<Vector3D> pos;
+        std::vector<Vector3D> vel;
+        snapshot.take(type.name, type.number, pos, vel);
+        size_t k = 0;
+        for (auto ion : ionVec_) {
+            if (ion->name() != type.name)
+                continue;
+            ion->set_position(pos[k]);
+            ion->set_velocity(vel[k]);
+            ion->set_ElecState(0);
+            ++k;
+        }
+    }
+}
+
 /**
  *  @brief Determine the coordinates of an \c n item lattice.
  *
@@ -635,13 +854,96 @@ int IonCloud::get_nearest_cube(int n) {
 Vector3D IonCloud::get_cloud_centre() const {
     // unweighted geometric centre of ion cloud
     Vector3D centre;
-    double n_ions = ionVec_.size();
+    double n_ions = store_.size();
 
-    for (auto ion : ionVec_) {
-        centre += ion->get_pos();
+    for (size_t i = 0; i < store_.size(); ++i) {
+        centre += store_.get_pos(i);
     }
 
     centre /= n_ions;
     return centre;
 }
 
+
+/**
+ *  @brief Shift every ion in the cloud by the same vector.
+ *
+ *  @param v    Displacement vector.
+ */
+void IonCloud::move_centre(const Vector3D& v) {
+    for (size_t i = 0; i < store_.size(); ++i) {
+        store_.x[i] += v.x;
+        store_.y[i] += v.y;
+        store_.z[i] += v.z;
+    }
+}
+
+
+/**
+ *  @brief Count the total number of ions of all types.
+ *
+ *  Used to size the IonStore before the ions are constructed.
+ *
+ *  @param cp   Cloud parameters listing the number of each ion type.
+ *  @return     Total number of ions.
+ */
+size_t IonCloud::count_ions(const CloudParams& cp) {
+    size_t n = 0;
+    for (auto& it : cp.ion_type_list) {
+        n += it.number;
+    }
+    return n;
+}
+
+
+/**
+ *  @brief Write the ion positions and velocities, the state of each ion and
+ *  the random number generator to a checkpoint.
+ *
+ *  @param writer   Checkpoint being written.
+ */
+void IonCloud::save_state(CheckpointWriter& writer) const {
+    writer.write(store_.mass);
+    writer.write(store_.charge);
+    writer.write(store_.x);
+    writer.write(store_.y);
+    writer.write(store_.z);
+    writer.write(store_.vx);
+    writer.write(store_.vy);
+    writer.write(store_.vz);
+    for (const auto& ion : ionVec_) {
+        ion->save_state(writer);
+    }
+    Stochastic_heat::save_generator(writer, generator_);
+}
+
+
+/**
+ *  @brief Restore the ions from a checkpoint.
+ *
+ *  The cloud must hold the same ions, in the same order, as when the
+ *  checkpoint was written.
+ *
+ *  @param reader   Checkpoint being read.
+ */
+void IonCloud::load_state(CheckpointReader& reader) {
+    AlignedVector mass(store_.size());
+    AlignedVector charge(store_.size());
+    reader.read(mass);
+    reader.read(charge);
+    if (mass != store_.mass || charge != store_.charge) {
+        Logger& log = Logger::getInstance();
+        log.error("The checkpoint holds different ions to the ion cloud.");
+        throw std::runtime_error("Checkpoint does not match the ion cloud");
+    }
+    reader.read(store_.x);
+    reader.read(store_.y);
+    reader.read(store_.z);
+    reader.read(store_.vx);
+    reader.read(store_.vy);
+    reader.read(store_.vz);
+    for (const auto& ion : ionVec_) {
+        ion->load_state(reader);
+    }
+    Stochastic_heat::load_generator(reader, generator_);
+}
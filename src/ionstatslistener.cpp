@@ -1,6 +1,7 @@
 #include "include/ionstatslistener.h"
 #include "include/datawriter.h"
 #include "include/logger.h"
+#include "include/snapshot.h"
 
 /**
  * @class IonStatsListener
@@ -103,6 +104,11 @@ void IonStatsListener::finished() {
 
         writer.writeRow(name, rowdata);
     }
+    // The same positions and velocities at full precision, to start another
+    // run from.
+    Snapshot::write(base_path_ + "snapshot.bin", *ions_, cloud_params_,
+                    trap_params_);
+
     has_finished_ = true;
     log_.debug("Finished IonStatsListener.");
 }
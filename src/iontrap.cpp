@@ -17,9 +17,15 @@
 
 #include "include/iontrap.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 #include "include/ccmdsim.h"
+#include "include/checkpoint.h"
+#include "include/logger.h"
 
 /** @brief Over-precise value of pi. */
 const double IonTrap::pi = 3.141592653589793238462643383279502884;
@@ -44,6 +50,10 @@ IonTrap::IonTrap(const TrapParams& params)
     : params_(params) {
     // Start at zero-time
     time_now_ = 0.0;
+    tick_ = 0.0;
+    ticks_per_time_ = 0.0;
+    tick_count_ = 0;
+    table_index_ = 0;
 
     // Calculate derived quantities
     double omega = 2*pi*params_.freq;
@@ -52,3 +62,238 @@ IonTrap::IonTrap(const TrapParams& params)
     q_unit_mass_ =  2.0*electron_charge*params_.v_rf
         /(u_mass*omega*omega*params_.r0*params_.r0);
 }
+
+
+/**
+ *  @brief Tabulate the phase over one period, for time steps that are whole
+ *  multiples of \c tick.
+ *
+ *  When the RF period is a whole number of ticks the phase repeats, so
+ *  phase_at need only be found once for each tick of the first period. After
+ *  this, evolve looks up the phase by a tick counter, and the time is found
+ *  from the counter rather than by adding up time steps, so it does not
+ *  drift. The phase and time then differ at rounding level from those found
+ *  by adding up the time steps, so the output of every trap type, the plain
+ *  cosine trap included, changes in the last digits. Without a table, or if
+ *  the period is not a whole number of ticks, the trap falls back to
+ *  phase_at.
+ *
+ *  @param tick     The smallest step the integrator will evolve the trap by.
+ */
+void IonTrap::use_phase_table(double tick) {
+    // Limit on the table length, for a period much longer than the RF period.
+    const double max_entries = 1 << 20;
+    Logger& log = Logger::getInstance();
+    phase_table_.clear();
+    const double ticks = period()/tick;
+    const double entries = std::round(ticks);
+    const double elapsed = std::round(time_now_/tick);
+    if (entries < 1 || entries > max_entries
+            || std::abs(ticks - entries) > 1e-9*entries
+            || std::abs(time_now_ - elapsed*tick) > 1e-9*tick) {
+        log.info("RF phase is not periodic in the time step, "
+                 "no phase table.");
+        return;
+    }
+    tick_ = tick;
+    ticks_per_time_ = 1.0/tick;
+    tick_count_ = static_cast<std::uint64_t>(elapsed);
+    phase_table_.resize(static_cast<size_t>(entries));
+    for (size_t i = 0; i < phase_table_.size(); ++i) {
+        phase_table_[i] = phase_at(i*tick);
+    }
+    table_index_ = tick_count_ % phase_table_.size();
+    log.info("RF phase table of " + std::to_string(phase_table_.size())
+             + " points.");
+}
+
+
+/**
+ *  @brief Move the trap time forward by \c dt.
+ *
+ *  With a phase table, a step of a whole number of ticks moves the tick
+ *  counter and the time is set from it. Any other step switches the table off
+ *  and adds \c dt to the time.
+ *
+ *  @param dt   Time step.
+ *  @return True if table_phase() holds the phase at the new time.
+ */
+bool IonTrap::advance(double dt) {
+    if (!phase_table_.empty()) {
+        const double ticks = dt*ticks_per_time_;
+        const double steps = std::round(ticks);
+        if (steps >= 0
+                && std::abs(ticks - steps) < 1e-9*std::max(steps, 1.0)) {
+            const size_t n = static_cast<size_t>(steps);
+            tick_count_ += n;
+            table_index_ += n;
+            while (table_index_ >= phase_table_.size())
+                table_index_ -= phase_table_.size();
+            time_now_ = tick_count_*tick_;
+            return true;
+        }
+        Logger& log = Logger::getInstance();
+        log.warn("Trap time step is not a whole number of phase table "
+                 "ticks, phase table switched off.");
+        phase_table_.clear();
+    }
+    time_now_ += dt;
+    return false;
+}
+
+
+/**
+ *  @brief The trap force per unit charge and displacement on each axis.
+ *
+ *  Every trap force is linear and diagonal in position: the force on an ion
+ *  of charge Q at r is Q (c.x r.x, c.y r.y, c.z r.z), with the coefficients
+ *  c set by the current phase from get_phase().
+ *
+ *  @return The coefficients c as a vector.
+ */
+Vector3D IonTrap::force_coefficients() {
+    return coefficients_at(get_phase());
+}
+
+
+/**
+ *  @brief The trap force on a whole array of ions.
+ *
+ *  The coefficients are found once for the current phase, then applied to
+ *  every ion in a single loop that the compiler vectorises. The force on
+ *  each ion is the same as force_now times its charge.
+ *
+ *  @param x, y, z      Position components of each ion.
+ *  @param charge       Charge of each ion.
+ *  @param fx, fy, fz   Set to the force components on each ion.
+ *  @param n            Number of ions.
+ */
+void IonTrap::force_batch(const double* x, const double* y, const double* z,
+                          const double* charge,
+                          double* fx, double* fy, double* fz, size_t n) {
+    const Vector3D c = force_coefficients();
+    for (size_t i = 0; i < n; ++i) {
+        fx[i] = x[i]*c.x*charge[i];
+        fy[i] = y[i]*c.y*charge[i];
+        fz[i] = z[i]*c.z*charge[i];
+    }
+}
+
+
+/**
+ *  @brief The force coefficients of the time-averaged pseudopotential, for an
+ *  ion of a given charge to mass ratio.
+ *
+ *  Over one period the phase p(t) has a mean P and an oscillating part whose
+ *  zero-mean integral is W(t). The ion sees the force of the mean phase, plus
+ *  the restoring force of the micromotion driven by the oscillating part,
+ *  which depends on the charge to mass ratio:
+ *
+ *      c.x = 2 q P - a - 4 q^2 (Q/m) <W^2>
+ *      c.y = -2 q P - a - 4 q^2 (Q/m) <W^2>
+ *      c.z = 2 a
+ *
+ *  For a cosine trap <W^2> = 1/8, the usual q^2/2 term of the secular
+ *  frequency. The averages are found numerically from phase_at, so any
+ *  periodic waveform works.
+ *
+ *  @param charge_over_mass     Ion charge over mass, in simulation units.
+ *  @return Coefficients c, for a force Q (c.x r.x, c.y r.y, c.z r.z).
+ */
+Vector3D IonTrap::pseudo_coefficients(double charge_over_mass) const {
+    const int samples = 4096;
+    const double T = period();
+    if (T <= 0.0) {
+        Logger& log = Logger::getInstance();
+        log.error("The trap waveform is not periodic, so has no "
+                  "pseudopotential.");
+        throw std::runtime_error("No pseudopotential for this trap");
+    }
+    const double h = T/samples;
+    std::vector<double> phase(samples);
+    double mean = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        phase[i] = phase_at((i + 0.5)*h);
+        mean += phase[i];
+    }
+    mean /= samples;
+    // Integral of the oscillating part, at the middle of each sample.
+    std::vector<double> integral(samples);
+    double sum = 0.0;
+    double integral_mean = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        integral[i] = sum + 0.5*(phase[i] - mean)*h;
+        sum += (phase[i] - mean)*h;
+        integral_mean += integral[i];
+    }
+    integral_mean /= samples;
+    double variance = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        double w = integral[i] - integral_mean;
+        variance += w*w;
+    }
+    variance /= samples;
+    const double micromotion =
+        4*q_unit_mass_*q_unit_mass_*charge_over_mass*variance;
+    return Vector3D(+2*q_unit_mass_*mean - a_unit_mass_ - micromotion,
+                    -2*q_unit_mass_*mean - a_unit_mass_ - micromotion,
+                    2*a_unit_mass_);
+}
+
+
+/**
+ *  @brief Write the trap time and phase to a checkpoint.
+ */
+void IonTrap::save_state(CheckpointWriter& writer) const {
+    writer.write(time_now_);
+    writer.write(get_phase());
+}
+
+
+/**
+ *  @brief Restore the trap time and phase from a checkpoint.
+ *
+ *  The phase is restored as saved rather than found again, as it is not
+ *  yet set before the trap first evolves. The tick counter of the phase
+ *  table follows from the time when the integrator sets up the table.
+ */
+void IonTrap::load_state(CheckpointReader& reader) {
+    time_now_ = reader.read_double();
+    set_phase(reader.read_double());
+    phase_table_.clear();
+}
+
+
+/**
+ *  @brief Construct the trap of the type given in the trap parameters.
+ *
+ *  The decay parameters of a decaying cosine trap are converted to simulation
+ *  time units here; the wait before the decay is counted from the start of
+ *  the histogram stage, see CosineDecayTrap::begin_histogram.
+ *
+ *  @param params               Trap parameters, converted in place.
+ *  @param integration_params   Integration parameters.
+ *  @return Pointer to the new trap.
+ */
+IonTrap_ptr make_trap(TrapParams& params,
+                      const IntegrationParams& integration_params) {
+    if (params.wave == params.cosine) {
+        return std::make_shared<CosineTrap>(params);
+    } else if (params.wave == params.digital) {
+        return std::make_shared<PulsedTrap>(params);
+    } else if (params.wave == params.waveform) {
+        return std::make_shared<WaveformTrap>(params);
+    } else if (params.wave == params.cosine_decay) {
+        // have to do some unit conversions here for the decay params
+        const double PI = 3.1415926535897932;
+        params.tau *= PI;
+        params.deltaT = integration_params.hist_steps
+            *integration_params.time_step - params.deltaT*PI;
+        return std::make_shared<CosineDecayTrap>(params);
+    } else if (params.wave == params.twofreq) {
+        return std::make_shared<TwoFreq_trap>(params);
+    }
+    Logger& log = Logger::getInstance();
+    log.error("Unrecognised trap type");
+    throw std::runtime_error("Unrecognised trap type");
+}
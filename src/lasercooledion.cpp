@@ -14,11 +14,20 @@
  *
  *  Heating term arising from photon recoil is implemented as a Langevin process
  *  with a Gaussian momentum distribution.
+ *
+ *  Photon absorption and emission are applied either by testing for an event
+ *  in each 1 ns of the time step, or, with LaserParams::events, as kinetic
+ *  Monte Carlo: each ion keeps the integrated scattering rate left until its
+ *  next event, drawn from a unit exponential distribution, and a time step
+ *  with no event costs only the rate. The rates are held fixed over each call
+ *  to cool, and found again after each event. Emission uses the natural
+ *  lifetime 1/A21.
  */
 
 #include "include/ion.h"
 
 #include "include/ccmdsim.h"
+#include "include/checkpoint.h"
 
 #include <math.h>
 
@@ -26,6 +35,7 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <cmath>
 
 #include "include/vector3D.h"
@@ -36,23 +46,46 @@
  *  `TrappedIon` parent class, and laser cooling parameters are stored.
  *  @param ion_trap A pointer to the ion trap.
  *  @param type     A pointer to ion parameters.
+ *  @param generator    Random number generator of the ion cloud.
+ *  @param store    Arrays holding the ion data.
+ *  @param index    Index of this ion in the store.
  */
-LaserCooledIon::LaserCooledIon(const IonTrap_ptr ion_trap,const TrapParams& trap_params, const IonType& type, const SimParams& sp, const LaserParams& lp): 
-	TrappedIon(ion_trap, type, lp), heater_(sp.random_seed), trap_params(trap_params) {
+LaserCooledIon::LaserCooledIon(const IonTrap_ptr ion_trap,const TrapParams& trap_params, const IonType& type, std::mt19937& generator, const LaserParams& lp, IonStore& store, size_t index):
+	TrappedIon(ion_trap, type, lp, store, index), heater_(generator), trap_params(trap_params),
+    hazard_(-1.0) {
     heater_.set_kick_size(sqrt(ionType_.recoil));
+
+    // Constants of fscatt, in simulation units.
+    const double pi = 3.14159265359;
+    const double IdIsat = 1;
+    Gamma_ = ionType_.A21*trap_params.time_scale;
+    delta_ = lp_.delta*trap_params.time_scale;
+    k_ = (2*pi*trap_params.length_scale) / lp_.wavelength;
+    rate_scale_ = 0.5 * (Gamma_*Gamma_*Gamma_);
+    rate_scale_ *= IdIsat;
 }
 
 /**
  *  @brief Change the ion velocity due to the laser cooling and trapping forces.
  *  The trapping force is handled first by calling the parent class kick
- *  function. The radiation pressure and friction force (cooling) are calculated
- *  and applied.
+ *  function. The radiation pressure and friction force (cooling) are then
+ *  applied by cool.
  *
  *  @param dt   Time step.
  */
 inline void LaserCooledIon::kick(double dt) {
     this->TrappedIon::kick(dt);
+    cool(dt);
+}
 
+/**
+ *  @brief Change the ion velocity due to the laser alone.
+ *  Applies the radiation pressure and the photon scattering of kick, without
+ *  the trapping force.
+ *
+ *  @param dt   Time step.
+ */
+void LaserCooledIon::cool(double dt) {
     // 1D radiation pressure force.
     Vector3D pressure(0.0, 0.0, 0.015);
     // Randomly apply pressure from positive or negative \c z direction,
@@ -62,8 +95,12 @@ inline void LaserCooledIon::kick(double dt) {
     else
         this->Ion::kick(dt, -pressure);
 
+    if (lp_.scattering == LaserParams::events) {
+        scatter_events(dt);
+        return;
+    }
+
     const double dtred = dt;
-    const double force_scale = std::pow(trap_params.energy_scale, 0.5)/trap_params.time_scale;
     // 1D Laser cooling friction force
     // This force must be evaluated last to allow its effect to be
     // undone by the call to velocity_scale
@@ -89,6 +126,42 @@ inline void LaserCooledIon::kick(double dt) {
     return;
 }
 
+/**
+ *  @brief Apply the photon absorptions and emissions in a time \c dt as
+ *  events, at times drawn from the scattering rates.
+ *
+ *  As in the stepped loop of cool, only the beam with the larger scattering
+ *  rate is absorbed from, and each event changes the velocity by the same
+ *  amount.
+ *
+ *  @param dt   Time step.
+ */
+void LaserCooledIon::scatter_events(double dt) {
+    const double amu = 1.66053904e-27;
+    double remaining = dt;
+    for (;;) {
+        const double fs1 = fscatt(1);
+        const double fs2 = fscatt(-1);
+        const double absorb = std::max(fs1, fs2);
+        const double rate = (ElecState == 1) ? absorb + Gamma_ : absorb;
+        if (hazard_ < 0.0)
+            hazard_ = heater_.exponential();
+        if (hazard_ >= rate*remaining) {
+            hazard_ -= rate*remaining;
+            return;
+        }
+        remaining -= hazard_/rate;
+        hazard_ = -1.0;
+
+        Vector3D f;
+        if (ElecState == 1)
+            f = Emit(dt)*1.0/(ionType_.mass*amu);
+        else
+            f = Absorb(dt)*((fs1 > fs2) ? -1.0 : 1.0)/(ionType_.mass*amu);
+        this->Ion::kick(1.0, f);
+    }
+}
+
 /**
  * @brief Find the stimulated emission/absorption probability based on the spontaneous emission probability and information about the
  * laser beam
@@ -97,18 +170,8 @@ inline void LaserCooledIon::kick(double dt) {
  * @param type	A pointer to the ion parameters 
  */
 double LaserCooledIon::fscatt(double LaserDirection) {
-    
-    const double pi = 3.14159265359;
-    double Gamma = ionType_.A21*trap_params.time_scale;
-    const double IdIsat = 1;
-    double delta = lp_.delta*trap_params.time_scale;
-	const double k = (2*pi*trap_params.length_scale) / lp_.wavelength ;
-    
-    double gamma = 0.5 * (Gamma*Gamma*Gamma);
-    gamma *= IdIsat;
-    const double x = delta - LaserDirection*vel_.z * k;
-    gamma /= (Gamma*Gamma + (4 * x*x));
-    return gamma;	
+    const double x = delta_ - LaserDirection*store_.vz[index_] * k_;
+    return rate_scale_ / (Gamma_*Gamma_ + (4 * x*x));
 }
 
 /**
@@ -138,7 +201,7 @@ Vector3D LaserCooledIon::Absorb(double dt){
  *  @return Friction vector.
  */
 Vector3D LaserCooledIon::get_friction() const {
-    return Vector3D(0.0, 0.0, ionType_.mass*ionType_.beta*vel_.z);
+    return Vector3D(0.0, 0.0, ionType_.mass*ionType_.beta*store_.vz[index_]);
     assert(false);
 }
 
@@ -165,7 +228,26 @@ void LaserCooledIon::velocity_scale(double dt) {
 
     // Eqn. 3.7
     // vel_.z /= 1.0 + two_dt*dt*ionType_.beta/ionType_.mass;
-    vel_.z /= 1.0 + dt*ionType_.beta/ionType_.mass;
+    store_.vz[index_] /= 1.0 + dt*ionType_.beta/ionType_.mass;
+}
+
+/**
+ *  @brief Write the ion state and the state of its random numbers to a
+ *  checkpoint.
+ */
+void LaserCooledIon::save_state(CheckpointWriter& writer) const {
+    Ion::save_state(writer);
+    heater_.save_state(writer);
+    writer.write(hazard_);
+}
+
+/**
+ *  @brief Restore the ion state and its random numbers from a checkpoint.
+ */
+void LaserCooledIon::load_state(CheckpointReader& reader) {
+    Ion::load_state(reader);
+    heater_.load_state(reader);
+    hazard_ = reader.read_double();
 }
 
 /**
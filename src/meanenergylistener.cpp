@@ -3,13 +3,18 @@
 
 #include <math.h>
 
+#include <cmath>
 #include <list>
+#include <vector>
 
 /**
  * @class MeanEnergyListener
  * @brief Stores mean of all ions' kinetic energy over an RF cycle. Writes each
  * cycle mean to text file.
  *
+ * The mean over all the steps of each RF period is kept for the convergence
+ * test of IntegrationParams::convergence, which lets the cooling stage end as
+ * soon as the crystal has equilibrated; see converged().
  */
 
 MeanEnergyListener::MeanEnergyListener(const IntegrationParams& int_params,
@@ -17,13 +22,18 @@ MeanEnergyListener::MeanEnergyListener(const IntegrationParams& int_params,
                            std::string stats_file)
     : int_params_(int_params), trap_params_(trap_params), writer_(","),
     stats_file_(stats_file), log_(Logger::getInstance()) {
-        write_every_ = int_params_.steps_per_period;
+        write_every_ = int_params_.cool_steps_per_period;
         energy_row_ = 0;
+        period_sum_ = 0.0;
+        period_count_ = 0;
         log_.debug("Started MeanEnergyListener");
 }
 
 void MeanEnergyListener::update(const int i) {
-    mean_energy_.append(ions_->kinetic_energy());
+    const double ke = ions_->kinetic_energy();
+    mean_energy_.append(ke);
+    period_sum_ += ke;
+    ++period_count_;
     int testvariance = 0;
     if (i%write_every_==0) {
         std::list<double> rowdata;
@@ -35,11 +45,118 @@ void MeanEnergyListener::update(const int i) {
             rowdata.push_back(mean_energy_.average() * trap_params_.energy_scale);
             rowdata.push_back(mean_energy_.variance() * trap_params_.energy_scale);
             writer_.writeRow(stats_file_, rowdata);
+            if (int_params_.convergence != IntegrationParams::fixed) {
+                history_.push_back(period_sum_/period_count_);
+                if (history_.size() > 2*static_cast<size_t>(
+                        int_params_.convergence_window))
+                    history_.pop_front();
+            }
+            period_sum_ = 0.0;
+            period_count_ = 0;
     }
         mean_energy_.reset();
 }
 
+/**
+ * @brief Carry on the file of an interrupted run from a checkpoint after
+ * \c n_iter steps, dropping any rows written after the checkpoint.
+ *
+ * @param n_iter    Steps taken before the checkpoint.
+ * @param state     The state() of the convergence test at the checkpoint.
+ */
+void MeanEnergyListener::resume(int n_iter, const std::vector<double>& state) {
+    energy_row_ = (n_iter + write_every_ - 1)/write_every_;
+    writer_.keepRows(stats_file_, energy_row_);
+    if (state.size() >= 2) {
+        history_.assign(state.begin(), state.end() - 2);
+        period_sum_ = state[state.size() - 2];
+        period_count_ = static_cast<int>(state.back());
+    }
+}
+
+/**
+ * @brief The energies of the convergence test, followed by the sum and number
+ * of steps of the period so far, to save in a checkpoint.
+ */
+std::vector<double> MeanEnergyListener::state() const {
+    std::vector<double> state(history_.begin(), history_.end());
+    state.push_back(period_sum_);
+    state.push_back(period_count_);
+    return state;
+}
+
+/**
+ * @brief Whether the cooling energy has stopped changing.
+ *
+ * With a window of w periods, the \c plateau test compares the mean energy of
+ * the last w periods with that of the w before, and the \c slope test fits a
+ * straight line to the last w periods by least squares. The energy has
+ * converged once the difference of the means, or the change along the line
+ * over the window, is less than IntegrationParams::convergence_tolerance of
+ * the mean energy of the last window. The change is taken as its size plus
+ * twice its standard error, so that a noisy series does not pass by chance
+ * while it is still drifting. Until there are enough periods, and always for
+ * the \c fixed test, it has not.
+ */
+bool MeanEnergyListener::converged() const {
+    const size_t w = int_params_.convergence_window;
+    const double tolerance = int_params_.convergence_tolerance;
+    if (int_params_.convergence == IntegrationParams::plateau) {
+        if (history_.size() < 2*w)
+            return false;
+        double before = 0.0;
+        double last = 0.0;
+        for (size_t i = 0; i < w; ++i) {
+            before += history_[i];
+            last += history_[w + i];
+        }
+        before /= w;
+        last /= w;
+        double var_before = 0.0;
+        double var_last = 0.0;
+        for (size_t i = 0; i < w; ++i) {
+            var_before += (history_[i] - before)*(history_[i] - before);
+            var_last += (history_[w + i] - last)*(history_[w + i] - last);
+        }
+        const double error = std::sqrt((var_before + var_last)/(w - 1)/w);
+        return std::abs(last - before) + 2*error <= tolerance*std::abs(last);
+    } else if (int_params_.convergence == IntegrationParams::slope) {
+        if (history_.size() < w)
+            return false;
+        const size_t first = history_.size() - w;
+        const double centre = (w - 1)/2.0;
+        double mean = 0.0;
+        for (size_t i = 0; i < w; ++i)
+            mean += history_[first + i];
+        mean /= w;
+        double sxy = 0.0;
+        double sxx = 0.0;
+        for (size_t i = 0; i < w; ++i) {
+            sxy += (i - centre)*(history_[first + i] - mean);
+            sxx += (i - centre)*(i - centre);
+        }
+        const double slope = sxy/sxx;
+        double residual = 0.0;
+        for (size_t i = 0; i < w; ++i) {
+            const double r = history_[first + i] - mean - slope*(i - centre);
+            residual += r*r;
+        }
+        const double change = slope*(w - 1);
+        const double error = std::sqrt(residual/(w - 2)/sxx)*(w - 1);
+        return std::abs(change) + 2*error <= tolerance*std::abs(mean);
+    }
+    return false;
+}
+
+/**
+ * @brief Write the rows so far to the file, on writing a checkpoint.
+ */
+void MeanEnergyListener::flush() {
+    writer_.flush();
+}
+
 void MeanEnergyListener::finished() {
+    writer_.flush();
     std::cout<<"\n";
     log_.debug("Finished MeanEnergyListener.");
 }
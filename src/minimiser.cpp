@@ -0,0 +1,198 @@
+/**
+ * @file minimiser.cpp
+ * @brief Function definitions for relaxing the starting ions to a minimum of
+ * the pseudopotential and Coulomb energy.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+/**
+ *  @class Minimiser
+ *
+ *  The ions start on the cubic lattice of IonCloud::get_lattice, far from the
+ *  shape of the crystal, and the cooling stage spends much of its time
+ *  letting the lattice melt and the laser remove the energy released. A
+ *  Coulomb crystal is close to a minimum of the energy
+ *
+ *      U = -1/2 sum_i Q_i (c.x x_i^2 + c.y y_i^2 + c.z z_i^2)
+ *          + sum_{i<j} Q_i Q_j / r_ij
+ *
+ *  of IonTrap::pseudo_coefficients and the Coulomb force, which the Fast
+ *  Inertial Relaxation Engine finds with only the forces:
+ *
+ *  > E. Bitzek, P. Koskinen, F. Gaehler, M. Moseler and P. Gumbsch,
+ *  > Phys. Rev. Lett. 97, 170201 (2006)
+ *
+ *  The ions move as in molecular dynamics with their masses, and the velocity
+ *  is turned towards the force at each step. The time step grows while the
+ *  ions keep going downhill, and the ions are stopped and the step cut when
+ *  they go uphill. The time step starts at IntegrationParams::cool_time_step.
+ *
+ *  The ions finish at rest, at the minimum nearest the starting positions.
+ *  This is not the true crystal structure for a large cloud, but its size and
+ *  shape are right, so the cooling stage only has to find the structure.
+ */
+
+#include "include/minimiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "include/ccmdsim.h"
+#include "include/logger.h"
+
+const int Minimiser::n_min_ = 5;
+const double Minimiser::dt_grow_ = 1.1;
+const double Minimiser::dt_shrink_ = 0.5;
+const double Minimiser::dt_max_factor_ = 10.0;
+const double Minimiser::alpha_start_ = 0.1;
+const double Minimiser::alpha_shrink_ = 0.99;
+
+
+/**
+ *  @brief Prepare to relax the ions of a cloud.
+ *
+ *  @param ic       Pointer to ion cloud object.
+ *  @param params   Integration parameters; uses relax_steps,
+ *                  relax_tolerance and cool_time_step.
+ *  @param sp       Simulation parameters, for the Coulomb force.
+ */
+Minimiser::Minimiser(const IonCloud_ptr ic, const IntegrationParams& params,
+                     const SimParams& sp)
+    : ions_(ic), coulomb_(ic, sp), params_(params),
+      fx_(ic->get_store().size()), fy_(ic->get_store().size()),
+      fz_(ic->get_store().size()), coulomb_rms_(0.0) {
+    ions_->pseudo_coefficients(cx_, cy_, cz_);
+    coulomb_.calculate_energy(true);
+}
+
+
+/**
+ *  @brief Find the force on each ion at the current positions, with the
+ *  energy.
+ */
+void Minimiser::update_force() {
+    coulomb_.update();
+    const std::vector<Vector3D>& fc = coulomb_.get_force();
+    const IonStore& store = ions_->store_;
+    double sum = 0.0;
+    for (size_t i = 0; i < store.size(); ++i) {
+        fx_[i] = fc[i].x + store.charge[i]*cx_[i]*store.x[i];
+        fy_[i] = fc[i].y + store.charge[i]*cy_[i]*store.y[i];
+        fz_[i] = fc[i].z + store.charge[i]*cz_[i]*store.z[i];
+        sum += fc[i].norm_sq();
+    }
+    coulomb_rms_ = std::sqrt(sum/store.size());
+}
+
+
+/**
+ *  @brief Pseudopotential and Coulomb energy at the last force update.
+ */
+double Minimiser::energy() {
+    const IonStore& store = ions_->store_;
+    double u = coulomb_.get_energy();
+    for (size_t i = 0; i < store.size(); ++i) {
+        u -= 0.5*store.charge[i]*(cx_[i]*store.x[i]*store.x[i]
+                                  + cy_[i]*store.y[i]*store.y[i]
+                                  + cz_[i]*store.z[i]*store.z[i]);
+    }
+    return u;
+}
+
+
+/**
+ *  @brief Move the ions downhill until the RMS force is below
+ *  IntegrationParams::relax_tolerance of the RMS Coulomb force, or for at
+ *  most IntegrationParams::relax_steps steps, and leave them at rest.
+ */
+void Minimiser::relax() {
+    Logger& log = Logger::getInstance();
+    IonStore& store = ions_->store_;
+    const size_t n = store.size();
+    const double energy_scale = ions_->trapParams_.energy_scale;
+
+    std::fill(store.vx.begin(), store.vx.end(), 0.0);
+    std::fill(store.vy.begin(), store.vy.end(), 0.0);
+    std::fill(store.vz.begin(), store.vz.end(), 0.0);
+    update_force();
+    const double start_energy = energy();
+
+    double dt = params_.cool_time_step;
+    const double dt_max = dt_max_factor_*dt;
+    double alpha = alpha_start_;
+    int downhill = 0;
+    int step = 0;
+    double force_sq = 0.0;
+    for (;; ++step) {
+        double power = 0.0;
+        force_sq = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            power += fx_[i]*store.vx[i] + fy_[i]*store.vy[i]
+                     + fz_[i]*store.vz[i];
+            force_sq += fx_[i]*fx_[i] + fy_[i]*fy_[i] + fz_[i]*fz_[i];
+        }
+        if (std::sqrt(force_sq/n) <= params_.relax_tolerance*coulomb_rms_
+                || step == params_.relax_steps)
+            break;
+
+        if (power > 0.0) {
+            if (++downhill > n_min_) {
+                dt = std::min(dt*dt_grow_, dt_max);
+                alpha *= alpha_shrink_;
+            }
+        } else {
+            // Uphill: step back half a step, stop, and go more carefully.
+            for (size_t i = 0; i < n; ++i) {
+                store.x[i] -= 0.5*dt*store.vx[i];
+                store.y[i] -= 0.5*dt*store.vy[i];
+                store.z[i] -= 0.5*dt*store.vz[i];
+                store.vx[i] = store.vy[i] = store.vz[i] = 0.0;
+            }
+            downhill = 0;
+            dt *= dt_shrink_;
+            alpha = alpha_start_;
+        }
+
+        // Semi-implicit Euler step, with the velocity turned towards the
+        // force.
+        double vel_sq = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            const double time_over_mass = dt/store.mass[i];
+            store.vx[i] += fx_[i]*time_over_mass;
+            store.vy[i] += fy_[i]*time_over_mass;
+            store.vz[i] += fz_[i]*time_over_mass;
+            vel_sq += store.vx[i]*store.vx[i] + store.vy[i]*store.vy[i]
+                      + store.vz[i]*store.vz[i];
+        }
+        const double mix = force_sq > 0.0 ?
+            alpha*std::sqrt(vel_sq/force_sq) : 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            store.vx[i] = (1.0 - alpha)*store.vx[i] + mix*fx_[i];
+            store.vy[i] = (1.0 - alpha)*store.vy[i] + mix*fy_[i];
+            store.vz[i] = (1.0 - alpha)*store.vz[i] + mix*fz_[i];
+            store.x[i] += store.vx[i]*dt;
+            store.y[i] += store.vy[i]*dt;
+            store.z[i] += store.vz[i]*dt;
+        }
+        update_force();
+    }
+
+    std::fill(store.vx.begin(), store.vx.end(), 0.0);
+    std::fill(store.vy.begin(), store.vy.end(), 0.0);
+    std::fill(store.vz.begin(), store.vz.end(), 0.0);
+
+    char buffer[256];
+    snprintf(buffer, 256, "Relaxed the ions in %d steps, energy %.6e J to "
+             "%.6e J, RMS force %.2e of the Coulomb force.", step,
+             start_energy*energy_scale, energy()*energy_scale,
+             coulomb_rms_ > 0.0 ? std::sqrt(force_sq/n)/coulomb_rms_ : 0.0);
+    log.info(std::string(buffer));
+    if (std::sqrt(force_sq/n) > params_.relax_tolerance*coulomb_rms_) {
+        log.warn("The ions did not relax to the tolerance in "
+                 + std::to_string(step) + " steps.");
+    }
+}
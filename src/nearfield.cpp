@@ -0,0 +1,90 @@
+/**
+ * @file nearfield.cpp
+ * @brief Function definitions for the short-range part of a distance-split
+ * Coulomb force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/nearfield.h"
+
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  @class NearField
+ *  @brief Coulomb force on every ion from its near neighbours only.
+ *
+ *  Each pair force is multiplied by a switch S(r), which is 1 closer than
+ *  (1 - switch_width_) times the radius, 0 beyond the radius, and the
+ *  smooth step 1 - t^2 (3 - 2t) in between. The force left over, 1 - S(r)
+ *  times the Coulomb force, is smooth and changes slowly as the ions move,
+ *  so a multiple-time-step integrator can update it less often. As the
+ *  split depends only on the distance, both parts are conservative.
+ *
+ *  The neighbours within the radius are taken from a NeighbourList, which
+ *  is only rebuilt when the ions have moved further than half its skin.
+ *  Each ion sums over all of its neighbours, so the ions are independent
+ *  and the result is the same for any number of OpenMP threads.
+ */
+
+constexpr double NearField::switch_width_;
+
+
+/** @brief Set up the near field for pairs closer than radius, with a
+ *  neighbour list that lists pairs up to radius + skin apart.
+ */
+NearField::NearField(double radius, double skin)
+    : radius_(radius), inner_((1.0 - switch_width_)*radius),
+      list_(radius, skin) {
+}
+
+
+/** @brief Calculate the near-field force on each ion.
+ *
+ *  @param store    Positions and charges of the ions.
+ *  @param force    Set to the near-field force on each ion, IonStore order.
+ */
+void NearField::compute(const IonStore& store, std::vector<Vector3D>& force) {
+    const long n = store.size();
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double* q = store.charge.data();
+    force.resize(n);
+    list_.update(store);
+    const long* neighbours = list_.neighbours().data();
+
+    const double rc2 = radius_*radius_;
+    const double inner2 = inner_*inner_;
+    const double inv_width = 1.0/(radius_ - inner_);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (long i = 0; i < n; ++i) {
+        const double xi = x[i], yi = y[i], zi = z[i];
+        double fx = 0.0, fy = 0.0, fz = 0.0;
+        for (long k = list_.begin(i); k < list_.begin(i + 1); ++k) {
+            const long j = neighbours[k];
+            double dx = xi - x[j];
+            double dy = yi - y[j];
+            double dz = zi - z[j];
+            double r2 = dx*dx + dy*dy + dz*dz;
+            if (r2 >= rc2 || r2 == 0.0)
+                continue;
+            double r = std::sqrt(r2);
+            double f = q[j]/(r2*r);
+            if (r2 > inner2) {
+                double t = (r - inner_)*inv_width;
+                f *= 1.0 - t*t*(3.0 - 2.0*t);
+            }
+            fx += f*dx;
+            fy += f*dy;
+            fz += f*dz;
+        }
+        force[i] = Vector3D(fx, fy, fz)*q[i];
+    }
+}
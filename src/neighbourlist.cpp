@@ -0,0 +1,209 @@
+/**
+ * @file neighbourlist.cpp
+ * @brief Function definitions for a Verlet neighbour list with a skin
+ * distance.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/neighbourlist.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  @class NeighbourList
+ *  @brief List of the ions within a cutoff of each ion, kept until the ions
+ *  have moved far enough to change it.
+ *
+ *  The list holds every pair closer than the cutoff plus a skin distance.
+ *  Until some ion has moved more than half the skin from where it was when
+ *  the list was built, no pair can have come within the cutoff without
+ *  being listed, so the list is kept. In a Coulomb crystal the ions barely
+ *  diffuse and rebuilds are rare; in between, finding the neighbours of
+ *  every ion costs only the check of each ion's displacement.
+ *
+ *  The list is built from a cell list: the ions are sorted into cells at
+ *  least (cutoff + skin)/cell_split_ wide so that each neighbouring cell is
+ *  a contiguous run. Each ion lists all of its neighbours, in both
+ *  directions, so the ions can be processed independently in parallel. The
+ *  neighbours are counted and then stored in a second pass, and each ion's
+ *  list is in cell order, so the list is the same for any number of OpenMP
+ *  threads.
+ */
+
+const int NeighbourList::cell_split_;
+const int NeighbourList::max_cells_per_ion_;
+
+
+/** @brief Set up an empty list of pairs closer than cutoff, plus skin.
+ */
+NeighbourList::NeighbourList(double cutoff, double skin)
+    : cutoff_(cutoff), skin_(skin), reach_(cutoff + skin), builds_(0) {
+    nc_[0] = nc_[1] = nc_[2] = 0;
+    span_[0] = span_[1] = span_[2] = 0;
+}
+
+
+/** @brief Rebuild the list if any ion has moved more than half the skin
+ *  since it was built, or the number of ions has changed.
+ *
+ *  @param store    Positions of the ions.
+ *  @return True if the list was rebuilt.
+ */
+bool NeighbourList::update(const IonStore& store) {
+    if (builds_ > 0 && start_.size() == store.size() + 1
+        && !moved(store))
+        return false;
+    build(store);
+    return true;
+}
+
+
+/** @brief Test whether any ion has moved more than half the skin.
+ */
+bool NeighbourList::moved(const IonStore& store) const {
+    const long n = store.size();
+    const double* x = store.x.data();
+    const double* y = store.y.data();
+    const double* z = store.z.data();
+    const double limit = 0.25*skin_*skin_;
+    double most = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(max:most)
+#endif
+    for (long i = 0; i < n; ++i) {
+        double dx = x[i] - x0_[i];
+        double dy = y[i] - y0_[i];
+        double dz = z[i] - z0_[i];
+        most = std::max(most, dx*dx + dy*dy + dz*dz);
+    }
+    return most > limit;
+}
+
+
+/** @brief Build the list for the current positions.
+ */
+void NeighbourList::build(const IonStore& store) {
+    const long n = store.size();
+    x0_.assign(store.x.begin(), store.x.end());
+    y0_.assign(store.y.begin(), store.y.end());
+    z0_.assign(store.z.begin(), store.z.end());
+    sort_ions(store);
+
+    start_.assign(n + 1, 0);
+    search<false>(n);
+    for (long i = 0; i < n; ++i)
+        start_[i + 1] += start_[i];
+    neighbours_.resize(start_[n]);
+    search<true>(n);
+    ++builds_;
+}
+
+
+/** @brief Find the neighbours of every ion from the cell list.
+ *
+ *  Counts the neighbours of ion i into start_[i+1] or, with fill, stores
+ *  them from start_[i] onwards.
+ */
+template <bool fill>
+void NeighbourList::search(long n) {
+    const double reach2 = reach_*reach_;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (long i = 0; i < n; ++i) {
+        const long c = cell_of_[i];
+        const int cx = c/(static_cast<long>(nc_[1])*nc_[2]);
+        const int cy = (c/nc_[2]) % nc_[1];
+        const int cz = c % nc_[2];
+        const double xi = x0_[i], yi = y0_[i], zi = z0_[i];
+        long k = fill ? start_[i] : 0;
+        for (int ax = std::max(cx - span_[0], 0);
+             ax <= std::min(cx + span_[0], nc_[0] - 1); ++ax) {
+            for (int ay = std::max(cy - span_[1], 0);
+                 ay <= std::min(cy + span_[1], nc_[1] - 1); ++ay) {
+                const long row = (static_cast<long>(ax)*nc_[1] + ay)*nc_[2];
+                const long j0 = cell_start_[row + std::max(cz - span_[2], 0)];
+                const long j1 = cell_start_[row + 1
+                        + std::min(cz + span_[2], nc_[2] - 1)];
+                for (long j = j0; j < j1; ++j) {
+                    double dx = xi - x_[j];
+                    double dy = yi - y_[j];
+                    double dz = zi - z_[j];
+                    if (dx*dx + dy*dy + dz*dz >= reach2 || order_[j] == i)
+                        continue;
+                    if (fill)
+                        neighbours_[k] = order_[j];
+                    ++k;
+                }
+            }
+        }
+        if (!fill)
+            start_[i + 1] = k;
+    }
+}
+
+
+/** @brief Sort the ions into cells of the bounding box of the cloud.
+ *
+ *  Cells are at least reach_/cell_split_ wide, so the neighbours lie within
+ *  cell_split_ cells on each axis. A sparse cloud, or one with a stray ion
+ *  far from the rest, gets wider cells so that there are never more than
+ *  max_cells_per_ion_ cells per ion.
+ */
+void NeighbourList::sort_ions(const IonStore& store) {
+    const long n = store.size();
+    const double* r[3] = {store.x.data(), store.y.data(), store.z.data()};
+    double lo[3], extent[3], inv_cell[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = std::numeric_limits<double>::max();
+        double hi = -lo[a];
+        for (long i = 0; i < n; ++i) {
+            lo[a] = std::min(lo[a], r[a][i]);
+            hi = std::max(hi, r[a][i]);
+        }
+        extent[a] = n > 0 ? hi - lo[a] : 0.0;
+        nc_[a] = std::max(1, static_cast<int>(cell_split_*extent[a]/reach_));
+    }
+    const double cells = static_cast<double>(nc_[0])*nc_[1]*nc_[2];
+    const double most = static_cast<double>(max_cells_per_ion_)*n + 1.0;
+    const double shrink = cells > most ? std::cbrt(cells/most) : 1.0;
+    for (int a = 0; a < 3; ++a) {
+        nc_[a] = std::max(1, static_cast<int>(nc_[a]/shrink));
+        inv_cell[a] = extent[a] > 0.0 ? nc_[a]/extent[a] : 0.0;
+        span_[a] = static_cast<int>(std::ceil(reach_*inv_cell[a]));
+    }
+    const long n_cells = static_cast<long>(nc_[0])*nc_[1]*nc_[2];
+
+    // Counting sort of the ions by cell.
+    cell_of_.resize(n);
+    cell_start_.assign(n_cells + 1, 0);
+    for (long i = 0; i < n; ++i) {
+        int c[3];
+        for (int a = 0; a < 3; ++a)
+            c[a] = std::min(nc_[a] - 1,
+                            static_cast<int>((r[a][i] - lo[a])*inv_cell[a]));
+        cell_of_[i] = (static_cast<long>(c[0])*nc_[1] + c[1])*nc_[2] + c[2];
+        ++cell_start_[cell_of_[i] + 1];
+    }
+    for (long c = 0; c < n_cells; ++c)
+        cell_start_[c + 1] += cell_start_[c];
+    order_.resize(n);
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    std::vector<long> next(cell_start_.begin(), cell_start_.end() - 1);
+    for (long i = 0; i < n; ++i) {
+        long s = next[cell_of_[i]]++;
+        order_[s] = i;
+        x_[s] = store.x[i];
+        y_[s] = store.y[i];
+        z_[s] = store.z[i];
+    }
+}
@@ -0,0 +1,252 @@
+/**
+ * @file octree.cpp
+ * @brief Function definitions for the octree used by the tree-code Coulomb
+ * solvers.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/octree.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ *  @class Octree
+ *  @brief Octree over the ions, rebuilt from scratch from the IonStore.
+ *
+ *  Each ion is given a Morton key by interleaving the bits of its position in
+ *  the bounding cube, and the ions are sorted by key. Every cell of the tree
+ *  then holds a contiguous range of the sorted ions, and its eight children
+ *  split that range by the next three bits of the key. Cells are divided
+ *  until they hold at most leaf_size ions.
+ *
+ *  All stages of the build run in parallel with OpenMP: the keys are computed
+ *  per ion, sorted in blocks which are then merged pairwise, and the tree is
+ *  grown one level at a time with the cells of each level split
+ *  independently. Nodes are stored breadth first, so the children of a node
+ *  are contiguous and each level is a contiguous range. The layout depends
+ *  only on the positions, not on the number of threads.
+ */
+
+const int Octree::max_depth_;
+
+namespace {
+
+/** @brief Spread the low 21 bits of v so that they occupy every third bit.
+ */
+uint64_t spread_bits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+}  // namespace
+
+/** @brief Construct an empty tree.
+ *
+ *  @param leaf_size    Cells with more ions than this are divided.
+ */
+Octree::Octree(long leaf_size) : leaf_size_(std::max(1L, leaf_size)) {}
+
+
+/** @brief Build the tree for the current ion positions.
+ *
+ *  @param store    Positions and charges of the ions.
+ */
+void Octree::build(const IonStore& store) {
+    const long n = store.size();
+    const double* px = store.x.data();
+    const double* py = store.y.data();
+    const double* pz = store.z.data();
+    if (n == 0) {
+        nodes_.clear();
+        level_start_.assign(1, 0);
+        return;
+    }
+
+    double xmin = px[0], ymin = py[0], zmin = pz[0];
+    double xmax = xmin, ymax = ymin, zmax = zmin;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(min: xmin, ymin, zmin) \
+                         reduction(max: xmax, ymax, zmax)
+#endif
+    for (long i = 0; i < n; ++i) {
+        xmin = std::min(xmin, px[i]);
+        ymin = std::min(ymin, py[i]);
+        zmin = std::min(zmin, pz[i]);
+        xmax = std::max(xmax, px[i]);
+        ymax = std::max(ymax, py[i]);
+        zmax = std::max(zmax, pz[i]);
+    }
+    double size = std::max(xmax - xmin, std::max(ymax - ymin, zmax - zmin));
+    if (size <= 0.0)
+        size = 1.0;
+
+    const uint64_t cells = 1ULL << max_depth_;
+    const double scale = cells/size;
+    keys_.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long i = 0; i < n; ++i) {
+        uint64_t ux = std::min<uint64_t>((px[i] - xmin)*scale, cells - 1);
+        uint64_t uy = std::min<uint64_t>((py[i] - ymin)*scale, cells - 1);
+        uint64_t uz = std::min<uint64_t>((pz[i] - zmin)*scale, cells - 1);
+        keys_[i] = KeyIndex(spread_bits(ux) << 2 | spread_bits(uy) << 1
+                            | spread_bits(uz), i);
+    }
+    sort_keys();
+
+    order.resize(n);
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    q.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long i = 0; i < n; ++i) {
+        long j = keys_[i].second;
+        order[i] = j;
+        x[i] = px[j];
+        y[i] = py[j];
+        z[i] = pz[j];
+        q[i] = store.charge[j];
+    }
+
+    Node root;
+    root.half = 0.5*size;
+    root.cx = xmin + root.half;
+    root.cy = ymin + root.half;
+    root.cz = zmin + root.half;
+    root.begin = 0;
+    root.end = n;
+    root.first_child = -1;
+    root.n_children = 0;
+    root.level = 0;
+    nodes_.assign(1, root);
+    split_levels();
+}
+
+
+/** @brief Sort the keys in parallel.
+ *
+ *  Each thread sorts one block, then neighbouring blocks are merged in pairs
+ *  until one remains. Keys are paired with the ion index, so there are no
+ *  ties and the result does not depend on the number of blocks.
+ */
+void Octree::sort_keys() {
+    const long n = keys_.size();
+    int blocks = 1;
+#ifdef _OPENMP
+    blocks = std::max(1, std::min(omp_get_max_threads(),
+                                  static_cast<int>(n/1024)));
+#endif
+    std::vector<long> bound(blocks + 1);
+    for (int b = 0; b <= blocks; ++b)
+        bound[b] = n*b/blocks;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1)
+#endif
+    for (int b = 0; b < blocks; ++b)
+        std::sort(keys_.begin() + bound[b], keys_.begin() + bound[b+1]);
+
+    buffer_.resize(n);
+    for (int width = 1; width < blocks; width *= 2) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1)
+#endif
+        for (int b = 0; b < blocks; b += 2*width) {
+            long lo = bound[b];
+            long mid = bound[std::min(b + width, blocks)];
+            long hi = bound[std::min(b + 2*width, blocks)];
+            std::merge(keys_.begin() + lo, keys_.begin() + mid,
+                       keys_.begin() + mid, keys_.begin() + hi,
+                       buffer_.begin() + lo);
+        }
+        keys_.swap(buffer_);
+    }
+}
+
+
+/** @brief Grow the tree from the root one level at a time.
+ *
+ *  The cells of a level are split in parallel, a prefix sum over the number
+ *  of children gives the position of each child in the node array, and the
+ *  children are then written in parallel.
+ */
+void Octree::split_levels() {
+    level_start_.assign(1, 0);
+    for (int level = 0; ; ++level) {
+        const int lo = level_start_.back();
+        const int hi = nodes_.size();
+        if (lo == hi)
+            break;
+        level_start_.push_back(hi);
+        const int shift = 3*(max_depth_ - 1 - level);
+        split_.resize(hi - lo);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+        for (int k = lo; k < hi; ++k) {
+            Node& node = nodes_[k];
+            std::array<long, 9>& s = split_[k - lo];
+            node.n_children = 0;
+            if (node.end - node.begin <= leaf_size_ || level == max_depth_)
+                continue;
+            s[0] = node.begin;
+            for (int octant = 0; octant < 8; ++octant) {
+                s[octant + 1] = std::partition_point(
+                        keys_.begin() + s[octant], keys_.begin() + node.end,
+                        [shift, octant](const KeyIndex& key) {
+                            return static_cast<int>(key.first >> shift & 7)
+                                   <= octant;
+                        }) - keys_.begin();
+                if (s[octant + 1] > s[octant])
+                    ++node.n_children;
+            }
+        }
+
+        int next = hi;
+        for (int k = lo; k < hi; ++k) {
+            Node& node = nodes_[k];
+            node.first_child = node.n_children ? next : -1;
+            next += node.n_children;
+        }
+        nodes_.resize(next);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+        for (int k = lo; k < hi; ++k) {
+            const Node& node = nodes_[k];
+            const std::array<long, 9>& s = split_[k - lo];
+            int child = node.first_child;
+            for (int octant = 0; octant < 8 && node.n_children; ++octant) {
+                if (s[octant + 1] == s[octant])
+                    continue;
+                Node& c = nodes_[child++];
+                c.half = 0.5*node.half;
+                c.cx = node.cx + (octant & 4 ? c.half : -c.half);
+                c.cy = node.cy + (octant & 2 ? c.half : -c.half);
+                c.cz = node.cz + (octant & 1 ? c.half : -c.half);
+                c.begin = s[octant];
+                c.end = s[octant + 1];
+                c.first_child = -1;
+                c.n_children = 0;
+                c.level = level + 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,430 @@
+/**
+ * @file particlemesh.cpp
+ * @brief Function definitions for the particle-particle/particle-mesh (P3M)
+ * Coulomb solver.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include "include/particlemesh.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/logger.h"
+
+/**
+ *  @class ParticleMesh
+ *  @brief Coulomb force on every ion by the P3M method, for open boundaries.
+ *
+ *  The interaction is split as 1/r = erf(alpha r)/r + erfc(alpha r)/r.
+ *
+ *  The smooth erf part is found on a mesh. Charges are spread to the mesh
+ *  points with the triangular-shaped cloud (TSC) scheme, and the mesh is
+ *  convolved with the field of the erf potential sampled at each mesh
+ *  displacement. Zero padding the mesh to twice its size on every axis
+ *  (Hockney and Eastwood) makes the circular FFT convolution equal to the
+ *  open-boundary one. The field is then interpolated back to the ions with
+ *  the same TSC weights. The kernel is odd, so the transforms of K_x and K_y
+ *  are combined and E_x + i E_y comes from a single inverse FFT.
+ *
+ *  The transformed kernel is divided by the smoothing of the TSC assignment
+ *  and interpolation, as in the Hockney-Eastwood optimal influence
+ *  function; without this the error falls only as (alpha h)^2.
+ *
+ *  The erfc part falls off quickly and is summed directly over the ions
+ *  within the cutoff, alpha = 3.2/cutoff, found from a cell list.
+ *
+ *  The mesh spacing gives about two mesh cells per ion in the bounding box
+ *  of the cloud, so both parts cost O(N) apart from the FFT, or is set from
+ *  the longest side of the cloud by `simulation.mesh`. The mesh and the
+ *  transformed kernels are kept until the cloud outgrows the mesh or the
+ *  spacing wanted falls to half of it; the mesh origin follows the cloud
+ *  every step. Accuracy is set by the cutoff in mesh spacings,
+ *  `simulation.cutoff`: the default of 4 gives a mean relative error of
+ *  about 1e-3.
+ */
+
+constexpr double ParticleMesh::alpha_cutoff_;
+constexpr double ParticleMesh::slack_;
+constexpr double ParticleMesh::ions_per_cell_;
+const int ParticleMesh::max_points_;
+const int ParticleMesh::cell_split_;
+const int ParticleMesh::table_size_;
+
+namespace {
+
+/** @brief TSC weights of the mesh points nearest to u, u+1 and u-1.
+ */
+inline int tsc_weights(double u, double w[3]) {
+    int i = static_cast<int>(std::floor(u + 0.5));
+    double d = u - i;
+    w[0] = 0.5*(0.5 - d)*(0.5 - d);
+    w[1] = 0.75 - d*d;
+    w[2] = 0.5*(0.5 + d)*(0.5 + d);
+    return i;
+}
+
+/** @brief Smallest power of two not less than n.
+ */
+int next_power_of_two(int n) {
+    int p = 1;
+    while (p < n)
+        p *= 2;
+    return p;
+}
+
+}  // namespace
+
+/** @brief Construct a P3M solver using the simulation parameters.
+ *
+ *  @param sp   Simulation parameters; uses p3m_mesh and p3m_cutoff.
+ */
+ParticleMesh::ParticleMesh(const SimParams& sp)
+    : mesh_points_(sp.p3m_mesh), cutoff_cells_(sp.p3m_cutoff), h_(0.0),
+      alpha_(0.0), cutoff_(0.0), screen_(table_size_ + 2, 0.0) {
+    m_[0] = m_[1] = m_[2] = 0;
+    const double two_over_sqrt_pi = 2.0/std::sqrt(std::acos(-1.0));
+    for (int k = 0; k <= table_size_; ++k) {
+        double x = alpha_cutoff_*std::sqrt(static_cast<double>(k)/table_size_);
+        screen_[k] = std::erfc(x) + two_over_sqrt_pi*x*std::exp(-x*x);
+    }
+}
+
+
+/** @brief Calculate the Coulomb force on every ion.
+ *
+ *  @param store    Positions and charges of the ions.
+ *  @param force    Set to the force on each ion, in IonStore order.
+ */
+void ParticleMesh::compute(const IonStore& store,
+                           std::vector<Vector3D>& force) {
+    const long n = store.size();
+    const double* p[3] = {store.x.data(), store.y.data(), store.z.data()};
+    double lo[3], hi[3], extent[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = hi[a] = n ? p[a][0] : 0.0;
+        for (long i = 1; i < n; ++i) {
+            lo[a] = std::min(lo[a], p[a][i]);
+            hi[a] = std::max(hi[a], p[a][i]);
+        }
+        extent[a] = hi[a] - lo[a];
+    }
+
+    const double spacing = mesh_spacing(extent, n);
+    if (!mesh_fits(extent, spacing))
+        resize_mesh(extent, spacing);
+
+    field_.resize(n);
+    mesh_field(store, lo);
+    short_range(store, lo, extent);
+
+    force.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long i = 0; i < n; ++i)
+        force[i] = field_[i]*store.charge[i];
+}
+
+
+/** @brief Mesh spacing wanted for the cloud.
+ *
+ *  A fixed number of mesh points along the longest side if one was given,
+ *  otherwise about ions_per_cell_ ions per mesh cell in the bounding box, so
+ *  that the short-range sum stays O(N).
+ */
+double ParticleMesh::mesh_spacing(const double extent[3], long n) const {
+    double longest = std::max(extent[0], std::max(extent[1], extent[2]));
+    if (longest <= 0.0)
+        longest = 1.0;
+    const int points = mesh_points_ ? mesh_points_ : max_points_;
+    const double finest = (1.0 + slack_)*longest/(points - 3);
+    if (mesh_points_)
+        return finest;
+    double volume = 1.0;
+    for (int a = 0; a < 3; ++a)
+        volume *= std::max(extent[a], finest);
+    return std::max(finest, std::cbrt(volume*ions_per_cell_/std::max(n, 1L)));
+}
+
+
+/** @brief Whether the cloud still fits the mesh, and the mesh is no more
+ *  than twice as coarse as the spacing wanted.
+ */
+bool ParticleMesh::mesh_fits(const double extent[3], double spacing) const {
+    if (!fft_ || spacing < 0.5*h_)
+        return false;
+    for (int a = 0; a < 3; ++a) {
+        if (extent[a]/h_ + 3 > m_[a])
+            return false;
+    }
+    return true;
+}
+
+
+/** @brief Choose the mesh spacing and size for the cloud, and transform the
+ *  field kernels.
+ */
+void ParticleMesh::resize_mesh(const double extent[3], double spacing) {
+    // Round the longest axis to the nearest power of two and set the spacing
+    // to fill it, rather than always rounding up and wasting up to half of
+    // the mesh.
+    const int most = mesh_points_ ? mesh_points_ : max_points_;
+    double longest = std::max(extent[0], std::max(extent[1], extent[2]));
+    if (longest <= 0.0)
+        longest = 1.0;
+    double needed = (1.0 + slack_)*longest/spacing + 3;
+    int longest_points = next_power_of_two(
+        static_cast<int>(std::ceil(needed)));
+    if (longest_points > 8
+        && longest_points*longest_points > 2*needed*needed)
+        longest_points /= 2;
+    longest_points = std::max(8, std::min(most, longest_points));
+    h_ = (1.0 + slack_)*longest/(longest_points - 3);
+    cutoff_ = cutoff_cells_*h_;
+    alpha_ = alpha_cutoff_/cutoff_;
+    for (int a = 0; a < 3; ++a) {
+        int axis = static_cast<int>(std::ceil((1.0 + slack_)*extent[a]/h_))
+                   + 3;
+        m_[a] = std::min(most, next_power_of_two(axis));
+    }
+
+    const int px = 2*m_[0], py = 2*m_[1], pz = 2*m_[2];
+    fft_.reset(new FFT3D(px, py, pz));
+    const long points = fft_->points();
+    kernel_xy_.assign(points, Complex());
+    kernel_z_.assign(points, Complex());
+    rho_.resize(points);
+    exy_.resize(points);
+
+    // Field of erf(alpha r)/r at each displacement of the padded mesh. The
+    // displacement m_ can never occur between two ions, and is left zero.
+    const double pi = std::acos(-1.0);
+    const double two_over_sqrt_pi = 2.0/std::sqrt(pi);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < px; ++i) {
+        if (i == m_[0])
+            continue;
+        double dx = (i < m_[0] ? i : i - px)*h_;
+        for (int j = 0; j < py; ++j) {
+            if (j == m_[1])
+                continue;
+            double dy = (j < m_[1] ? j : j - py)*h_;
+            for (int k = 0; k < pz; ++k) {
+                if (k == m_[2] || (i == 0 && j == 0 && k == 0))
+                    continue;
+                double dz = (k < m_[2] ? k : k - pz)*h_;
+                double r2 = dx*dx + dy*dy + dz*dz;
+                double r = std::sqrt(r2);
+                double ar = alpha_*r;
+                double s = (std::erf(ar) - two_over_sqrt_pi*ar*std::exp(-ar*ar))
+                           /(r2*r);
+                long idx = (static_cast<long>(i)*py + j)*pz + k;
+                kernel_xy_[idx] = Complex(s*dx, s*dy);
+                kernel_z_[idx] = s*dz;
+            }
+        }
+    }
+    fft_->forward(kernel_xy_.data());
+    fft_->forward(kernel_z_.data());
+
+    // Correct for TSC assignment and interpolation: multiply by W^2/(sum of
+    // aliased W^2)^2 on each axis, the TSC case of the Hockney-Eastwood
+    // optimal influence function.
+    const int p[3] = {px, py, pz};
+    std::vector<double> influence[3];
+    for (int a = 0; a < 3; ++a) {
+        influence[a].resize(p[a]);
+        for (int i = 0; i < p[a]; ++i) {
+            double x = pi*(i < p[a]/2 ? i : i - p[a])/p[a];
+            double s2 = std::sin(x)*std::sin(x);
+            double sinc = i ? std::sin(x)/x : 1.0;
+            double alias = 1.0 - s2 + 2.0/15.0*s2*s2;
+            influence[a][i] = std::pow(sinc, 6)/(alias*alias);
+        }
+    }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < px; ++i) {
+        for (int j = 0; j < py; ++j) {
+            double w = influence[0][i]*influence[1][j];
+            long row = (static_cast<long>(i)*py + j)*pz;
+            for (int k = 0; k < pz; ++k) {
+                kernel_xy_[row + k] *= w*influence[2][k];
+                kernel_z_[row + k] *= w*influence[2][k];
+            }
+        }
+    }
+
+    Logger::getInstance().info("P3M mesh " + std::to_string(m_[0]) + "x"
+            + std::to_string(m_[1]) + "x" + std::to_string(m_[2])
+            + ", spacing " + std::to_string(h_)
+            + ", cutoff " + std::to_string(cutoff_));
+}
+
+
+/** @brief Long-range field at each ion from the erf part on the mesh.
+ */
+void ParticleMesh::mesh_field(const IonStore& store, const double lo[3]) {
+    const long n = store.size();
+    const int py = 2*m_[1], pz = 2*m_[2];
+    for (int a = 0; a < 3; ++a)
+        origin_[a] = lo[a] - h_;
+
+    std::fill(rho_.begin(), rho_.end(), Complex());
+    for (long i = 0; i < n; ++i) {
+        double wx[3], wy[3], wz[3];
+        int ix = tsc_weights((store.x[i] - origin_[0])/h_, wx);
+        int iy = tsc_weights((store.y[i] - origin_[1])/h_, wy);
+        int iz = tsc_weights((store.z[i] - origin_[2])/h_, wz);
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                long row = (static_cast<long>(ix + a - 1)*py + iy + b - 1)*pz
+                           + iz - 1;
+                double w = store.charge[i]*wx[a]*wy[b];
+                for (int c = 0; c < 3; ++c)
+                    rho_[row + c] += w*wz[c];
+            }
+        }
+    }
+
+    fft_->forward(rho_.data(), true);
+    const long points = fft_->points();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long k = 0; k < points; ++k) {
+        exy_[k] = rho_[k]*kernel_xy_[k];
+        rho_[k] *= kernel_z_[k];
+    }
+    fft_->inverse(exy_.data(), true);
+    fft_->inverse(rho_.data(), true);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long i = 0; i < n; ++i) {
+        double wx[3], wy[3], wz[3];
+        int ix = tsc_weights((store.x[i] - origin_[0])/h_, wx);
+        int iy = tsc_weights((store.y[i] - origin_[1])/h_, wy);
+        int iz = tsc_weights((store.z[i] - origin_[2])/h_, wz);
+        Complex exy;
+        double ez = 0.0;
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                long row = (static_cast<long>(ix + a - 1)*py + iy + b - 1)*pz
+                           + iz - 1;
+                double w = wx[a]*wy[b];
+                for (int c = 0; c < 3; ++c) {
+                    exy += w*wz[c]*exy_[row + c];
+                    ez += w*wz[c]*rho_[row + c].real();
+                }
+            }
+        }
+        field_[i] = Vector3D(exy.real(), exy.imag(), ez);
+    }
+}
+
+
+/** @brief Add the short-range erfc part of the field, summed over the ions
+ *  within the cutoff.
+ *
+ *  Ions are sorted into cells of side at least cutoff/cell_split_, so only
+ *  the cells within cell_split_ of each ion's cell need to be searched. The
+ *  screening erfc(x) + 2x/sqrt(pi) exp(-x^2) depends only on r/cutoff, and
+ *  is interpolated from a table in (r/cutoff)^2.
+ */
+void ParticleMesh::short_range(const IonStore& store, const double lo[3],
+                               const double extent[3]) {
+    const long n = store.size();
+    const int span = cell_split_;
+    int nc[3];
+    double inv_cell[3];
+    for (int a = 0; a < 3; ++a) {
+        nc[a] = std::max(1, static_cast<int>(span*extent[a]/cutoff_));
+        inv_cell[a] = extent[a] > 0.0 ? nc[a]/extent[a] : 0.0;
+    }
+    const long n_cells = static_cast<long>(nc[0])*nc[1]*nc[2];
+
+    // Counting sort of the ions by cell.
+    cell_of_.resize(n);
+    cell_start_.assign(n_cells + 1, 0);
+    for (long i = 0; i < n; ++i) {
+        int c[3];
+        const double r[3] = {store.x[i], store.y[i], store.z[i]};
+        for (int a = 0; a < 3; ++a)
+            c[a] = std::min(nc[a] - 1,
+                            static_cast<int>((r[a] - lo[a])*inv_cell[a]));
+        cell_of_[i] = (static_cast<long>(c[0])*nc[1] + c[1])*nc[2] + c[2];
+        ++cell_start_[cell_of_[i] + 1];
+    }
+    for (long c = 0; c < n_cells; ++c)
+        cell_start_[c + 1] += cell_start_[c];
+    order_.resize(n);
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    q_.resize(n);
+    {
+        std::vector<long> next(cell_start_.begin(), cell_start_.end() - 1);
+        for (long i = 0; i < n; ++i) {
+            long s = next[cell_of_[i]]++;
+            order_[s] = i;
+            x_[s] = store.x[i];
+            y_[s] = store.y[i];
+            z_[s] = store.z[i];
+            q_[s] = store.charge[i];
+        }
+    }
+
+    const double rc2 = cutoff_*cutoff_;
+    const double to_table = table_size_/rc2;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (long c = 0; c < n_cells; ++c) {
+        const int cx = c/(static_cast<long>(nc[1])*nc[2]);
+        const int cy = (c/nc[2]) % nc[1];
+        const int cz = c % nc[2];
+        for (long s = cell_start_[c]; s < cell_start_[c + 1]; ++s) {
+            const double xi = x_[s], yi = y_[s], zi = z_[s];
+            double fx = 0.0, fy = 0.0, fz = 0.0;
+            for (int ax = std::max(cx - span, 0);
+                 ax <= std::min(cx + span, nc[0] - 1); ++ax) {
+                for (int ay = std::max(cy - span, 0);
+                     ay <= std::min(cy + span, nc[1] - 1); ++ay) {
+                    const long row = (static_cast<long>(ax)*nc[1] + ay)*nc[2];
+                    const long j0 = cell_start_[row + std::max(cz - span, 0)];
+                    const long j1 = cell_start_[row
+                                                + std::min(cz + span, nc[2] - 1)
+                                                + 1];
+                    for (long j = j0; j < j1; ++j) {
+                        double dx = xi - x_[j];
+                        double dy = yi - y_[j];
+                        double dz = zi - z_[j];
+                        double r2 = dx*dx + dy*dy + dz*dz;
+                        if (r2 >= rc2 || r2 == 0.0)
+                            continue;
+                        double u = r2*to_table;
+                        int k = static_cast<int>(u);
+                        double screen = screen_[k]
+                                        + (u - k)*(screen_[k + 1] - screen_[k]);
+                        double f = q_[j]*screen/(r2*std::sqrt(r2));
+                        fx += f*dx;
+                        fy += f*dy;
+                        fz += f*dz;
+                    }
+                }
+            }
+            field_[order_[s]] += Vector3D(fx, fy, fz);
+        }
+    }
+}
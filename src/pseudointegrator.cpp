@@ -0,0 +1,85 @@
+/**
+ * @file pseudointegrator.cpp
+ * @brief Function definitions for velocity Verlet in the trap
+ * pseudopotential.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include <vector>
+
+#include "include/ccmdsim.h"
+#include "include/integrator.h"
+#include "include/ion.h"
+#include "include/ioncloud.h"
+#include "include/iontrap.h"
+#include "include/logger.h"
+
+/**
+ *  @class PseudoIntegrator
+ *  @brief Velocity Verlet integration in the time-averaged pseudopotential of
+ *  the trap, for the cooling stage.
+ *
+ *  The RF force is replaced by the static harmonic force of
+ *  IonTrap::pseudo_coefficients, which depends on each ion's charge to mass
+ *  ratio. With no micromotion to resolve the time step need only follow the
+ *  secular motion, and can be one to two orders of magnitude longer than in
+ *  the RF trap. The trap is not evolved, so the RF integrator that follows
+ *  starts from time zero.
+ *
+ *  The order of operations is that of VerletIntegrator, with heating and
+ *  laser cooling applied to the laser cooled ions after each half-kick.
+ */
+
+
+/**
+ *  @brief Create a new pseudopotential integrator, and find the force
+ *  coefficients of each ion.
+ *
+ *  @param it       Pointer to ion trap object.
+ *  @param ic       Pointer to ion cloud object.
+ *  @param ip       Reference to integrator parameters.
+ *  @param sp       Reference to simulation parameters.
+ */
+PseudoIntegrator::PseudoIntegrator(const IonTrap_ptr it,
+        const IonCloud_ptr ic, const IntegrationParams& integrationParams,
+        const SimParams& sp)
+    : Integrator(it, ic, integrationParams, sp) {
+    Logger& log = Logger::getInstance();
+    log.info("Velocity Verlet integration in the trap pseudopotential.");
+    ions_->pseudo_coefficients(cx_, cy_, cz_);
+    for (const auto& ion : ions_->get_ions()) {
+        if (ion->get_type().is_laser_cooled)
+            cooled_.push_back(ion);
+    }
+}
+
+
+/** @brief Advance the ions by one velocity Verlet step of \c dt.
+ *
+ *  @param dt   Time step.
+ */
+void PseudoIntegrator::evolve(double dt) {
+    const double half_dt = dt/2.0;
+
+    ions_->kick(half_dt, coulomb_.get_force());
+    ions_->linear_kick(half_dt, cx_, cy_, cz_);
+    for (const auto& ion : cooled_) {
+        ion->heat(half_dt);
+        ion->cool(half_dt);
+    }
+    ions_->drift(dt);
+
+    coulomb_.update();
+
+    ions_->kick(half_dt, coulomb_.get_force());
+    ions_->linear_kick(half_dt, cx_, cy_, cz_);
+    for (const auto& ion : cooled_) {
+        ion->heat(half_dt);
+        ion->cool(half_dt);
+    }
+
+    // Tell everyone we're done
+    notifyListeners(n_iter_++);
+}
@@ -30,26 +30,30 @@ PulsedTrap::PulsedTrap(const TrapParams& params)
 
 void PulsedTrap::evolve(double dt)
 {
-    time_now_ += dt;
-    
+    pulse_height_ = advance(dt) ? table_phase() : phase_at(time_now_);
+}
+
+
+/**
+ *  @brief The amplitude of the digital waveform at time `time`.
+ *
+ *  @param time Time in simulation units.
+ */
+double PulsedTrap::phase_at(double time) const
+{
     // Implementation of square wave pulse shape
-    double scaled_time = time_now_/pi - std::floor( time_now_/pi );
+    double scaled_time = time/pi - std::floor( time/pi );
     
-    if (scaled_time <= params_.tau/2) {
-        pulse_height_ = 1.0;
-        return;
+    if (scaled_time < params_.tau/2) {
+        return 1.0;
     } else if (scaled_time < (1.0-params_.tau)/2) {
-        pulse_height_ = 0.0;
-        return;
+        return 0.0;
     } else if (scaled_time < (1.0+params_.tau)/2) {
-        pulse_height_ = -1.0;
-        return;
+        return -1.0;
     } else if (scaled_time < 1.0-params_.tau/2) {
-        pulse_height_ = 0.0;
-        return;
+        return 0.0;
     }
-    pulse_height_ = 1.0;
-    return;
+    return 1.0;
 }
 
 
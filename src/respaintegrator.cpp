@@ -8,6 +8,7 @@
 
 #include "include/ccmdsim.h"
 #include "include/integrator.h"
+#include "include/ion.h"
 #include "include/ioncloud.h"
 #include "include/iontrap.h"
 #include "include/logger.h"
@@ -38,7 +39,43 @@ RespaIntegrator::RespaIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
     : Integrator(it, ic, integrationParams, sp) {
         Logger& log = Logger::getInstance();
         log.info("Verlet integration.");
-        n_iter_ = 0;
+        // The slow force is updated at the start of each step.
+        energy_at_update_ = false;
+        for (const auto& ion : ions_->get_ions()) {
+            if (ion->get_type().is_laser_cooled)
+                cooled_.push_back(ion);
+        }
+        // The trap is evolved by half RESPA steps.
+        trap_->use_phase_table(params_.time_step/params_.respa_steps/2.0);
+        switch (trap_->wave()) {
+            case TrapParams::cosine:
+                select_step<CosineTrap>();
+                break;
+            case TrapParams::digital:
+                select_step<PulsedTrap>();
+                break;
+            case TrapParams::waveform:
+                select_step<WaveformTrap>();
+                break;
+            case TrapParams::cosine_decay:
+                select_step<CosineDecayTrap>();
+                break;
+            case TrapParams::twofreq:
+                select_step<TwoFreq_trap>();
+                break;
+        }
+}
+
+
+/** @brief Use the step for this type of trap, and with laser cooling only
+ *  if there are laser cooled ions.
+ */
+template <class Trap>
+void RespaIntegrator::select_step() {
+    if (cooled_.empty())
+        step_ = &RespaIntegrator::step<Trap, false>;
+    else
+        step_ = &RespaIntegrator::step<Trap, true>;
 }
 
 
@@ -50,37 +87,61 @@ RespaIntegrator::RespaIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
  *  are used. Finally, a second half-step of Coulomb force and ion heating is
  *  applied.
  *
+ *  The step is compiled for each type of trap, as for VerletIntegrator. The
+ *  trap force of each sub-step is applied to all ions in one loop, and the
+ *  heating, laser cooling and friction correction only to the laser cooled
+ *  ions, in the same order as by their Ion objects.
+ *
  *  @param dt   Time step.
  */
-void RespaIntegrator::evolve(double dt) {
+template <class Trap, bool Cooled>
+void RespaIntegrator::step(double dt) {
     double half_dt = dt/2.0;
     double dt_respa = dt/params_.respa_steps;
     double half_dt_respa = dt_respa/2.0;
+    Trap& trap = static_cast<Trap&>(*trap_);
     // slow Coulomb force half-kick
     ions_->kick(half_dt, coulomb_.get_force() );
     // get new slow force
     coulomb_.update();
     // ion stochastic heating for half-step
-    ions_->heat(half_dt);
+    if (Cooled) {
+        for (const auto& ion : cooled_)
+            ion->heat(half_dt);
+    }
     // Velocity Verlet style evolution for fast forces
     for (int i = 0; i <params_.respa_steps; ++i) {
         // update trap by half_dt_respa
-        trap_->evolve(half_dt_respa);
+        trap.Trap::evolve(half_dt_respa);
         // kick ions with resulting force
-        ions_->kick(half_dt_respa);
+        ions_->linear_kick(half_dt_respa,
+                           trap.coefficients_at(trap.Trap::get_phase()));
+        if (Cooled) {
+            for (const auto& ion : cooled_)
+                ion->cool(half_dt_respa);
+        }
         // free flight evolution
         ions_->drift(dt_respa);
         // update trap by half_dt_respa
-        trap_->evolve(half_dt_respa);
+        trap.Trap::evolve(half_dt_respa);
         // kick ions with resulting force
-        ions_->kick(half_dt_respa);
-        // correct for friction forces in Velocity Verlet algorithm
-        // see: M. Tuckerman and B. J. Berne,
-        //      J. Chem. Phys. 95, 4389 (1991), Eqn. 3.7
-        ions_->velocity_scale(half_dt_respa);
+        ions_->linear_kick(half_dt_respa,
+                           trap.coefficients_at(trap.Trap::get_phase()));
+        if (Cooled) {
+            // correct for friction forces in Velocity Verlet algorithm
+            // see: M. Tuckerman and B. J. Berne,
+            //      J. Chem. Phys. 95, 4389 (1991), Eqn. 3.7
+            for (const auto& ion : cooled_) {
+                ion->cool(half_dt_respa);
+                ion->velocity_scale(half_dt_respa);
+            }
+        }
     }
     // ion stochastic heating for half-step
-    ions_->heat(half_dt);
+    if (Cooled) {
+        for (const auto& ion : cooled_)
+            ion->heat(half_dt);
+    }
     // slow Coulomb force half-kick
     ions_->kick(half_dt, coulomb_.get_force());
 
@@ -0,0 +1,220 @@
+/**
+ * @file snapshot.cpp
+ * @brief Function definitions for starting a run from the ions of an earlier
+ * one.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+/**
+ *  @class Snapshot
+ *
+ *  Starting from the crystal of an earlier run, rather than the cubic lattice
+ *  of IonCloud::get_lattice, saves most of the cooling time when the trap or
+ *  laser parameters change only a little, as between neighbouring points of a
+ *  scan. The earlier run is given either as its working directory, from which
+ *  the \c _pos.csv file of each species is read, or as the \c snapshot.bin
+ *  it wrote. The binary file keeps the full precision of the positions and
+ *  velocities; the text files hold six significant figures.
+ *
+ *  Both hold S.I. units, and are converted with the length and time scales
+ *  of this run's trap. The ions are matched by species name. If the earlier
+ *  run had more ions of a species than this one, those closest to the trap
+ *  centre are taken.
+ */
+
+#include "include/snapshot.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "include/ccmdsim.h"
+#include "include/checkpoint.h"
+#include "include/ioncloud.h"
+#include "include/logger.h"
+
+/** @brief Marks the file as a CCMD snapshot ("CCMDSNAP"). */
+const std::int64_t Snapshot::magic_ = 0x50414E53444D4343;
+/** @brief Changed whenever the layout of the file changes. */
+const std::int64_t Snapshot::version_ = 1;
+
+namespace {
+/// Used to rotate the axes of the text files, as in IonStatsListener.
+const double sqrt2 = 1.414213562;
+}
+
+
+/**
+ *  @brief Load the ions of an earlier run.
+ *
+ *  @param from     A \c snapshot.bin file, or a working directory holding
+ *                  \c _pos.csv files.
+ *  @param cp       Cloud parameters of this run, naming the species to read.
+ *  @param tp       Trap parameters of this run, for the simulation units.
+ */
+Snapshot::Snapshot(const std::string& from, const CloudParams& cp,
+                   const TrapParams& tp) {
+    Logger& log = Logger::getInstance();
+    log.info("Starting from the ions in " + from);
+    const std::string ending = ".bin";
+    if (from.size() >= ending.size()
+            && from.compare(from.size() - ending.size(), ending.size(),
+                            ending) == 0) {
+        read_binary(from, tp);
+    } else {
+        read_csv(from.back() == '/' ? from : from + "/", cp, tp);
+    }
+}
+
+
+/**
+ *  @brief Write the positions and velocities of the ions, in S.I. units and
+ *  without rotating the axes, to a snapshot file.
+ *
+ *  @param file_name    File to write.
+ *  @param cloud        The ions.
+ *  @param cp           Cloud parameters, listing the species.
+ *  @param tp           Trap parameters, for the scale to S.I. units.
+ */
+void Snapshot::write(const std::string& file_name, const IonCloud& cloud,
+                     const CloudParams& cp, const TrapParams& tp) {
+    const double vel_scale = tp.length_scale/tp.time_scale;
+    CheckpointWriter writer(file_name);
+    writer.write(magic_);
+    writer.write(version_);
+    writer.write(static_cast<std::int64_t>(cp.ion_type_list.size()));
+    for (auto& type : cp.ion_type_list) {
+        std::vector<Vector3D> pos;
+        std::vector<Vector3D> vel;
+        for (auto ion : cloud.get_ions()) {
+            if (ion->name() == type.name) {
+                pos.push_back(ion->get_pos()*tp.length_scale);
+                vel.push_back(ion->get_vel()*vel_scale);
+            }
+        }
+        writer.write(type.name);
+        writer.write(pos);
+        writer.write(vel);
+    }
+    writer.close();
+}
+
+
+/**
+ *  @brief The \c n ions of a species closest to the trap centre, in the order
+ *  they were stored.
+ *
+ *  @param name     Species name.
+ *  @param n        Number of ions wanted.
+ *  @param pos      Filled with their positions.
+ *  @param vel      Filled with their velocities.
+ */
+void Snapshot::take(const std::string& name, size_t n,
+                    std::vector<Vector3D>& pos,
+                    std::vector<Vector3D>& vel) const {
+    Logger& log = Logger::getInstance();
+    auto it = species_.find(name);
+    if (it == species_.end() || it->second.pos.size() < n) {
+        const size_t found = it == species_.end() ? 0 : it->second.pos.size();
+        log.error("Starting ions have " + std::to_string(found) + " "
+                  + name + ", but " + std::to_string(n) + " are needed.");
+        throw std::runtime_error("Too few starting ions of a species");
+    }
+    const Species& s = it->second;
+
+    std::vector<size_t> order(s.pos.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&s](size_t a, size_t b) {
+                         return s.pos[a] < s.pos[b]; });
+    order.resize(n);
+    std::sort(order.begin(), order.end());
+
+    pos.clear();
+    vel.clear();
+    for (size_t i : order) {
+        pos.push_back(s.pos[i]);
+        vel.push_back(s.vel[i]);
+    }
+}
+
+
+void Snapshot::read_binary(const std::string& file_name,
+                           const TrapParams& tp) {
+    Logger& log = Logger::getInstance();
+    CheckpointReader reader(file_name);
+    if (reader.read_int() != magic_ || reader.read_int() != version_) {
+        log.error(file_name + " is not a snapshot of this version.");
+        throw std::runtime_error("Not a snapshot file");
+    }
+    const double vel_scale = tp.length_scale/tp.time_scale;
+    const std::int64_t n_species = reader.read_int();
+    for (std::int64_t k = 0; k < n_species; ++k) {
+        Species& s = species_[reader.read_string()];
+        reader.read(s.pos);
+        reader.read(s.vel);
+        if (s.pos.size() != s.vel.size()) {
+            log.error(file_name + " has more positions than velocities.");
+            throw std::runtime_error("Snapshot file is damaged");
+        }
+        for (auto& r : s.pos)
+            r /= tp.length_scale;
+        for (auto& v : s.vel)
+            v /= vel_scale;
+    }
+}
+
+
+void Snapshot::read_csv(const std::string& path, const CloudParams& cp,
+                        const TrapParams& tp) {
+    Logger& log = Logger::getInstance();
+    const double vel_scale = tp.length_scale/tp.time_scale;
+    for (auto& type : cp.ion_type_list) {
+        const std::string file_name = path + type.name + "_pos.csv";
+        std::ifstream in(file_name.c_str());
+        if (!in) {
+            log.error("Cannot open starting positions " + file_name);
+            throw std::runtime_error("Cannot open starting positions");
+        }
+        Species& s = species_[type.name];
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            // x, y, z, vx, vy, vz with the x and y axes between the rods,
+            // each followed by a comma.
+            std::vector<double> row;
+            std::istringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, ',')) {
+                if (field.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                try {
+                    row.push_back(std::stod(field));
+                } catch (const std::exception&) {
+                    row.clear();
+                    break;
+                }
+            }
+            if (row.size() != 6) {
+                log.error("Cannot read the line \"" + line + "\" of "
+                          + file_name);
+                throw std::runtime_error("Cannot read starting positions");
+            }
+            Vector3D r((row[0] + row[1])*sqrt2/2, (row[0] - row[1])*sqrt2/2,
+                       row[2]);
+            Vector3D v((row[3] + row[4])*sqrt2/2, (row[3] - row[4])*sqrt2/2,
+                       row[5]);
+            r /= tp.length_scale;
+            v /= vel_scale;
+            s.pos.push_back(r);
+            s.vel.push_back(v);
+        }
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file splitrespaintegrator.cpp
+ * @brief Function definitions for RESPA with a distance-split Coulomb force.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include <vector>
+
+#include "include/ccmdsim.h"
+#include "include/checkpoint.h"
+#include "include/integrator.h"
+#include "include/ioncloud.h"
+#include "include/iontrap.h"
+#include "include/logger.h"
+
+/**
+ *  @class SplitRespaIntegrator
+ *  @brief RESPA integration with three time scales.
+ *
+ *  The Coulomb force is split by NearField into a near field from the ions
+ *  within \c splitradius and the smooth far field left over. The trap force
+ *  is applied in \c respasteps sub-steps of each step, as by
+ *  RespaIntegrator; the near field is updated every step and applied as
+ *  half-kicks at each end of it; the far field is updated only every
+ *  \c farsteps steps and applied as half-kicks at each end of that cycle.
+ *
+ *  The far field is the full Coulomb force from CoulombForce, with any of
+ *  its methods, less the near field at the same positions. Between far
+ *  updates only the near field is calculated, from a neighbour list with
+ *  \c skin to spare, which costs O(N) for a crystal, so the full force is
+ *  found a factor \c farsteps less often.
+ *
+ *  See: M. Tuckerman, B. J. Berne and G. J. Martyna,
+ *  J. Chem. Phys. 97, 1990 (1992)
+ */
+
+
+/**
+ *  @brief Create a new split RESPA integrator, and split the Coulomb force
+ *  at the starting positions.
+ *
+ *  @param it       Pointer to ion trap object.
+ *  @param ic       Pointer to ion cloud object.
+ *  @param ip       Reference to integrator parameters.
+ *  @param sp       Reference to simulation parameters.
+ */
+SplitRespaIntegrator::SplitRespaIntegrator(const IonTrap_ptr it,
+        const IonCloud_ptr ic, const IntegrationParams& integrationParams,
+        const SimParams& sp)
+    : Integrator(it, ic, integrationParams, sp),
+      near_(integrationParams.split_radius, integrationParams.skin) {
+    Logger& log = Logger::getInstance();
+    log.info("RESPA integration with split Coulomb force.");
+    // The full force is updated only once each far field cycle.
+    energy_at_update_ = false;
+    trap_->use_phase_table(params_.time_step/params_.respa_steps/2.0);
+    near_.compute(ions_->get_store(), near_force_);
+    split_far();
+}
+
+
+/** @brief Increment by one step.
+ *
+ *  The first step of each far field cycle starts with a far field half-kick
+ *  for the whole cycle, and the last step ends with an update of the far
+ *  field and the second half-kick. Each step applies near field half-kicks
+ *  around a RESPA loop of trap force sub-steps, and updates the near field
+ *  in between. With a Coulomb worker thread the full force is calculated
+ *  while the near field is.
+ *
+ *  @param dt   Time step.
+ */
+void SplitRespaIntegrator::evolve(double dt) {
+    const int far_steps = params_.far_steps;
+    const int phase = n_iter_ % far_steps;
+    const double half_dt = dt/2.0;
+    const double half_far_dt = far_steps*half_dt;
+    const double dt_respa = dt/params_.respa_steps;
+    const double half_dt_respa = dt_respa/2.0;
+
+    if (phase == 0)
+        ions_->kick(half_far_dt, far_force_);
+    // near field half-kick and heating
+    ions_->kick(half_dt, near_force_);
+    ions_->heat(half_dt);
+    for (int i = 0; i < params_.respa_steps; ++i) {
+        trap_->evolve(half_dt_respa);
+        ions_->kick(half_dt_respa);
+        ions_->drift(dt_respa);
+        trap_->evolve(half_dt_respa);
+        ions_->kick(half_dt_respa);
+        ions_->velocity_scale(half_dt_respa);
+    }
+    ions_->heat(half_dt);
+    const bool far_update = phase == far_steps - 1;
+    if (far_update)
+        coulomb_.update();
+    near_.compute(ions_->get_store(), near_force_);
+    ions_->kick(half_dt, near_force_);
+    if (far_update) {
+        split_far();
+        ions_->kick(half_far_dt, far_force_);
+    }
+
+    // Tell everyone we're done
+    notifyListeners(n_iter_++);
+}
+
+
+/** @brief Write the step counter, full force and both parts of the split
+ *  force to a checkpoint.
+ */
+void SplitRespaIntegrator::save_state(CheckpointWriter& writer) {
+    Integrator::save_state(writer);
+    writer.write(near_force_);
+    writer.write(far_force_);
+}
+
+
+/** @brief Restore the split force from a checkpoint.
+ *
+ *  The neighbour list is rebuilt from the restored positions, so later near
+ *  field sums may take the pairs in a different order, and the trajectory
+ *  only matches the uninterrupted run to rounding.
+ */
+void SplitRespaIntegrator::load_state(CheckpointReader& reader) {
+    Integrator::load_state(reader);
+    reader.read(near_force_);
+    reader.read(far_force_);
+}
+
+
+/** @brief Take the near field away from the full Coulomb force of the last
+ *  update, at the same positions, to leave the far field.
+ */
+void SplitRespaIntegrator::split_far() {
+    const std::vector<Vector3D>& full = coulomb_.get_force();
+    far_force_.resize(full.size());
+    for (size_t i = 0; i < full.size(); ++i)
+        far_force_[i] = full[i] - near_force_[i];
+}
@@ -5,6 +5,59 @@
 #include "include/stochastic_heat.h"
 
 #include <random>
+#include <sstream>
+#include <string>
 
-std::mt19937 Stochastic_heat::generator = std::mt19937();
+#include "include/checkpoint.h"
 
+/**
+ *  @brief Seed the generator shared by the ions of a cloud.
+ *
+ *  @param gen      The generator.
+ *  @param seed     Seed, or -1 to seed from the time.
+ */
+void Stochastic_heat::seed(std::mt19937& gen, int seed) {
+    if (seed<0) {
+        seed = (int)std::time(0);
+    }
+    gen.seed(static_cast<unsigned int>(seed));
+}
+
+/**
+ *  @brief Write the state of the generator shared by the ions of a cloud to
+ *  a checkpoint.
+ */
+void Stochastic_heat::save_generator(CheckpointWriter& writer,
+                                     const std::mt19937& gen) {
+    std::ostringstream state;
+    state << gen;
+    writer.write(state.str());
+}
+
+/**
+ *  @brief Restore the shared generator from a checkpoint.
+ */
+void Stochastic_heat::load_generator(CheckpointReader& reader,
+                                     std::mt19937& gen) {
+    std::istringstream state(reader.read_string());
+    state >> gen;
+}
+
+/**
+ *  @brief Write the state of the Gaussian distribution, which keeps the
+ *  second of each pair of numbers it draws.
+ */
+void Stochastic_heat::save_state(CheckpointWriter& writer) const {
+    std::ostringstream state;
+    state.precision(17);
+    state << norm_dist;
+    writer.write(state.str());
+}
+
+/**
+ *  @brief Restore the Gaussian distribution from a checkpoint.
+ */
+void Stochastic_heat::load_state(CheckpointReader& reader) {
+    std::istringstream state(reader.read_string());
+    state >> norm_dist;
+}
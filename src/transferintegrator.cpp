@@ -0,0 +1,189 @@
+/**
+ * @file transferintegrator.cpp
+ * @brief Function definitions for RESPA with trap transfer matrices.
+ *
+ * @author Chris Rennick
+ * @copyright Copyright 2014 University of Oxford.
+ */
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "include/ccmdsim.h"
+#include "include/integrator.h"
+#include "include/ion.h"
+#include "include/ioncloud.h"
+#include "include/iontrap.h"
+#include "include/logger.h"
+
+/**
+ *  @class TransferIntegrator
+ *  @brief RESPA integration with the trap force applied by transfer
+ *  matrices.
+ *
+ *  The trap force is linear and diagonal in position (see
+ *  IonTrap::force_coefficients), so each kick and drift of the RESPA inner
+ *  loop is a linear map of an ion's position and velocity along each axis,
+ *  the same for every ion of a given charge and mass. The \c respasteps
+ *  sub-steps of a step are multiplied together as the trap evolves, into one
+ *  2x2 matrix per axis and species, and the matrices are then applied to the
+ *  ions in a single pass. The cost of the inner loop no longer grows with
+ *  the number of ions, so \c respasteps can be raised freely; the result is
+ *  the same as the sub-steps taken ion by ion, to rounding.
+ *
+ *  The matrices are built afresh for each step rather than for one RF
+ *  period, as not every trap is periodic (CosineDecayTrap) and the step need
+ *  not divide the period.
+ *
+ *  Laser cooled ions feel a velocity dependent and random scattering force,
+ *  so they are still moved sub-step by sub-step as by RespaIntegrator. The
+ *  Coulomb force is applied as half-kicks at each end of the step, and is
+ *  updated at the end of the step.
+ */
+
+
+/**
+ *  @brief Create a new transfer matrix integrator, and sort the ions into
+ *  species.
+ *
+ *  @param it       Pointer to ion trap object.
+ *  @param ic       Pointer to ion cloud object.
+ *  @param ip       Reference to integrator parameters.
+ *  @param sp       Reference to simulation parameters.
+ */
+TransferIntegrator::TransferIntegrator(const IonTrap_ptr it,
+        const IonCloud_ptr ic, const IntegrationParams& integrationParams,
+        const SimParams& sp)
+    : Integrator(it, ic, integrationParams, sp) {
+    Logger& log = Logger::getInstance();
+    log.info("RESPA integration with trap transfer matrices.");
+    trap_->use_phase_table(params_.time_step/params_.respa_steps/2.0);
+    find_species();
+    log.info("\t" + std::to_string(charge_over_mass_.size())
+             + " species moved by transfer matrices, "
+             + std::to_string(cooled_.size()) + " laser cooled ions.");
+}
+
+
+/** @brief Increment by one step.
+ *
+ *  A Coulomb half-kick and half-step of heating are followed by the RESPA
+ *  loop of trap sub-steps, which moves the laser cooled ions and builds the
+ *  transfer matrices for the rest. The matrices are applied, and then the
+ *  second half-step of heating and, with the updated Coulomb force, the
+ *  second half-kick.
+ *
+ *  @param dt   Time step.
+ */
+void TransferIntegrator::evolve(double dt) {
+    const double half_dt = dt/2.0;
+    const double dt_respa = dt/params_.respa_steps;
+    const double half_dt_respa = dt_respa/2.0;
+
+    ions_->kick(half_dt, coulomb_.get_force());
+    ions_->heat(half_dt);
+    for (auto& m : transfer_)
+        m = Transfer{1.0, 0.0, 0.0, 1.0};
+    for (int i = 0; i < params_.respa_steps; ++i) {
+        trap_->evolve(half_dt_respa);
+        kick_transfer(half_dt_respa);
+        drift_transfer(dt_respa);
+        for (const auto& ion : cooled_)
+            ion->kick(half_dt_respa);
+        for (const auto& ion : cooled_)
+            ion->drift(dt_respa);
+        trap_->evolve(half_dt_respa);
+        kick_transfer(half_dt_respa);
+        for (const auto& ion : cooled_)
+            ion->kick(half_dt_respa);
+        for (const auto& ion : cooled_)
+            ion->velocity_scale(half_dt_respa);
+    }
+    apply_transfer();
+    ions_->heat(half_dt);
+    coulomb_.update();
+    ions_->kick(half_dt, coulomb_.get_force());
+
+    // Tell everyone we're done
+    notifyListeners(n_iter_++);
+}
+
+
+/** @brief Group the ions that are not laser cooled by charge and mass, into
+ *  runs of neighbouring ions of the same species.
+ */
+void TransferIntegrator::find_species() {
+    std::map<std::pair<double, double>, size_t> species;
+    const Ion_ptr_vector& ions = ions_->get_ions();
+    for (size_t i = 0; i < ions.size(); ++i) {
+        const Ion& ion = *ions[i];
+        if (ion.get_type().is_laser_cooled) {
+            cooled_.push_back(ions[i]);
+            continue;
+        }
+        auto key = std::make_pair(ion.get_charge(), ion.get_mass());
+        auto found = species.find(key);
+        if (found == species.end()) {
+            found = species.insert(
+                    std::make_pair(key, charge_over_mass_.size())).first;
+            charge_over_mass_.push_back(ion.get_charge()/ion.get_mass());
+        }
+        if (!runs_.empty() && runs_.back().end == i
+            && runs_.back().species == found->second) {
+            ++runs_.back().end;
+        } else {
+            runs_.push_back(Run{i, i + 1, found->second});
+        }
+    }
+    transfer_.resize(3*charge_over_mass_.size());
+}
+
+
+/** @brief Follow the transfer matrices with a kick by the trap force at its
+ *  current phase.
+ */
+void TransferIntegrator::kick_transfer(double dt) {
+    const Vector3D c = trap_->force_coefficients();
+    const double coeff[3] = {c.x, c.y, c.z};
+    for (size_t s = 0; s < charge_over_mass_.size(); ++s) {
+        for (int a = 0; a < 3; ++a) {
+            Transfer& m = transfer_[3*s + a];
+            const double k = coeff[a]*charge_over_mass_[s]*dt;
+            m.c += k*m.a;
+            m.d += k*m.b;
+        }
+    }
+}
+
+
+/** @brief Follow the transfer matrices with a free flight.
+ */
+void TransferIntegrator::drift_transfer(double dt) {
+    for (auto& m : transfer_) {
+        m.a += dt*m.c;
+        m.b += dt*m.d;
+    }
+}
+
+
+/** @brief Move each ion that is not laser cooled by the transfer matrices
+ *  of its species.
+ */
+void TransferIntegrator::apply_transfer() {
+    IonStore& store = ions_->store_;
+    double* r[3] = {store.x.data(), store.y.data(), store.z.data()};
+    double* v[3] = {store.vx.data(), store.vy.data(), store.vz.data()};
+    for (const auto& run : runs_) {
+        for (int a = 0; a < 3; ++a) {
+            const Transfer m = transfer_[3*run.species + a];
+            double* ra = r[a];
+            double* va = v[a];
+            for (size_t i = run.begin; i < run.end; ++i) {
+                const double ri = ra[i];
+                ra[i] = m.a*ri + m.b*va[i];
+                va[i] = m.c*ri + m.d*va[i];
+            }
+        }
+    }
+}
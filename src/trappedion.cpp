@@ -20,9 +20,12 @@
  *  Construct a new trapped ion that stores a pointer to the ion trap
  *  @param ion_trap A pointer to the ion trap.
  *  @param type     A pointer to ion parameters.
+ *  @param store    Arrays holding the ion data.
+ *  @param index    Index of this ion in the store.
  */
-TrappedIon::TrappedIon(const IonTrap_ptr trap, const IonType& type, const LaserParams& lp)
-    : trap_(trap), Ion(type, lp) {
+TrappedIon::TrappedIon(const IonTrap_ptr trap, const IonType& type,
+                       const LaserParams& lp, IonStore& store, size_t index)
+    : trap_(trap), Ion(type, lp, store, index) {
 }
 
 /**
@@ -34,7 +37,7 @@ TrappedIon::TrappedIon(const IonTrap_ptr trap, const IonType& type, const LaserP
  *  @param dt   Time step.
  */
 inline void TrappedIon::kick(double dt) {
-    Vector3D f = trap_->force_now(pos_);
+    Vector3D f = trap_->force_now(get_pos());
     f *= ionType_.charge;
     this->Ion::kick(dt, f);
 }
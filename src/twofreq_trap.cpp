@@ -33,8 +33,35 @@ TwoFreq_trap::TwoFreq_trap(const TrapParams& params)
  *  @param dt   Time step.
  */
 void TwoFreq_trap::evolve(double dt) {
-    time_now_ += dt; 
-    cos_phase = 0.5 * (cos(2.0*time_now_) + cos (2.0*time_now_*freq_mult)); 
+    cos_phase = advance(dt) ? table_phase() : phase_at(time_now_);
+}
+
+
+/** @brief The trapping voltage amplitude at time `time`.
+ *
+ *  @param time Time in simulation units.
+ */
+double TwoFreq_trap::phase_at(double time) const {
+    return 0.5 * (cos(2.0*time) + cos (2.0*time*freq_mult));
+}
+
+
+/** @brief The time after which both cosines have made a whole number of
+ *  cycles.
+ *
+ *  This is a whole number of RF periods when the multiplier is a fraction
+ *  with a small denominator, otherwise the waveform is taken not to repeat.
+ *
+ *  @return The period, or zero if there is none.
+ */
+double TwoFreq_trap::period() const {
+    const int max_periods = 64;
+    for (int n = 1; n <= max_periods; ++n) {
+        double cycles = n*freq_mult;
+        if (std::abs(cycles - std::round(cycles)) < 1e-9*n)
+            return n*pi;
+    }
+    return 0.0;
 }
 
 /**
@@ -17,69 +17,109 @@ VerletIntegrator::VerletIntegrator(const IonTrap_ptr it, const IonCloud_ptr ic,
         //std::cout<<"Here 15\n";
         //log.info("Verlet integration.");
         //std::cout<<"Here 16\n"<<std::flush;
-        n_iter_ = 0;
+        const Ion_ptr_vector& ions = ions_->get_ions();
+        for (size_t i = 0; i < ions.size(); ++i) {
+            if (ions[i]->get_type().is_laser_cooled)
+                cooled_.push_back(ions[i]);
+            else
+                uncooled_.push_back(i);
+        }
+        // The trap is evolved by half steps.
+        trap_->use_phase_table(params_.time_step/2.0);
+        switch (trap_->wave()) {
+            case TrapParams::cosine:
+                select_step<CosineTrap>();
+                break;
+            case TrapParams::digital:
+                select_step<PulsedTrap>();
+                break;
+            case TrapParams::waveform:
+                select_step<WaveformTrap>();
+                break;
+            case TrapParams::cosine_decay:
+                select_step<CosineDecayTrap>();
+                break;
+            case TrapParams::twofreq:
+                select_step<TwoFreq_trap>();
+                break;
+        }
 }
 
-void VerletIntegrator::evolve(double dt) {
-    double half_dt = dt/2.0;
 
-    std::vector<Vector3D> coulomb_force = coulomb_.get_force();
-    int j = 0;
-    int k = 0;
-    auto _ions = ions_->get_ions();
-    long length = _ions.size();
-
-#ifdef _OPENMP  
-  
-//#pragma omp parallel default(shared) private(k,j) shared(_ions, length, coulomb_force, half_dt, dt)
-//{     
-//#pragma omp for 
-#endif
+/** @brief Use the step for this type of trap, and with laser cooling only
+ *  if there are laser cooled ions.
+ */
+template <class Trap>
+void VerletIntegrator::select_step() {
+    if (cooled_.empty())
+        step_ = &VerletIntegrator::step<Trap, false>;
+    else
+        step_ = &VerletIntegrator::step<Trap, true>;
+}
 
-    for (int j = 0; j < length; j++){
-        auto ion =* (_ions.begin() + j);
-        // Calculate velocity at half time-step, uses Coulomb force from
-        // previous time step.
-        ion->kick(half_dt, coulomb_force[j]);
-        ion->heat(half_dt);   // Heating
-        ion->kick(half_dt);   // Trap, plus heating if LaserCooled.
 
-        // Update positions by full time step
-         ion->drift(dt);
+/** @brief Half-kick the ions by the trap, heating and cooling the laser
+ *  cooled ones, after their Coulomb half-kick.
+ *
+ *  @param trap     The trap, of its own type.
+ *  @param dt       Half step.
+ */
+template <class Trap, bool Cooled>
+void VerletIntegrator::trap_kick(Trap& trap, double dt) {
+    const Vector3D c = trap.coefficients_at(trap.Trap::get_phase());
+    if (!Cooled) {
+        ions_->linear_kick(dt, c);
+        return;
     }
-#ifdef _OPENMP
-//    #pragma omp single
-#endif
-    {
-    // Calculate new acceleration
-    coulomb_.update();
-    trap_->evolve(half_dt);
-
-    coulomb_force = coulomb_.get_force();
-    //i = 0;
+    ions_->linear_kick(dt, c, uncooled_);
+    for (const auto& ion : cooled_) {
+        ion->heat(dt);
+        ion->kick(dt);   // Trap, plus cooling.
     }
-#ifdef _OPENMP    
-//    #pragma omp for
-#endif 
-    for (int k = 0; k < length; k++){
-        auto ion =* (_ions.begin() + k);
-        // Update velocity over second half time-step
-        ion->kick(half_dt, coulomb_force[k] );
-        ion->heat(half_dt);   // Heating
-        ion->kick(half_dt);   // Trap, plus heating if LaserCooled.
-    }
-#ifdef _OPENMP
-//    #pragma omp single
-#endif    
-    {
-    // Update trap again.
+}
+
+
+/** @brief Advance the ions by one velocity Verlet step of \c dt.
+ *
+ *  The Coulomb force is evaluated once per step, at the positions after the
+ *  drift, and kept for the first half-kick of the next step. With a Coulomb
+ *  worker thread the force calculation runs while the trap is updated.
+ *
+ *  The step is compiled for each type of trap, which is evolved and read
+ *  without a virtual call. The trap force is linear in position, so it is
+ *  applied to all ions in one loop over the IonStore from the coefficients
+ *  of IonTrap::coefficients_at. Heating and laser cooling only act on laser
+ *  cooled ions, so they are left out of the step altogether when there are
+ *  none. Otherwise each laser cooled ion is heated between its Coulomb and
+ *  trap kicks, and its trap kick and cooling are applied by its Ion object,
+ *  ion by ion, while the other ions are kicked by the trap together. The
+ *  order of operations on each ion and of the random numbers is that of
+ *  the kicks and drift of its Ion object. The compiler may still round the
+ *  batched trap kick differently from TrappedIon::kick, so long runs drift
+ *  apart from the ion by ion step at rounding level.
+ *
+ *  @param dt   Time step.
+ */
+template <class Trap, bool Cooled>
+void VerletIntegrator::step(double dt) {
+    const double half_dt = dt/2.0;
+    Trap& trap = static_cast<Trap&>(*trap_);
+
+    // Coulomb force at the current positions, from the previous step. The
+    // reference is only valid until the next update.
+    ions_->kick(half_dt, coulomb_.get_force());
+    trap_kick<Trap, Cooled>(trap, half_dt);
+    ions_->drift(dt);
+
+    // The one force evaluation of the step.
     coulomb_.update();
-    trap_->evolve(half_dt);
+    trap.Trap::evolve(half_dt);
+
+    // Velocity over the second half step.
+    ions_->kick(half_dt, coulomb_.get_force());
+    trap_kick<Trap, Cooled>(trap, half_dt);
+    trap.Trap::evolve(half_dt);
 
     // Tell everyone we're done
     notifyListeners(n_iter_++);
-    }
 }
-#ifdef _OPENMP
-//}
-#endif
@@ -42,7 +42,7 @@
  *  @param params   Reference to the trap parameters object.
  */
 WaveformTrap::WaveformTrap(const TrapParams& params)
-    : IonTrap(params) {
+    : IonTrap(params), potential_(0.0) {
     Logger &log = Logger::getInstance();
     log.info("Initialising a waveform trap...");
     std::ifstream wfFile(params_.waveformFile.c_str(), std::ifstream::in);
@@ -72,9 +72,18 @@ WaveformTrap::WaveformTrap(const TrapParams& params)
  *  @param dt   Time step.
  */
 void WaveformTrap::evolve(double dt) {
-    time_now_ += dt;
+    potential_ = advance(dt) ? table_phase() : phase_at(time_now_);
+}
+
+
+/**
+ *  @brief The interpolated waveform amplitude at time `time`.
+ *
+ *  @param time Time in simulation units.
+ */
+double WaveformTrap::phase_at(double time) const {
     // Get the fractional part of the time
-    double timeFrac = std::fmod(time_now_/pi, 1);
+    double timeFrac = std::fmod(time/pi, 1);
     // Fractional position in the array
     double arrPos = timeFrac * npts_;
     // Get the voltage at the points either side of this, looping back to the
@@ -85,13 +94,13 @@ void WaveformTrap::evolve(double dt) {
     if (i1 == i2) {
         // If these are the same, we're directly on a defined voltage, so
         // return that
-        potential_ = amplitudes_[i1];
+        return amplitudes_[i1];
     } else {
         // Otherwise, we have to interpolate.
         double v1 = amplitudes_[i1];
         double v2 = amplitudes_[i2];
         // Perform a linear interpolation between these voltages
-        potential_ = v1 + (v2-v1) * (arrPos - std::floor(arrPos));
+        return v1 + (v2-v1) * (arrPos - std::floor(arrPos));
     }
 }
 